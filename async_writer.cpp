@@ -0,0 +1,250 @@
+#include "async_writer.h"
+#include "trace.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+namespace {
+
+// Completions in a row that make no progress (EINTR/EAGAIN) before a write is failed
+constexpr int MAX_WRITE_RETRIES = 16;
+
+} // namespace
+
+AsyncWriter::File::~File() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+AsyncWriter::AsyncWriter(size_t queue_depth, size_t fallback_threads)
+    : queue_(queue_depth), queue_depth_(queue_depth > 0 ? queue_depth : 1) {
+#ifdef HAVE_LIBURING
+    // io_uring needs kernel 5.1+; older kernels (e.g. L4T 4.9) fall back to pwrite
+    io_uring* ring = new io_uring;
+    if (io_uring_queue_init(static_cast<unsigned>(queue_depth_), ring, 0) == 0) {
+        ring_ = ring;
+        use_uring_ = true;
+        threads_.emplace_back(&AsyncWriter::runUring, this);
+        return;
+    }
+    delete ring;
+#endif
+
+    if (fallback_threads == 0) {
+        fallback_threads = 1;
+    }
+    for (size_t i = 0; i < fallback_threads; i++) {
+        threads_.emplace_back(&AsyncWriter::runPwrite, this);
+    }
+}
+
+AsyncWriter::~AsyncWriter() {
+    flush();
+    queue_.close();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+
+#ifdef HAVE_LIBURING
+    if (ring_) {
+        io_uring* ring = static_cast<io_uring*>(ring_);
+        io_uring_queue_exit(ring);
+        delete ring;
+    }
+#endif
+}
+
+AsyncWriter::FileHandle AsyncWriter::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::make_shared<File>(fd, path);
+}
+
+void AsyncWriter::write(const FileHandle& file, std::vector<uint8_t> data) {
+    if (!file || data.empty()) {
+        return;
+    }
+
+    std::unique_ptr<Request> request(new Request);
+    request->file = file;
+    request->data = std::move(data);
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        request->offset = file->next_offset_;
+        file->next_offset_ += request->data.size();
+        pending_++;
+    }
+
+    queue_.push(std::move(request));
+}
+
+bool AsyncWriter::writeFile(const std::string& path, std::vector<uint8_t> data) {
+    FileHandle file = open(path);
+    if (!file) {
+        return false;
+    }
+    write(file, std::move(data));
+    return true;
+}
+
+bool AsyncWriter::flush() {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    pending_done_.wait(lock, [this] { return pending_ == 0; });
+    return !failed_.exchange(false);
+}
+
+std::vector<std::string> AsyncWriter::takeFailedPaths() {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    std::vector<std::string> paths;
+    paths.swap(failed_paths_);
+    return paths;
+}
+
+const char* AsyncWriter::backend() const {
+    return use_uring_ ? "io_uring" : "pwrite";
+}
+
+void AsyncWriter::complete(int error, const std::string& path) {
+    if (error != 0) {
+        std::cerr << "Failed to write " << path << ": " << std::strerror(error) << std::endl;
+        failed_ = true;
+    }
+
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    if (error != 0) {
+        failed_paths_.push_back(path);
+    }
+    if (--pending_ == 0) {
+        pending_done_.notify_all();
+    }
+}
+
+int AsyncWriter::writeBlocking(Request& request) {
+    while (request.written < request.data.size()) {
+        ssize_t result = ::pwrite(request.file->fd(), request.data.data() + request.written,
+                                  request.data.size() - request.written, request.offset + request.written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        if (result == 0) {
+            return EIO;
+        }
+        request.written += static_cast<size_t>(result);
+    }
+    return 0;
+}
+
+void AsyncWriter::runPwrite() {
+    TRACE_THREAD_NAME("pwrite");
+    std::unique_ptr<Request> request;
+    while (queue_.pop(request)) {
+        TRACE_MARK(write_start);
+        int error = writeBlocking(*request);
+        TRACE_SINCE("disk_write", write_start);
+        std::string path = request->file->path();
+        request.reset();
+        complete(error, path);
+    }
+}
+
+void AsyncWriter::runUring() {
+#ifdef HAVE_LIBURING
+    TRACE_THREAD_NAME("io_uring");
+    io_uring* ring = static_cast<io_uring*>(ring_);
+    size_t in_flight = 0;
+
+    // Queue a write for the next io_uring_submit(). A full submission queue is flushed
+    // to the kernel first; if it stays full the request is written synchronously.
+    auto submit = [this, ring, &in_flight](Request* request) {
+        io_uring_sqe* sqe = io_uring_get_sqe(ring);
+        if (!sqe) {
+            io_uring_submit(ring);
+            sqe = io_uring_get_sqe(ring);
+        }
+        if (!sqe) {
+            int error = writeBlocking(*request);
+            std::string path = request->file->path();
+            delete request;
+            complete(error, path);
+            return;
+        }
+        io_uring_prep_write(sqe, request->file->fd(), request->data.data() + request->written,
+                            static_cast<unsigned>(request->data.size() - request->written),
+                            request->offset + request->written);
+        io_uring_sqe_set_data(sqe, request);
+        in_flight++;
+    };
+
+    while (true) {
+        // Block for work only when nothing is in flight, then batch whatever is queued
+        std::unique_ptr<Request> request;
+        if (in_flight == 0) {
+            if (!queue_.pop(request)) {
+                break;
+            }
+            submit(request.release());
+        }
+        while (in_flight < queue_depth_ && queue_.tryPop(request)) {
+            submit(request.release());
+        }
+        if (in_flight == 0) {
+            continue;
+        }
+        io_uring_submit(ring);
+
+        // Reap at least one completion, then everything already available
+        io_uring_cqe* cqe = nullptr;
+        TRACE_MARK(wait_start);
+        int waited = io_uring_wait_cqe(ring, &cqe);
+        TRACE_SINCE("disk_wait", wait_start);
+        if (waited < 0) {
+            continue;
+        }
+        while (cqe) {
+            Request* done = static_cast<Request*>(io_uring_cqe_get_data(cqe));
+            int result = cqe->res;
+            io_uring_cqe_seen(ring, cqe);
+            in_flight--;
+
+            // A zero-length write would be resubmitted forever; transient errors are
+            // retried a bounded number of times
+            int error = 0;
+            if (result == 0) {
+                error = EIO;
+            } else if (result == -EINTR || result == -EAGAIN) {
+                error = ++done->retries > MAX_WRITE_RETRIES ? -result : 0;
+            } else if (result < 0) {
+                error = -result;
+            } else {
+                done->written += static_cast<size_t>(result);
+                done->retries = 0;
+            }
+
+            if (error == 0 && done->written < done->data.size()) {
+                // Short write or retry: resubmit the remainder
+                submit(done);
+            } else {
+                std::string path = done->file->path();
+                delete done;
+                complete(error, path);
+            }
+
+            cqe = nullptr;
+            io_uring_peek_cqe(ring, &cqe);
+        }
+    }
+#endif
+}
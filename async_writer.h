@@ -0,0 +1,116 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "bounded_queue.h"
+
+// Batched asynchronous file writer shared by the tools in this repo.
+//
+// Callers hand over complete buffers and continue computing; a background thread
+// submits the writes in batches through io_uring (when built with HAVE_LIBURING and
+// supported by the kernel) or through a small pool of threads calling pwrite().
+// The submission queue is bounded, so producers block instead of piling up buffers.
+class AsyncWriter {
+public:
+    // Open output file; closed once the handle is released and its writes completed
+    class File;
+    typedef std::shared_ptr<File> FileHandle;
+
+    /**
+     * @param queue_depth Maximum number of writes queued or in flight
+     * @param fallback_threads Worker threads used by the pwrite backend
+     */
+    explicit AsyncWriter(size_t queue_depth = 64, size_t fallback_threads = 2);
+
+    // Waits for all queued writes
+    ~AsyncWriter();
+
+    /**
+     * Create (or truncate) a file for sequential writes
+     * @param path File path
+     * @return Handle, or nullptr if the file cannot be created
+     */
+    FileHandle open(const std::string& path);
+
+    /**
+     * Queue a write at the current end of the file (writes to one file land in call order)
+     * @param file Handle from open()
+     * @param data Buffer to write, moved into the writer
+     */
+    void write(const FileHandle& file, std::vector<uint8_t> data);
+
+    /**
+     * Create a file holding exactly one buffer
+     * @param path File path
+     * @param data File contents, moved into the writer
+     * @return false if the file cannot be created (write errors are reported by flush())
+     */
+    bool writeFile(const std::string& path, std::vector<uint8_t> data);
+
+    /**
+     * Wait until every queued write has completed
+     * @return false if any write failed since the last flush()
+     */
+    bool flush();
+
+    /**
+     * Paths of the writes that failed since the last call (call after flush())
+     * @return Failed file paths, each listed once per failed write
+     */
+    std::vector<std::string> takeFailedPaths();
+
+    /**
+     * @return "io_uring" or "pwrite"
+     */
+    const char* backend() const;
+
+private:
+    struct Request {
+        FileHandle file;
+        std::vector<uint8_t> data;
+        uint64_t offset = 0;
+        size_t written = 0;
+        int retries = 0;     // io_uring completions in a row without progress
+    };
+
+    void runUring();
+    void runPwrite();
+    int writeBlocking(Request& request);
+    void complete(int error, const std::string& path);
+
+    BoundedQueue<std::unique_ptr<Request>> queue_;
+    std::vector<std::thread> threads_;
+    size_t queue_depth_;
+    bool use_uring_ = false;
+    void* ring_ = nullptr;
+
+    std::mutex pending_mutex_;
+    std::condition_variable pending_done_;
+    size_t pending_ = 0;
+    std::vector<std::string> failed_paths_;
+    std::atomic<bool> failed_{false};
+};
+
+class AsyncWriter::File {
+public:
+    File(int fd, const std::string& path) : fd_(fd), path_(path) {}
+    ~File();
+
+    int fd() const { return fd_; }
+    const std::string& path() const { return path_; }
+
+private:
+    friend class AsyncWriter;
+    int fd_;
+    std::string path_;
+    uint64_t next_offset_ = 0;   // Assigned at submission, so writes keep call order
+};
+
+#endif // ASYNC_WRITER_H
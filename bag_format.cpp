@@ -0,0 +1,225 @@
+#include "bag_format.h"
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Record header and data of the next record; false at the end of the file
+bool readRecord(std::ifstream& file, std::vector<uint8_t>& header, std::vector<uint8_t>& data, bool read_data) {
+    uint8_t length[4];
+    if (!file.read(reinterpret_cast<char*>(length), 4)) {
+        return false;
+    }
+    header.resize(BagFormat::readU32(length));
+    if (!file.read(reinterpret_cast<char*>(header.data()), header.size()) ||
+        !file.read(reinterpret_cast<char*>(length), 4)) {
+        return false;
+    }
+    uint32_t data_len = BagFormat::readU32(length);
+    if (!read_data) {
+        data.clear();
+        return static_cast<bool>(file.seekg(data_len, std::ios::cur));
+    }
+    data.resize(data_len);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), data.size()));
+}
+
+// Time field (u32 seconds, u32 nanoseconds) in nanoseconds
+bool timeField(const std::map<std::string, std::string>& fields, const char* name, uint64_t& ns) {
+    auto field = fields.find(name);
+    if (field == fields.end() || field->second.size() != 8) {
+        return false;
+    }
+    const uint8_t* value = reinterpret_cast<const uint8_t*>(field->second.data());
+    ns = static_cast<uint64_t>(BagFormat::readU32(value)) * 1000000000ULL + BagFormat::readU32(value + 4);
+    return true;
+}
+
+} // namespace
+
+uint32_t BagFormat::readU32(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+           (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+uint64_t BagFormat::readU64(const uint8_t* in) {
+    return static_cast<uint64_t>(readU32(in)) | (static_cast<uint64_t>(readU32(in + 4)) << 32);
+}
+
+uint64_t BagFormat::fnv1a(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool BagFormat::parseRecordHeader(const uint8_t* data, size_t size, std::map<std::string, std::string>& fields) {
+    size_t pos = 0;
+    while (pos < size) {
+        if (size - pos < 4) {
+            return false;
+        }
+        uint32_t field_len = readU32(data + pos);
+        pos += 4;
+        if (field_len > size - pos) {
+            return false;
+        }
+
+        const char* field = reinterpret_cast<const char*>(data + pos);
+        const void* equals = std::memchr(field, '=', field_len);
+        if (!equals) {
+            return false;
+        }
+        size_t name_len = static_cast<const char*>(equals) - field;
+        fields[std::string(field, name_len)] = std::string(field + name_len + 1, field_len - name_len - 1);
+        pos += field_len;
+    }
+    return true;
+}
+
+bool BagFormat::readHeader(const std::string& path, BagHeaderInfo& info) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    info.file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    char magic[BAG_MAGIC_SIZE];
+    file.read(magic, BAG_MAGIC_SIZE);
+    if (!file || std::memcmp(magic, BAG_MAGIC, BAG_MAGIC_SIZE) != 0) {
+        return false;
+    }
+
+    uint8_t length[4];
+    file.read(reinterpret_cast<char*>(length), 4);
+    uint32_t header_len = readU32(length);
+    if (!file || header_len > 4096) {
+        return false;
+    }
+
+    std::vector<uint8_t> header(header_len);
+    file.read(reinterpret_cast<char*>(header.data()), header_len);
+    std::map<std::string, std::string> fields;
+    if (!file || !parseRecordHeader(header.data(), header.size(), fields)) {
+        return false;
+    }
+
+    auto op = fields.find("op");
+    auto index_pos = fields.find("index_pos");
+    auto conn_count = fields.find("conn_count");
+    auto chunk_count = fields.find("chunk_count");
+    if (op == fields.end() || op->second.size() != 1 || static_cast<uint8_t>(op->second[0]) != BAG_OP_BAG_HEADER ||
+        index_pos == fields.end() || index_pos->second.size() != 8 ||
+        conn_count == fields.end() || conn_count->second.size() != 4 ||
+        chunk_count == fields.end() || chunk_count->second.size() != 4) {
+        return false;
+    }
+
+    info.index_pos = readU64(reinterpret_cast<const uint8_t*>(index_pos->second.data()));
+    info.conn_count = readU32(reinterpret_cast<const uint8_t*>(conn_count->second.data()));
+    info.chunk_count = readU32(reinterpret_cast<const uint8_t*>(chunk_count->second.data()));
+    return info.index_pos > BAG_MAGIC_SIZE && info.index_pos <= info.file_size;
+}
+
+bool BagFormat::hashIndex(const std::string& path, uint64_t& hash) {
+    BagHeaderInfo info;
+    if (!readHeader(path, info)) {
+        return false;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(info.index_pos, std::ios::beg);
+    if (!file) {
+        return false;
+    }
+
+    // The sizes go first so a truncated or appended bag never matches
+    hash = fnv1a(&info.file_size, sizeof(info.file_size));
+    hash = fnv1a(&info.index_pos, sizeof(info.index_pos), hash);
+
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        hash = fnv1a(buffer.data(), static_cast<size_t>(file.gcount()), hash);
+    }
+    return file.eof();
+}
+
+bool BagFormat::readChunkInfos(const std::string& path, std::vector<BagChunkInfo>& chunks, std::string& compression) {
+    chunks.clear();
+    compression.clear();
+    BagHeaderInfo info;
+    if (!readHeader(path, info)) {
+        return false;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(info.index_pos, std::ios::beg);
+    if (!file) {
+        return false;
+    }
+
+    // The index holds connection records followed by one chunk info per chunk
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> data;
+    while (readRecord(file, header, data, true)) {
+        std::map<std::string, std::string> fields;
+        if (!parseRecordHeader(header.data(), header.size(), fields)) {
+            return false;
+        }
+        auto op = fields.find("op");
+        if (op == fields.end() || op->second.size() != 1 || static_cast<uint8_t>(op->second[0]) != BAG_OP_CHUNK_INFO) {
+            continue;
+        }
+
+        BagChunkInfo chunk;
+        auto chunk_pos = fields.find("chunk_pos");
+        auto count = fields.find("count");
+        if (chunk_pos == fields.end() || chunk_pos->second.size() != 8 ||
+            count == fields.end() || count->second.size() != 4 ||
+            !timeField(fields, "start_time", chunk.start_ns) || !timeField(fields, "end_time", chunk.end_ns)) {
+            return false;
+        }
+        chunk.pos = readU64(reinterpret_cast<const uint8_t*>(chunk_pos->second.data()));
+
+        // count is the number of connections; the data holds (conn, message count) pairs
+        uint32_t connections = readU32(reinterpret_cast<const uint8_t*>(count->second.data()));
+        if (data.size() < static_cast<size_t>(connections) * 8) {
+            return false;
+        }
+        for (uint32_t i = 0; i < connections; i++) {
+            chunk.message_count += readU32(data.data() + i * 8 + 4);
+        }
+        chunks.push_back(chunk);
+    }
+    if (chunks.size() != info.chunk_count) {
+        return false;
+    }
+
+    std::sort(chunks.begin(), chunks.end(),
+              [](const BagChunkInfo& a, const BagChunkInfo& b) { return a.pos < b.pos; });
+    for (size_t i = 0; i < chunks.size(); i++) {
+        uint64_t next = i + 1 < chunks.size() ? chunks[i + 1].pos : info.index_pos;
+        chunks[i].size = next > chunks[i].pos ? next - chunks[i].pos : 0;
+    }
+    if (chunks.empty()) {
+        return true;
+    }
+
+    // All chunks of a recording share the compression of the first one
+    file.clear();
+    file.seekg(chunks.front().pos, std::ios::beg);
+    std::map<std::string, std::string> fields;
+    if (!readRecord(file, header, data, false) || !parseRecordHeader(header.data(), header.size(), fields)) {
+        return false;
+    }
+    auto chunk_compression = fields.find("compression");
+    compression = chunk_compression != fields.end() ? chunk_compression->second : "none";
+    return true;
+}
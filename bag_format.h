@@ -0,0 +1,95 @@
+#ifndef BAG_FORMAT_H
+#define BAG_FORMAT_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <cstdint>
+
+// Minimal reader for the ROS bag v2.0 container, independent of the rosbag library.
+//
+// A bag starts with "#ROSBAG V2.0\n" followed by records:
+//   u32 header_len, header fields (u32 field_len, "name=value"), u32 data_len, data
+// (all integers little-endian). The bag header record (op 0x03) stores index_pos, the
+// offset of the index section (connection and chunk info records) at the end of the file.
+
+constexpr const char* BAG_MAGIC = "#ROSBAG V2.0\n";
+constexpr size_t BAG_MAGIC_SIZE = 13;
+
+// Record op codes
+constexpr uint8_t BAG_OP_MESSAGE_DATA = 0x02;
+constexpr uint8_t BAG_OP_BAG_HEADER = 0x03;
+constexpr uint8_t BAG_OP_INDEX_DATA = 0x04;
+constexpr uint8_t BAG_OP_CHUNK = 0x05;
+constexpr uint8_t BAG_OP_CHUNK_INFO = 0x06;
+constexpr uint8_t BAG_OP_CONNECTION = 0x07;
+
+struct BagHeaderInfo {
+    uint64_t index_pos = 0;     // Offset of the index section
+    uint32_t conn_count = 0;
+    uint32_t chunk_count = 0;
+    uint64_t file_size = 0;
+};
+
+// Chunk info record of the index section (times in nanoseconds since the epoch)
+struct BagChunkInfo {
+    uint64_t pos = 0;            // Offset of the chunk record
+    uint64_t start_ns = 0;       // Earliest message in the chunk
+    uint64_t end_ns = 0;         // Latest message in the chunk
+    uint32_t message_count = 0;
+    uint64_t size = 0;           // File bytes up to the next chunk or the index (compressed size)
+};
+
+class BagFormat {
+public:
+    /**
+     * Split a record header into its name=value fields
+     * @param data Header bytes (without the length prefix)
+     * @param size Header size in bytes
+     * @param fields Output map of field name to raw value bytes
+     * @return false if a field runs past the header or has no '='
+     */
+    static bool parseRecordHeader(const uint8_t* data, size_t size, std::map<std::string, std::string>& fields);
+
+    /**
+     * Read the bag header record
+     * @param path Bag file path
+     * @param info Output header information
+     * @return false if the file is not a v2.0 bag or is still being written (index_pos 0)
+     */
+    static bool readHeader(const std::string& path, BagHeaderInfo& info);
+
+    /**
+     * Hash the index section of a bag (connections, chunk infos and their time ranges).
+     * The index describes every message, so this identifies the bag content without
+     * reading the chunks.
+     * @param path Bag file path
+     * @param hash Output 64-bit hash
+     * @return true on success
+     */
+    static bool hashIndex(const std::string& path, uint64_t& hash);
+
+    /**
+     * Read the chunk info records of the index section, without reading any chunk data
+     * @param path Bag file path
+     * @param chunks Output chunk infos in file order
+     * @param compression Output compression of the first chunk ("none", "bz2" or "lz4",
+     *                    empty for a bag without chunks)
+     * @return true on success
+     */
+    static bool readChunkInfos(const std::string& path, std::vector<BagChunkInfo>& chunks, std::string& compression);
+
+    /**
+     * 64-bit FNV-1a hash, chainable through the seed
+     * @param data Bytes to hash
+     * @param size Number of bytes
+     * @param seed Previous hash (or the FNV offset basis)
+     * @return Updated hash
+     */
+    static uint64_t fnv1a(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+    static uint32_t readU32(const uint8_t* in);
+    static uint64_t readU64(const uint8_t* in);
+};
+
+#endif // BAG_FORMAT_H
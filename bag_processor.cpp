@@ -0,0 +1,2002 @@
+#include "bag_processor.h"
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+#include <mutex>
+#include <sys/resource.h>
+
+// ROS includes
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/NavSatFix.h>
+#include <ros/serialization.h>
+#include <cv_bridge/cv_bridge.h>
+
+// OpenCV includes
+#include <opencv2/opencv.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+// Boost for filesystem (C++14 compatible)
+#include <boost/filesystem.hpp>
+
+#include "task_scheduler.h"
+#include "async_writer.h"
+#include "sync_index.h"
+#include "bag_format.h"
+#include "output_cache.h"
+#include "sprite_sheet.h"
+#include "telemetry.h"
+#include "jpeg_encoder.h"
+#include "parallel_bag_reader.h"
+#include "mapped_bag.h"
+#include "h264_sample.h"
+#include "bag_stream_reader.h"
+#include "h264_stream_encoder.h"
+#include "trace.h"
+
+namespace {
+
+// A converted frame waiting to be written by a worker thread
+struct FrameJob {
+    std::string topic_name;
+    std::string filepath;
+    cv::Mat image;
+    MemoryReservation reservation;   // Released once the frame has been written
+    SpriteSheetBuilder* sprites = nullptr;
+    long sprite_tile = -1;           // Tile ordinal when the frame is also a sprite
+};
+
+// Telemetry is recorded from BagMessage; messages read through a View are copied out
+const BagMessage& to_bag_message(const BagMessage& message) {
+    return message;
+}
+
+BagMessage to_bag_message(const rosbag::MessageInstance& instance) {
+    return BagMessage::fromInstance(instance);
+}
+
+BagMessage to_bag_message(const MappedMessage& mapped) {
+    BagMessage message;
+    message.topic = mapped.getTopic();
+    message.datatype = mapped.getDataType();
+    message.md5sum = mapped.getMD5Sum();
+    message.time = mapped.getTime();
+    message.data.assign(mapped.data, mapped.data + mapped.data_size);
+    return message;
+}
+
+// Convert an image message for JPEG encoding: color to bgr8, mono16 scaled to 8 bits
+cv_bridge::CvImagePtr to_cv_image(const sensor_msgs::ImageConstPtr& image_msg) {
+    cv_bridge::CvImagePtr cv_ptr;
+    try {
+        // Try to convert the image
+        if (image_msg->encoding == "bgr8" || image_msg->encoding == "rgb8") {
+            cv_ptr = cv_bridge::toCvCopy(image_msg, "bgr8");
+        } else if (image_msg->encoding == "mono8") {
+            cv_ptr = cv_bridge::toCvCopy(image_msg, "mono8");
+        } else if (image_msg->encoding == "mono16") {
+            cv_ptr = cv_bridge::toCvCopy(image_msg, "mono16");
+            // Convert 16-bit to 8-bit
+            cv_ptr->image.convertTo(cv_ptr->image, CV_8UC1, 1.0/256.0);
+        } else {
+            // Try default conversion
+            cv_ptr = cv_bridge::toCvCopy(image_msg, "bgr8");
+        }
+    } catch (cv_bridge::Exception& e) {
+        // If conversion fails, try with original encoding
+        cv_ptr = cv_bridge::toCvCopy(image_msg);
+    }
+    return cv_ptr;
+}
+
+// Time of the message of a topic nearest to time, from the index only: the first
+// message at or after time, and the last one before it, searched in a window that
+// doubles until it holds a message. Ties go to the earlier message.
+bool nearest_message_time(rosbag::Bag& bag, const std::string& topic, const ros::Time& time, ros::Time& nearest) {
+    rosbag::TopicQuery query(topic);
+    rosbag::View topic_view(bag, query);
+    if (topic_view.size() == 0) {
+        return false;
+    }
+    uint64_t begin_ns = topic_view.getBeginTime().toNSec();
+    uint64_t time_ns = time.toNSec();
+
+    bool found_after = false;
+    uint64_t after_ns = 0;
+    rosbag::View after_view(bag, query, time, ros::TIME_MAX);
+    rosbag::View::iterator after = after_view.begin();
+    if (after != after_view.end()) {
+        found_after = true;
+        after_ns = after->getTime().toNSec();
+    }
+
+    bool found_before = false;
+    uint64_t before_ns = 0;
+    uint64_t window_ns = 100000000ULL;
+    while (!found_before && time_ns > begin_ns) {
+        uint64_t from_ns = time_ns - std::min(window_ns, time_ns - begin_ns);
+        ros::Time from;
+        ros::Time to;
+        from.fromNSec(from_ns);
+        to.fromNSec(time_ns - 1);
+        for (const rosbag::MessageInstance& msg : rosbag::View(bag, query, from, to)) {
+            before_ns = msg.getTime().toNSec();
+            found_before = true;
+        }
+        if (from_ns == begin_ns) {
+            break;
+        }
+        window_ns *= 2;
+    }
+
+    if (!found_before && !found_after) {
+        return false;
+    }
+    bool use_before = found_before && (!found_after || time_ns - before_ns <= after_ns - time_ns);
+    nearest.fromNSec(use_before ? before_ns : after_ns);
+    return true;
+}
+
+// Deserialize and convert an image message read through rosbag
+template <class Message>
+cv::Mat decode_frame(const Message& msg) {
+    TRACE_MARK(deserialize_start);
+    sensor_msgs::ImageConstPtr image_msg = msg.template instantiate<sensor_msgs::Image>();
+    TRACE_SINCE("deserialize", deserialize_start);
+    if (!image_msg) {
+        return cv::Mat();
+    }
+    TRACE_MARK(convert_start);
+    cv_bridge::CvImagePtr cv_ptr = to_cv_image(image_msg);
+    TRACE_SINCE("convert", convert_start);
+    return cv_ptr ? cv_ptr->image : cv::Mat();
+}
+
+// Mapped bgr8 and mono8 frames are used in place; rgb8 and little-endian mono16 are
+// converted straight from the mapping as cv_bridge would. Other encodings take the
+// cv_bridge path.
+cv::Mat decode_frame(const MappedMessage& msg) {
+    ImageView view;
+    if (msg.getDataType() == "sensor_msgs/Image" && msg.imageView(view) && view.width > 0 && view.height > 0) {
+        TRACE_SPAN("convert");
+        int rows = static_cast<int>(view.height);
+        int cols = static_cast<int>(view.width);
+        uint8_t* data = const_cast<uint8_t*>(view.data);
+        uint64_t width = view.width;
+        if (view.encodingIs("bgr8") && view.step >= width * 3) {
+            return cv::Mat(rows, cols, CV_8UC3, data, view.step);
+        }
+        if (view.encodingIs("mono8") && view.step >= width) {
+            return cv::Mat(rows, cols, CV_8UC1, data, view.step);
+        }
+        if (view.encodingIs("rgb8") && view.step >= width * 3) {
+            cv::Mat bgr;
+            cv::cvtColor(cv::Mat(rows, cols, CV_8UC3, data, view.step), bgr, cv::COLOR_RGB2BGR);
+            return bgr;
+        }
+        if (view.encodingIs("mono16") && !view.is_bigendian && view.step >= width * 2 && view.step % 2 == 0) {
+            cv::Mat mono8;
+            cv::Mat(rows, cols, CV_16UC1, data, view.step).convertTo(mono8, CV_8UC1, 1.0/256.0);
+            return mono8;
+        }
+    }
+    return decode_frame<MappedMessage>(msg);
+}
+
+// Helper function to parse the frame number from "image_0123_1751959747.173.jpg"
+int frame_number_from_image(const std::string& filename) {
+    size_t first_underscore = filename.find('_');
+    size_t second_underscore = filename.find('_', first_underscore + 1);
+    if (first_underscore == std::string::npos || second_underscore == std::string::npos) {
+        return -1;
+    }
+    try {
+        return std::stoi(filename.substr(first_underscore + 1, second_underscore - first_underscore - 1));
+    } catch (...) {
+        return -1;
+    }
+}
+
+// Helper function to list the extracted JPG files of a topic ordered by frame number
+std::vector<std::string> list_frame_images(const std::string& images_dir) {
+    std::vector<std::pair<int, std::string>> frames;
+    for (auto& file : boost::filesystem::directory_iterator(images_dir)) {
+        if (file.path().extension() == ".jpg") {
+            std::string filename = file.path().filename().string();
+            frames.emplace_back(frame_number_from_image(filename), filename);
+        }
+    }
+    std::sort(frames.begin(), frames.end());
+
+    std::vector<std::string> result;
+    for (const auto& frame : frames) {
+        result.push_back(frame.second);
+    }
+    return result;
+}
+
+// Image topics are recognised by message type or topic name
+bool is_image_topic(const std::string& topic_name, const std::string& msg_type) {
+    return msg_type.find("Image") != std::string::npos || topic_name.find("image") != std::string::npos;
+}
+
+} // namespace
+
+BagProcessor::BagProcessor(const std::string& bag_path, const std::string& output_dir, const std::string& timestamp,
+                           const ProcessorOptions& options)
+    : bag_path_(bag_path), output_dir_(output_dir), timestamp_(timestamp), options_(options),
+      memory_budget_(options.max_memory_bytes) {}
+
+BagProcessor::~BagProcessor() = default;
+
+TaskScheduler& BagProcessor::scheduler() {
+    if (!scheduler_) {
+        SchedulerOptions scheduler_options;
+        scheduler_options.threads = options_.worker_threads > 0 ? static_cast<size_t>(options_.worker_threads) : 0;
+        scheduler_options.reserved_cores = options_.reserved_cores;
+        scheduler_options.pin_threads = options_.pin_threads;
+        scheduler_.reset(new TaskScheduler(scheduler_options));
+    }
+    return *scheduler_;
+}
+
+void BagProcessor::reportProgress(ProcessingStage stage, const std::string& topic, size_t done, size_t total) const {
+    if (options_.on_progress) {
+        options_.on_progress(ProgressEvent{stage, topic, done, total});
+    }
+}
+
+// Encode the images of a topic into independent closed-GOP segments and concatenate
+// the Annex-B output. Segment n holds the frames of topic messages [n * segment_frames,
+// (n + 1) * segment_frames), so every shard cuts exactly where a single-node run does,
+// even when some messages do not decode. Segments run as nested tasks on the shared
+// scheduler, so one long topic spreads over all workers; concatenating them in order
+// keeps sample numbers, and with them the SEI timestamps, continuous.
+int BagProcessor::encodeSegmented(const std::string& images_dir, const std::string& h264_raw_path) {
+    std::vector<std::string> frames = list_frame_images(images_dir);
+    if (frames.empty()) {
+        return 1;
+    }
+
+    std::ofstream output(h264_raw_path, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        return 1;
+    }
+
+    std::string abs_images_dir = boost::filesystem::absolute(images_dir).string();
+    size_t segment_frames = static_cast<size_t>(options_.segment_frames);
+
+    // Message number of every frame; frame numbers when the topic was not extracted here
+    std::vector<size_t> messages;
+    for (const auto& topic_dir_pair : topic_directories_) {
+        auto topic_messages = frame_messages_.find(topic_dir_pair.first);
+        if (topic_dir_pair.second == images_dir && topic_messages != frame_messages_.end() &&
+            topic_messages->second.size() == frames.size()) {
+            messages = topic_messages->second;
+        }
+    }
+    if (messages.empty()) {
+        for (size_t i = 0; i < frames.size(); i++) {
+            messages.push_back(i);
+        }
+    }
+
+    // Frame ranges of the non-empty segments, in order
+    std::vector<std::pair<size_t, size_t>> segments;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (segments.empty() || messages[i] / segment_frames != messages[i - 1] / segment_frames) {
+            segments.emplace_back(i, i);
+        }
+        segments.back().second = i + 1;
+    }
+    size_t segment_count = segments.size();
+
+    // Parallelism comes from running segments side by side; each ffmpeg keeps the fixed
+    // x264 thread count of the options (see encodeSegment)
+    std::vector<int> results(segment_count, 0);
+    {
+        TaskGroup segment_tasks(scheduler());
+        for (size_t segment = 0; segment < segment_count; segment++) {
+            segment_tasks.run([&, segment]() {
+                results[segment] = cancelled_ ? 1 : encodeSegment(frames, segments[segment].first,
+                                                                  segments[segment].second, abs_images_dir,
+                                                                  h264_raw_path, segment);
+            });
+        }
+        segment_tasks.wait();
+    }
+
+    int result = 0;
+    for (size_t segment = 0; segment < segment_count; segment++) {
+        std::string segment_path = h264_raw_path + ".seg" + std::to_string(segment) + ".h264";
+        if (result == 0 && results[segment] == 0) {
+            std::ifstream input(segment_path, std::ios::binary);
+            output << input.rdbuf();
+        } else if (result == 0) {
+            result = results[segment];
+        }
+        std::remove(segment_path.c_str());
+    }
+
+    if (result != 0) {
+        return result;
+    }
+    return output ? 0 : 1;
+}
+
+// Encode frames [begin, end) to <h264_raw_path>.seg<n>.h264; returns the ffmpeg exit code
+int BagProcessor::encodeSegment(const std::vector<std::string>& frames, size_t begin, size_t end,
+                                const std::string& abs_images_dir, const std::string& h264_raw_path, size_t segment) {
+    TRACE_SPAN("encode_segment");
+    std::string segment_dir = h264_raw_path + ".seg" + std::to_string(segment);
+    std::string segment_path = segment_dir + ".h264";
+
+    // Link the segment's frames under sequential names for the image2 demuxer
+    boost::filesystem::remove_all(segment_dir);
+    create_directories(segment_dir);
+    for (size_t i = begin; i < end; i++) {
+        std::ostringstream link_name;
+        link_name << segment_dir << "/frame_" << std::setfill('0') << std::setw(6) << (i - begin) << ".jpg";
+        boost::filesystem::create_symlink(abs_images_dir + "/" + frames[i], link_name.str());
+    }
+
+    std::ostringstream cmd;
+    cmd << "ffmpeg -y -loglevel error "
+        << "-framerate 30 "
+        << "-start_number 0 "
+        << "-i '" << segment_dir << "/frame_%06d.jpg' "
+        << "-vf 'scale=trunc(iw/2)*2:trunc(ih/2)*2' "
+        << "-c:v libx264 "
+        << "-pix_fmt yuv420p "
+        << "-threads " << options_.x264_threads << " "  // Output depends on it: never host-derived
+        << "-g " << options_.gop_size << " "  // Fixed closed GOPs
+        << "-keyint_min " << options_.gop_size << " "
+        << "-sc_threshold 0 "
+        << "-flags +cgop "
+        << "-r 30 "
+        << "-bsf:v h264_mp4toannexb "
+        << "-f h264 "
+        << "'" << segment_path << "'";
+
+    int result;
+    {
+        // ffmpeg inherits the CPU mask of this thread; a pinned worker widens it first
+        ScopedAffinity affinity(scheduler().allowedCpus());
+        result = system(cmd.str().c_str());
+    }
+    boost::filesystem::remove_all(segment_dir);
+    if (result != 0) {
+        std::cout << "❌ Segment encoding failed (exit code: " << result << "): " << segment_path << std::endl;
+        return result;
+    }
+
+    // Frame timestamps are assigned by sample number, so a segment must hold exactly its frames
+    std::ifstream input(segment_path, std::ios::binary);
+    std::vector<uint8_t> stream((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    std::vector<NalUnitRef> nals;
+    H264Sample::parseAnnexB(stream.data(), stream.size(), nals);
+    size_t pictures = H264Sample::countPictures(nals);
+    if (pictures != end - begin) {
+        std::cout << "❌ Segment " << segment << " has " << pictures << " pictures, expected "
+                  << (end - begin) << ": " << segment_path << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+std::string BagProcessor::shardStreamPath(const std::string& images_dir) const {
+    return output_dir_ + "/" + boost::filesystem::path(images_dir).filename().string() + "_30fps.h264";
+}
+
+bool BagProcessor::convertImagesToVideo(const std::string& images_dir, const std::string& output_video_path) {
+    TRACE_SPAN("encode");
+    std::cout << "🎬 Converting images to H264 video..." << std::endl;
+    std::cout << "  Input: " << images_dir << std::endl;
+    std::cout << "  Output: " << output_video_path << std::endl;
+
+    // First, create a raw H264 stream without container
+    std::string h264_raw_path = output_video_path + ".h264";
+
+    if (options_.segment_frames > 0) {
+        std::cout << "Encoding in parallel segments of " << options_.segment_frames << " frames (GOP "
+                  << options_.gop_size << ", " << options_.x264_threads << " x264 threads each)" << std::endl;
+        int result = encodeSegmented(images_dir, h264_raw_path);
+        return packageH264Stream(images_dir, h264_raw_path, output_video_path, result);
+    }
+
+    // ffmpeg command to convert images to raw H264 stream
+    std::ostringstream cmd;
+    cmd << "ffmpeg -y "  // -y to overwrite output file
+        << "-framerate 30 "  // Input framerate
+        << "-pattern_type glob "  // Use glob pattern
+        << "-i '" << images_dir << "/*.jpg' "  // Input pattern
+        << "-vf 'scale=trunc(iw/2)*2:trunc(ih/2)*2' "  // Ensure even dimensions
+        << "-c:v libx264 "  // H264 codec
+        << "-pix_fmt yuv420p "  // Pixel format
+        << "-r 30 "  // Output framerate
+        << "-bsf:v h264_mp4toannexb "  // Convert to Annex B format
+        << "-f h264 "  // Raw H264 output
+        << "'" << h264_raw_path << "'";
+
+    std::cout << "Running: " << cmd.str() << std::endl;
+
+    TRACE_MARK(ffmpeg_start);
+    int result = system(cmd.str().c_str());
+    TRACE_SINCE("ffmpeg_encode", ffmpeg_start);
+    return packageH264Stream(images_dir, h264_raw_path, output_video_path, result);
+}
+
+// Package an encoded Annex-B stream into MP4 and generate the streaming samples
+bool BagProcessor::packageH264Stream(const std::string& images_dir, const std::string& h264_raw_path,
+                                     const std::string& output_video_path, int result) {
+    if (result == 0) {
+        std::cout << "✅ H264 stream creation successful: " << h264_raw_path << std::endl;
+
+        // Shards keep their raw stream for the merge step, which packages the whole topic
+        if (isSharded()) {
+            std::string stream_path = shardStreamPath(images_dir);
+            boost::filesystem::rename(h264_raw_path, stream_path);
+            std::cout << "✅ Shard stream kept for merge: " << stream_path << std::endl;
+            return true;
+        }
+
+        // Now inject timestamps into the H264 stream
+        std::string h264_timestamped_path = output_video_path + ".timestamped.h264";
+        // Skip old timestamp injection - we'll inject real timestamps later
+        std::cout << "⏭️  Skipping intermediate timestamp injection (will inject real timestamps later)" << std::endl;
+
+        // Just copy the raw H264 to timestamped path for now
+        std::ostringstream copy_cmd;
+        copy_cmd << "cp '" << h264_raw_path << "' '" << h264_timestamped_path << "'";
+        int inject_result = system(copy_cmd.str().c_str());
+
+        if (inject_result == 0) {
+            std::cout << "✅ H264 file prepared for timestamp injection: " << h264_timestamped_path << std::endl;
+
+            // Package the timestamped H264 stream into MP4 container
+            std::ostringstream package_cmd;
+            package_cmd << "ffmpeg -y "
+                       << "-f h264 "
+                       << "-i '" << h264_timestamped_path << "' "
+                       << "-c:v copy "
+                       << "'" << output_video_path << "'";
+
+            TRACE_MARK(package_start);
+            int package_result = system(package_cmd.str().c_str());
+            TRACE_SINCE("package_mp4", package_start);
+
+            if (package_result == 0) {
+                std::cout << "✅ Final MP4 packaging successful: " << output_video_path << std::endl;
+
+                // Generate H264 files for streaming
+                std::string h264_output_dir = streamingOutputDir(images_dir);
+                if (generateH264FilesForStreaming(h264_timestamped_path, h264_output_dir)) {
+                    std::cout << "✅ H264 streaming files generated: " << h264_output_dir << std::endl;
+                } else {
+                    std::cout << "⚠️  H264 streaming file generation failed" << std::endl;
+                }
+
+                // Clean up intermediate files
+                std::remove(h264_raw_path.c_str());
+                std::remove(h264_timestamped_path.c_str());
+            } else {
+                std::cout << "⚠️  MP4 packaging failed, keeping raw H264 files" << std::endl;
+            }
+        } else {
+            std::cout << "⚠️  Timestamp injection failed, creating standard MP4 without timestamps" << std::endl;
+
+            // Fall back to creating MP4 without timestamps
+            std::ostringstream fallback_cmd;
+            fallback_cmd << "ffmpeg -y "
+                        << "-f h264 "
+                        << "-i '" << h264_raw_path << "' "
+                        << "-c:v copy "
+                        << "'" << output_video_path << "'";
+            int fallback_result = system(fallback_cmd.str().c_str());
+
+            if (fallback_result == 0) {
+                // Still generate H264 files for streaming (without timestamps)
+                std::string h264_output_dir = streamingOutputDir(images_dir);
+                if (generateH264FilesForStreaming(h264_raw_path, h264_output_dir)) {
+                    std::cout << "✅ H264 streaming files generated (without timestamps): " << h264_output_dir << std::endl;
+                }
+            }
+
+            std::remove(h264_raw_path.c_str());
+        }
+
+        return true;
+    } else {
+        std::cout << "❌ Video conversion failed (exit code: " << result << ")" << std::endl;
+        return false;
+    }
+}
+
+std::string BagProcessor::spritesDir(const std::string& topic_name) const {
+    return output_dir_ + "/sprites/" + topicDirectoryName(topic_name);
+}
+
+std::string BagProcessor::streamingOutputDir(const std::string& images_dir) const {
+    return options_.h264_root + "/" + timestamp_ + "/" + boost::filesystem::path(images_dir).filename().string() + "_30fps";
+}
+
+// Everything that changes the per-topic outputs for the same bag
+std::string BagProcessor::cacheParameters() const {
+    std::ostringstream parameters;
+    parameters << "v1"
+               << " packed=" << options_.packed_samples
+               << " per_file=" << options_.per_file_samples
+               << " gop=" << options_.gop_size
+               << " segment_frames=" << options_.segment_frames
+               << " x264_threads=" << options_.x264_threads
+               << " splitter=" << options_.generate_h264_script
+               << " sprites=" << options_.sprite_interval_us << "/" << options_.sprite_tile_width << "/"
+               << options_.sprite_columns << "x" << options_.sprite_rows << "/" << options_.sprite_format
+               << " jpeg=" << JpegEncoder::backend() << "/" << options_.jpeg_quality << "/" << options_.jpeg_subsampling
+               << " telemetry=";
+    for (const auto& topic : options_.telemetry_topics) {
+        parameters << topic << ",";
+    }
+    return parameters.str();
+}
+
+// Restore every image topic that has a complete cache entry and drop it from
+// image_topics_, so only the remaining topics are extracted and encoded
+void BagProcessor::restoreCachedTopics(const OutputCache& cache, uint64_t bag_hash) {
+    TRACE_SPAN("cache_restore");
+    std::string parameters = cacheParameters();
+    std::vector<TopicInfo> remaining;
+
+    for (const auto& topic : image_topics_) {
+        std::string key = OutputCache::topicKey(bag_hash, topic.topic_name, parameters);
+        cache_keys_[topic.topic_name] = key;
+
+        std::string metadata;
+        std::string images_dir = output_dir_ + "/" + topicDirectoryName(topic.topic_name);
+        std::string video_path = images_dir + "_30fps.mp4";
+        std::map<std::string, std::string> destinations = {
+            {"images", images_dir},
+            {"video.mp4", video_path},
+            {"samples", streamingOutputDir(images_dir)},
+        };
+        if (options_.sprite_interval_us > 0) {
+            destinations["sprites"] = spritesDir(topic.topic_name);
+        }
+        if (!cache.contains(key) || !cache.restore(key, destinations, metadata)) {
+            remaining.push_back(topic);
+            continue;
+        }
+
+        // Metadata: "frames <n>" followed by one frame timestamp (us) per line
+        std::istringstream fields(metadata);
+        std::string label;
+        size_t frame_count = 0;
+        fields >> label >> frame_count;
+        std::vector<uint64_t>& timestamps = frame_timestamps_us_[topic.topic_name];
+        timestamps.clear();
+        uint64_t timestamp_us;
+        while (timestamps.size() < frame_count && fields >> timestamp_us) {
+            timestamps.push_back(timestamp_us);
+        }
+
+        topic_directories_[topic.topic_name] = images_dir;
+        extraction_counts_[topic.topic_name] = static_cast<int>(timestamps.size());
+        if (!timestamps.empty()) {
+            first_timestamps_us_[topic.topic_name] = timestamps.front();
+            last_timestamps_us_[topic.topic_name] = timestamps.back();
+        }
+        cached_topics_.insert(topic.topic_name);
+        std::cout << "♻️  Reusing cached outputs for " << topic.topic_name << " (" << key << ")" << std::endl;
+    }
+
+    image_topics_.swap(remaining);
+}
+
+// Store the outputs of a freshly encoded topic
+// Called from concurrent encode tasks, so the member maps are only read
+void BagProcessor::storeTopicInCache(const OutputCache& cache, const std::string& topic_name) {
+    TRACE_SPAN("cache_store");
+    const std::string& images_dir = topic_directories_.at(topic_name);
+    const std::vector<uint64_t>& frame_times = frame_timestamps_us_.at(topic_name);
+    std::string samples_dir = streamingOutputDir(images_dir);
+    if (!boost::filesystem::exists(samples_dir)) {
+        return;
+    }
+
+    std::ostringstream metadata;
+    metadata << "frames " << frame_times.size() << "\n";
+    for (uint64_t timestamp_us : frame_times) {
+        metadata << timestamp_us << "\n";
+    }
+
+    std::map<std::string, std::string> sources = {
+        {"images", images_dir},
+        {"video.mp4", images_dir + "_30fps.mp4"},
+        {"samples", samples_dir},
+    };
+    if (options_.sprite_interval_us > 0) {
+        if (!boost::filesystem::exists(spritesDir(topic_name))) {
+            return;
+        }
+        sources["sprites"] = spritesDir(topic_name);
+    }
+    if (!cache.store(cache_keys_.at(topic_name), sources, metadata.str())) {
+        std::cout << "⚠️  Could not cache outputs of " << topic_name << std::endl;
+    }
+}
+
+// Helper function to replace filesystem functionality
+bool BagProcessor::file_exists(const std::string& path) {
+    struct stat buffer;
+    return (stat(path.c_str(), &buffer) == 0);
+}
+
+void BagProcessor::create_directories(const std::string& path) {
+    boost::filesystem::create_directories(path);
+}
+
+bool BagProcessor::generateH264FilesForStreaming(const std::string& timestamped_h264_path, const std::string& output_dir) {
+    TRACE_SPAN("split");
+    std::cout << "🎬 Generating H264 files for streaming..." << std::endl;
+    std::cout << "  Input: " << timestamped_h264_path << std::endl;
+    std::cout << "  Output: " << output_dir << std::endl;
+
+    // Create output directory
+    create_directories(output_dir);
+
+    // Step 1: Split H264 into individual frame files
+    std::ostringstream cmd;
+    cmd << "python3 '" << options_.generate_h264_script << "' "
+        << "-i '" << timestamped_h264_path << "' "
+        << "-o '" << output_dir << "/'";
+    if (options_.packed_samples) {
+        cmd << " --packed";
+        if (options_.per_file_samples) {
+            cmd << " --split-files";
+        }
+    }
+
+    std::cout << "Running: " << cmd.str() << std::endl;
+
+    int result = system(cmd.str().c_str());
+
+    if (result == 0) {
+        std::cout << "✅ H264 streaming files generated successfully" << std::endl;
+
+        // Skip automatic timestamp injection - will be done manually after Docker
+        std::cout << "INFO: H264 files generated without SEI timestamps" << std::endl;
+        std::cout << "INFO: Use fix_sei_for_flutter.sh script after copying files to backend" << std::endl;
+
+        return true;
+    } else {
+        std::cout << "❌ H264 streaming file generation failed (exit code: " << result << ")" << std::endl;
+        return false;
+    }
+}
+
+// Split every image topic into shard_count slices of whole segments. Each shard
+// computes the same plan from the bag index, so no coordination is needed. Slices are
+// counted in messages, and encodeSegmented() cuts segments on the same message numbers,
+// so messages that fail to decode do not move a shard boundary off a segment boundary.
+void BagProcessor::planShard() {
+    size_t segment_frames = static_cast<size_t>(options_.segment_frames);
+
+    std::cout << "Shard " << options_.shard_index << "/" << options_.shard_count
+              << " (segments of " << segment_frames << " messages):" << std::endl;
+
+    for (const auto& topic : image_topics_) {
+        const std::vector<ros::Time>& times = topic_times_[topic.topic_name];
+        size_t segments = (times.size() + segment_frames - 1) / segment_frames;
+        size_t first_segment = segments * options_.shard_index / options_.shard_count;
+        size_t last_segment = segments * (options_.shard_index + 1) / options_.shard_count;
+
+        TopicRange range;
+        range.first_message = std::min(times.size(), first_segment * segment_frames);
+        size_t end_message = std::min(times.size(), last_segment * segment_frames);
+        range.message_count = end_message - range.first_message;
+
+        if (range.message_count > 0) {
+            range.start_time = times[range.first_message];
+            range.end_time = times[end_message - 1];
+
+            // Messages sharing the first timestamp that precede the slice
+            for (size_t i = range.first_message; i > 0 && times[i - 1] == range.start_time; i--) {
+                range.skip++;
+            }
+        }
+
+        topic_ranges_[topic.topic_name] = range;
+        std::cout << "  " << topic.topic_name << ": messages " << range.first_message << "-"
+                  << (range.first_message + range.message_count) << " of " << times.size() << std::endl;
+    }
+
+    topic_times_.clear();
+}
+
+// Peak memory of the in-process stages plus the largest child (ffmpeg, splitter)
+void BagProcessor::reportMemoryUsage() const {
+    std::cout << std::endl;
+    memory_budget_.report(std::cout);
+
+    struct rusage self_usage;
+    struct rusage child_usage;
+    getrusage(RUSAGE_SELF, &self_usage);
+    getrusage(RUSAGE_CHILDREN, &child_usage);
+    std::cout << "  Process peak RSS: " << (self_usage.ru_maxrss / 1024) << " MiB" << std::endl;
+    std::cout << "  Largest child peak RSS (encode/split): " << (child_usage.ru_maxrss / 1024) << " MiB" << std::endl;
+}
+
+// Write manifest.txt describing the topics extracted into output_dir_
+bool BagProcessor::writeManifest() {
+    std::ofstream manifest(output_dir_ + "/manifest.txt");
+    if (!manifest) {
+        return false;
+    }
+
+    manifest << "# bag_processor manifest v1" << std::endl;
+    manifest << "bag " << boost::filesystem::path(bag_path_).filename().string() << std::endl;
+    manifest << "shard " << options_.shard_index << " " << options_.shard_count << std::endl;
+    manifest << "segment_frames " << options_.segment_frames << " " << options_.gop_size << " "
+             << options_.x264_threads << std::endl;
+
+    for (const auto& topic_dir_pair : topic_directories_) {
+        const std::string& topic_name = topic_dir_pair.first;
+        size_t first_message = isSharded() ? topic_ranges_[topic_name].first_message : 0;
+        manifest << "topic " << topic_name << " "
+                 << boost::filesystem::path(topic_dir_pair.second).filename().string() << " "
+                 << first_message << " " << extraction_counts_[topic_name] << " "
+                 << first_timestamps_us_[topic_name] << " " << last_timestamps_us_[topic_name] << std::endl;
+    }
+
+    return static_cast<bool>(manifest);
+}
+
+// Write frame_times.txt ("<topic> <timestamp_us>" per frame) so a merge can rebuild the sync index
+bool BagProcessor::writeFrameTimes() {
+    std::ofstream times(output_dir_ + "/frame_times.txt");
+    for (const auto& topic : frame_timestamps_us_) {
+        for (uint64_t timestamp_us : topic.second) {
+            times << topic.first << " " << timestamp_us << "\n";
+        }
+    }
+    return static_cast<bool>(times);
+}
+
+// Build the cross-camera sync index from the recorded frame timestamps
+bool BagProcessor::writeSyncIndex() {
+    TRACE_SPAN("sync_index");
+    SyncIndex index;
+    bool built = false;
+
+    if (options_.sync_tick_us > 0) {
+        built = index.buildFromTicks(frame_timestamps_us_, options_.sync_tick_us);
+        std::cout << "Sync index reference: every " << options_.sync_tick_us << " us" << std::endl;
+    } else {
+        std::string master = options_.sync_master;
+        if (master.empty()) {
+            size_t most_frames = 0;
+            for (const auto& topic : frame_timestamps_us_) {
+                if (topic.second.size() > most_frames) {
+                    most_frames = topic.second.size();
+                    master = topic.first;
+                }
+            }
+        }
+        built = index.buildFromMaster(frame_timestamps_us_, master);
+        std::cout << "Sync index reference: frames of " << master << std::endl;
+    }
+
+    if (!built) {
+        std::cerr << "⚠️  No frames for the sync index reference" << std::endl;
+        return false;
+    }
+    if (!index.write(output_dir_)) {
+        std::cerr << "⚠️  Failed to write " << SYNC_INDEX_FILENAME << std::endl;
+        return false;
+    }
+
+    std::cout << "🔗 Sync index: " << index.rowCount() << " rows x " << frame_timestamps_us_.size()
+              << " topics -> " << output_dir_ << "/" << SYNC_INDEX_FILENAME << std::endl;
+    return true;
+}
+
+bool BagProcessor::analyzeBag() {
+    TRACE_SPAN("analyze");
+    std::cout << "=== ANALYZING BAG FILE ===" << std::endl;
+    std::cout << "Bag file: " << bag_path_ << std::endl;
+    std::cout << "==============================" << std::endl;
+
+    try {
+        rosbag::Bag bag;
+        bag.open(bag_path_, rosbag::bagmode::Read);
+
+        // Get bag info
+        rosbag::View view(bag);
+        
+        // Count total messages and get duration
+        int total_messages = 0;
+        ros::Time start_time = ros::TIME_MAX;
+        ros::Time end_time = ros::TIME_MIN;
+        
+        std::map<std::string, int> topic_counts;
+        std::map<std::string, std::string> topic_types;
+
+        // First pass: collect metadata
+        size_t view_size = view.size();
+        reportProgress(ProcessingStage::Analyze, "", 0, view_size);
+        for (const rosbag::MessageInstance& msg : view) {
+            if (cancelled_) {
+                bag.close();
+                return false;
+            }
+            total_messages++;
+            if (total_messages % 1000 == 0) {
+                reportProgress(ProcessingStage::Analyze, "", total_messages, view_size);
+            }
+            
+            if (msg.getTime() < start_time) start_time = msg.getTime();
+            if (msg.getTime() > end_time) end_time = msg.getTime();
+            
+            std::string topic = msg.getTopic();
+            topic_counts[topic]++;
+            topic_types[topic] = msg.getDataType();
+
+            // Message times are needed to cut GOP-aligned shards (index data only)
+            if (isSharded()) {
+                topic_times_[topic].push_back(msg.getTime());
+            }
+        }
+
+        reportProgress(ProcessingStage::Analyze, "", total_messages, view_size);
+        double duration = (end_time - start_time).toSec();
+        
+        for (const auto& topic_pair : topic_counts) {
+            const std::string& topic_name = topic_pair.first;
+            int count = topic_pair.second;
+            const std::string& msg_type = topic_types[topic_name];
+            
+            // Check if this is an image topic
+            if (is_image_topic(topic_name, msg_type)) {
+                
+                TopicInfo info;
+                info.topic_name = topic_name;
+                info.msg_type = msg_type;
+                info.msg_count = count;
+                image_topics_.push_back(info);
+            }
+        }
+
+        // Display found image topics
+        if (!image_topics_.empty()) {
+            std::cout << "Found " << image_topics_.size() << " image topics:" << std::endl;
+            // for (const auto& topic : image_topics_) {
+            //     std::cout << "  - " << topic.topic_name << ": " << topic.msg_count << " images" << std::endl;
+            // }
+        } else {
+            std::cout << "No image topics found!" << std::endl;
+            bag.close();
+            return false;
+        }
+
+        bag.close();
+
+        if (isSharded()) {
+            planShard();
+        }
+
+        std::cout << std::endl;
+        return true;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error analyzing bag file: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool BagProcessor::createOutputDirectories() {
+    try {
+        // Create main output directory
+        create_directories(output_dir_);
+        
+        // Create directories for each image topic
+        for (const auto& topic : image_topics_) {
+            topicDirectory(topic.topic_name);
+        }
+        
+        std::cout << std::endl;
+        return true;
+        
+    } catch (const std::exception& e) {
+        std::cerr << "Error creating directories: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::string BagProcessor::topicDirectoryName(const std::string& topic_name) const {
+    // Clean topic name for directory (replace / with _)
+    std::string dir_name = topic_name;
+    std::replace(dir_name.begin(), dir_name.end(), '/', '_');
+    std::replace(dir_name.begin(), dir_name.end(), ':', '_');
+
+    // Remove leading/trailing underscores
+    if (!dir_name.empty() && dir_name[0] == '_') {
+        dir_name = dir_name.substr(1);
+    }
+    return dir_name;
+}
+
+const std::string& BagProcessor::topicDirectory(const std::string& topic_name) {
+    auto it = topic_directories_.find(topic_name);
+    if (it != topic_directories_.end()) {
+        return it->second;
+    }
+
+    std::string topic_dir = output_dir_ + "/" + topicDirectoryName(topic_name);
+    create_directories(topic_dir);
+
+    extraction_counts_[topic_name] = 0;
+    return topic_directories_[topic_name] = topic_dir;
+}
+
+// Find image topics from the connection records of the bag index. Unlike analyzeBag()
+// this reads no message data, so extraction is the only pass over the chunks.
+bool BagProcessor::discoverImageTopics(rosbag::Bag& bag) {
+    image_topics_.clear();
+
+    rosbag::View index_view(bag);
+    std::map<std::string, std::string> topic_types;
+    for (const rosbag::ConnectionInfo* connection : index_view.getConnections()) {
+        topic_types[connection->topic] = connection->datatype;
+    }
+
+    for (const auto& topic_pair : topic_types) {
+        if (is_image_topic(topic_pair.first, topic_pair.second)) {
+            TopicInfo info;
+            info.topic_name = topic_pair.first;
+            info.msg_type = topic_pair.second;
+            info.msg_count = static_cast<int>(rosbag::View(bag, rosbag::TopicQuery(topic_pair.first)).size());
+            image_topics_.push_back(info);
+        }
+    }
+
+    if (image_topics_.empty()) {
+        std::cout << "No image topics found!" << std::endl;
+        return false;
+    }
+    std::cout << "Found " << image_topics_.size() << " image topics (from the bag index)" << std::endl;
+    return true;
+}
+
+bool BagProcessor::extractImages() {
+    TRACE_SPAN("extract");
+    try {
+        rosbag::Bag bag;
+        bag.open(bag_path_, rosbag::bagmode::Read);
+
+        if (options_.single_pass && image_topics_.empty() && !discoverImageTopics(bag)) {
+            bag.close();
+            return false;
+        }
+
+        // Create view for image topics only
+        std::vector<std::string> image_topic_names;
+        for (const auto& topic : image_topics_) {
+            image_topic_names.push_back(topic.topic_name);
+        }
+        
+        // Shards only read their own time window of every topic
+        std::unique_ptr<rosbag::View> view_ptr;
+        if (isSharded()) {
+            view_ptr.reset(new rosbag::View());
+            for (const auto& topic : image_topics_) {
+                const TopicRange& range = topic_ranges_[topic.topic_name];
+                if (range.message_count > 0) {
+                    view_ptr->addQuery(bag, rosbag::TopicQuery(topic.topic_name), range.start_time, range.end_time);
+                }
+            }
+        } else {
+            view_ptr.reset(new rosbag::View(bag, rosbag::TopicQuery(image_topic_names)));
+        }
+        rosbag::View& view = *view_ptr;
+        size_t planned_messages = view.size();
+        if (isSharded()) {
+            planned_messages = 0;
+            for (const auto& range : topic_ranges_) {
+                planned_messages += range.second.message_count;
+            }
+        }
+
+        // Telemetry topics join the same traversal; tracks are created on their first
+        // message, once the datatype is known
+        TelemetryRecorder telemetry;
+        std::map<std::string, long> telemetry_tracks;
+        if (!options_.telemetry_topics.empty() && !isSharded()) {
+            std::vector<std::string> telemetry_names;
+            for (const auto& topic_name : options_.telemetry_topics) {
+                if (std::find(image_topic_names.begin(), image_topic_names.end(), topic_name) != image_topic_names.end()) {
+                    std::cout << "⚠️  Ignoring image topic as telemetry: " << topic_name << std::endl;
+                    continue;
+                }
+                telemetry_tracks[topic_name] = -1;
+                telemetry_names.push_back(topic_name);
+            }
+            if (!telemetry_names.empty()) {
+                view.addQuery(bag, rosbag::TopicQuery(telemetry_names));
+            }
+        }
+        
+        int processed_messages = 0;
+        std::map<std::string, int> success_counts;
+        std::map<std::string, int> attempt_counts;
+        std::map<std::string, int> frame_numbers;
+        std::map<std::string, size_t> window_counts;
+        std::set<std::string> failed_topics;    // Topics with a frame that was not written
+        std::mutex counts_mutex;
+        
+        // Initialize counters
+        for (const auto& topic : image_topics_) {
+            success_counts[topic.topic_name] = 0;
+            attempt_counts[topic.topic_name] = 0;
+            frame_numbers[topic.topic_name] = 0;
+            frame_timestamps_us_[topic.topic_name].clear();
+            frame_messages_[topic.topic_name].clear();
+        }
+
+        // JPEG encoding and writing are per-frame tasks on the shared scheduler. Its
+        // queue limit and the memory budget both block the bag reader when the
+        // encoders fall behind.
+        TaskScheduler& tasks = scheduler();
+
+        // Sprite builders exist before the first frame task, so tasks only read the map
+        std::map<std::string, std::unique_ptr<SpriteSheetBuilder>> sprite_builders;
+        if (options_.sprite_interval_us > 0 && !isSharded()) {
+            SpriteOptions sprite_options;
+            sprite_options.interval_us = options_.sprite_interval_us;
+            sprite_options.tile_width = options_.sprite_tile_width;
+            sprite_options.columns = options_.sprite_columns;
+            sprite_options.rows = options_.sprite_rows;
+            sprite_options.format = options_.sprite_format;
+            for (const auto& topic : image_topics_) {
+                sprite_builders[topic.topic_name].reset(
+                    new SpriteSheetBuilder(spritesDir(topic.topic_name), sprite_options));
+            }
+        }
+
+        // Encoded JPEGs are handed to the batched writer so encoders never wait on disk
+        AsyncWriter output_writer(tasks.threadCount() * 4);
+
+        JpegOptions jpeg_options;
+        jpeg_options.quality = options_.jpeg_quality;
+        jpeg_options.subsampling = options_.jpeg_subsampling;
+
+        auto encode_frame = [&](const std::shared_ptr<FrameJob>& job) {
+            // The sprite tile is cut from the decoded frame before it is released
+            if (job->sprite_tile >= 0) {
+                TRACE_SPAN("sprite_tile");
+                job->sprites->addTile(job->sprite_tile, job->image);
+            }
+            std::vector<uint8_t> encoded;
+            TRACE_MARK(encode_start);
+            // Each worker keeps its encoder and output buffer across frames
+            bool encoded_ok = JpegEncoder::forThread(jpeg_options).encode(job->image, encoded);
+            TRACE_SINCE("jpeg_encode", encode_start);
+            TRACE_MARK(submit_start);
+            bool saved = encoded_ok && output_writer.writeFile(job->filepath, std::move(encoded));
+            TRACE_SINCE("write_submit", submit_start);
+            job->image.release();
+            job->reservation.reset();
+
+            std::lock_guard<std::mutex> lock(counts_mutex);
+            if (saved) {
+                success_counts[job->topic_name]++;
+            } else {
+                std::cerr << "Failed to save image: " << job->filepath << std::endl;
+                failed_topics.insert(job->topic_name);
+            }
+        };
+
+        // Frames read through the mapping may point into it until encoded
+        MappedBag mapped_bag;
+
+        // Destroyed first on every exit path (including exceptions from the bag reader),
+        // so no frame task outlives the state above
+        TaskGroup frame_tasks(tasks);
+
+        // Handles one message from a rosbag::View, the parallel reader or the mapped bag
+        auto handle_message = [&](const auto& msg) {
+            std::string topic_name = msg.getTopic();
+
+            auto telemetry_track = telemetry_tracks.find(topic_name);
+            if (telemetry_track != telemetry_tracks.end()) {
+                recordTelemetry(to_bag_message(msg), telemetry, telemetry_track->second);
+                return;
+            }
+
+            // Keep exactly the planned slice: drop messages tied with the previous
+            // shard's last timestamp and anything past the slice end
+            if (isSharded()) {
+                TopicRange& range = topic_ranges_[topic_name];
+                if (range.skip > 0) {
+                    range.skip--;
+                    return;
+                }
+                if (window_counts[topic_name] >= range.message_count) {
+                    return;
+                }
+                window_counts[topic_name]++;
+            }
+
+            attempt_counts[topic_name]++;
+            processed_messages++;
+            size_t message_number = static_cast<size_t>(attempt_counts[topic_name] - 1) +
+                                    (isSharded() ? topic_ranges_[topic_name].first_message : 0);
+            if (processed_messages % 100 == 0) {
+                reportProgress(ProcessingStage::Extract, topic_name, processed_messages, planned_messages);
+            }
+
+            try {
+                // Reserve the serialized size before the message is read and deserialized
+                TRACE_MARK(budget_start);
+                MemoryReservation message_reservation(memory_budget_, "bag_read", msg.size());
+                TRACE_SINCE("budget_wait", budget_start);
+
+                // Convert the message to an OpenCV frame. Through a View this also reads the
+                // record from its (decompressed) chunk; mapped frames may point into the bag file.
+                cv::Mat image = decode_frame(msg);
+
+                // The message is no longer needed once converted
+                message_reservation.reset();
+
+                if (!image.empty()) {
+                    // Generate filename with timestamp
+                    double timestamp = msg.getTime().toSec();
+                    
+                    std::ostringstream filename_stream;
+                    filename_stream << "image_" 
+                                  << std::setfill('0') << std::setw(4) << frame_numbers[topic_name]
+                                  << "_" << std::fixed << std::setprecision(3) << timestamp
+                                  << ".jpg";
+
+                    uint64_t timestamp_us = msg.getTime().toNSec() / 1000;
+                    if (frame_numbers[topic_name] == 0) {
+                        first_timestamps_us_[topic_name] = timestamp_us;
+                    }
+                    last_timestamps_us_[topic_name] = timestamp_us;
+                    frame_timestamps_us_[topic_name].push_back(timestamp_us);
+                    frame_messages_[topic_name].push_back(message_number);
+
+                    // Hand the frame to the scheduler; blocks while the budget or queue is full
+                    std::shared_ptr<FrameJob> job = std::make_shared<FrameJob>();
+                    auto sprites = sprite_builders.find(topic_name);
+                    if (sprites != sprite_builders.end()) {
+                        job->sprites = sprites->second.get();
+                        job->sprite_tile = job->sprites->select(timestamp_us, frame_numbers[topic_name]);
+                    }
+                    frame_numbers[topic_name]++;
+
+                    job->topic_name = topic_name;
+                    job->filepath = topicDirectory(topic_name) + "/" + filename_stream.str();
+                    job->image = image;
+                    TRACE_SPAN("queue_wait");
+                    job->reservation = MemoryReservation(memory_budget_, "frame_queue",
+                                                         job->image.total() * job->image.elemSize());
+                    frame_tasks.run([&encode_frame, job]() { encode_frame(job); });
+                }
+            } catch (const std::exception& e) {
+                if (attempt_counts[topic_name] <= 5) {  // Only show first few errors
+                    std::cerr << "Error processing image " << attempt_counts[topic_name] 
+                             << " from " << topic_name << ": " << e.what() << std::endl;
+                }
+            }
+        };
+
+        std::vector<std::string> read_topics = image_topic_names;
+        for (const auto& telemetry_topic : telemetry_tracks) {
+            read_topics.push_back(telemetry_topic.first);
+        }
+
+        // Uncompressed bags can be read in place from a memory mapping
+        bool use_mapped = false;
+        if (options_.mapped_reader && !isSharded()) {
+            use_mapped = mapped_bag.open(bag_path_);
+            if (use_mapped) {
+                std::cout << "📖 Reading the memory-mapped bag" << std::endl;
+            } else {
+                std::cout << "⚠️  Cannot map the bag (compressed or not v2.0), reading through rosbag" << std::endl;
+            }
+        }
+
+        // Compressed bags are decompressed ahead of this loop on several threads
+        std::unique_ptr<ParallelBagReader> parallel_reader;
+        size_t read_threads = options_.read_threads > 0 ? static_cast<size_t>(options_.read_threads) : 0;
+        if (read_threads == 0 && !use_mapped) {
+            std::string compression = ParallelBagReader::chunkCompression(bag_path_);
+            read_threads = !compression.empty() && compression != "none"
+                               ? std::max<size_t>(2, std::min<size_t>(4, tasks.threadCount()))
+                               : 1;
+        }
+        if (read_threads > 1 && !isSharded() && !use_mapped) {
+            ParallelReadOptions read_options;
+            read_options.threads = read_threads;
+            // Read-ahead is held outside the budget's stages, so it gets at most half of the
+            // budget and decoding and the JPEG queue keep the rest
+            if (options_.max_memory_bytes > 0) {
+                read_options.max_buffered_bytes =
+                    std::min<uint64_t>(read_options.max_buffered_bytes, options_.max_memory_bytes / 2);
+            }
+            parallel_reader.reset(new ParallelBagReader(bag_path_, read_topics, read_options));
+            if (parallel_reader->start()) {
+                std::cout << "📖 Reading " << parallel_reader->windowCount() << " windows on "
+                          << parallel_reader->threadCount() << " threads" << std::endl;
+            } else {
+                std::cout << "⚠️  Cannot read the chunk index, reading on one thread" << std::endl;
+                parallel_reader.reset();
+            }
+        }
+
+        // bag_read spans cover advancing the view (or waiting for the readers) between two messages
+        reportProgress(ProcessingStage::Extract, "", 0, planned_messages);
+        TRACE_THREAD_NAME("bag_reader");
+        TRACE_MARK(read_start);
+        if (use_mapped) {
+            for (const MappedMessage& msg : mapped_bag.messages(read_topics)) {
+                TRACE_SINCE("bag_read", read_start);
+                TRACE_MARK_ON_EXIT(read_start);
+                if (cancelled_) {
+                    break;
+                }
+                handle_message(msg);
+            }
+        } else if (parallel_reader) {
+            BagMessage message;
+            while (!cancelled_ && parallel_reader->next(message)) {
+                TRACE_SINCE("bag_read", read_start);
+                TRACE_MARK_ON_EXIT(read_start);
+                handle_message(message);
+            }
+            parallel_reader.reset();
+        } else {
+            for (const rosbag::MessageInstance& msg : view) {
+                TRACE_SINCE("bag_read", read_start);
+                TRACE_MARK_ON_EXIT(read_start);
+                if (cancelled_) {
+                    break;
+                }
+                handle_message(msg);
+            }
+        }
+
+        frame_tasks.wait();
+        if (!output_writer.flush()) {
+            for (const std::string& path : output_writer.takeFailedPaths()) {
+                for (const auto& topic_dir_pair : topic_directories_) {
+                    if (path.compare(0, topic_dir_pair.second.size() + 1, topic_dir_pair.second + "/") == 0) {
+                        failed_topics.insert(topic_dir_pair.first);
+                    }
+                }
+            }
+        }
+
+        // Frame n of a topic is sample n downstream (injector, sync index, telemetry), so
+        // a missing image would shift every later timestamp: a topic with a failed write
+        // is dropped instead of being encoded with a hole
+        for (const std::string& topic_name : failed_topics) {
+            std::cerr << "❌ Images of " << topic_name << " could not be written ("
+                      << output_writer.backend() << " backend), the topic is skipped" << std::endl;
+            success_counts[topic_name] = 0;
+            frame_timestamps_us_.erase(topic_name);
+            frame_messages_.erase(topic_name);
+            first_timestamps_us_.erase(topic_name);
+            last_timestamps_us_.erase(topic_name);
+        }
+
+        for (auto& sprites : sprite_builders) {
+            if (!sprites.second->finish()) {
+                std::cerr << "⚠️  Some sprite sheets could not be written for " << sprites.first << std::endl;
+            } else if (sprites.second->tileCount() > 0) {
+                std::cout << "🖼️  " << sprites.second->tileCount() << " sprite tiles: " << spritesDir(sprites.first) << std::endl;
+            }
+        }
+
+        bag.close();
+
+        for (const auto& count : success_counts) {
+            extraction_counts_[count.first] = count.second;
+        }
+
+        if (!telemetry.tracks().empty() && !cancelled_) {
+            writeTelemetry(telemetry);
+        }
+        reportProgress(ProcessingStage::Extract, "", processed_messages, planned_messages);
+
+        if (cancelled_) {
+            std::cout << "⏹️  Extraction cancelled after " << processed_messages << " messages" << std::endl;
+            return false;
+        }
+
+        // Print final results
+        std::cout << std::endl << "Extraction completed:" << std::endl;
+        std::cout << "--------------------------------------------------" << std::endl;
+        
+        int total_attempted = 0;
+        int total_extracted = 0;
+        
+        for (const auto& topic : image_topics_) {
+            int attempted = attempt_counts[topic.topic_name];
+            int extracted = success_counts[topic.topic_name];
+            double success_rate = attempted > 0 ? (double(extracted) / attempted * 100.0) : 0.0;
+            
+            total_attempted += attempted;
+            total_extracted += extracted;
+            
+            std::cout << topic.topic_name << ":" << std::endl;
+            std::cout << "  Attempted: " << attempted << std::endl;
+            std::cout << "  Successful: " << extracted << std::endl;
+            std::cout << "  Success rate: " << std::fixed << std::setprecision(1) 
+                     << success_rate << "%" << std::endl;
+        }
+        
+        double overall_success = total_attempted > 0 ? (double(total_extracted) / total_attempted * 100.0) : 0.0;
+        std::cout << std::endl << "Overall Results:" << std::endl;
+        std::cout << "  Total attempted: " << total_attempted << std::endl;
+        std::cout << "  Total extracted: " << total_extracted << std::endl;
+        std::cout << "  Overall success rate: " << std::fixed << std::setprecision(1) 
+                 << overall_success << "%" << std::endl;
+
+        return total_extracted > 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error extracting images: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// Keep one telemetry message: GPS fixes as interpolatable values, anything else as
+// its raw serialization for the nearest-message lookup
+void BagProcessor::recordTelemetry(const BagMessage& msg, TelemetryRecorder& telemetry, long& track) {
+    TRACE_SPAN("telemetry_read");
+    uint64_t timestamp_us = msg.getTime().toNSec() / 1000;
+    try {
+        if (msg.getDataType() == "sensor_msgs/NavSatFix") {
+            sensor_msgs::NavSatFixConstPtr fix = msg.instantiate<sensor_msgs::NavSatFix>();
+            if (!fix) {
+                return;
+            }
+            if (track < 0) {
+                track = static_cast<long>(telemetry.addTrack(msg.getTopic(), msg.getDataType(), TelemetryKind::Interpolated));
+            }
+            telemetry.addValues(static_cast<size_t>(track), timestamp_us, {fix->latitude, fix->longitude, fix->altitude});
+            return;
+        }
+
+        if (track < 0) {
+            track = static_cast<long>(telemetry.addTrack(msg.getTopic(), msg.getDataType(), TelemetryKind::Nearest));
+        }
+        std::vector<uint8_t> buffer(msg.size());
+        ros::serialization::OStream stream(buffer.data(), static_cast<uint32_t>(buffer.size()));
+        msg.write(stream);
+        telemetry.addMessage(static_cast<size_t>(track), timestamp_us, buffer.data(), buffer.size());
+    } catch (const std::exception& e) {
+        std::cerr << "Error reading telemetry from " << msg.getTopic() << ": " << e.what() << std::endl;
+    }
+}
+
+// Sample the recorded telemetry at the frames of every image topic
+bool BagProcessor::writeTelemetry(const TelemetryRecorder& telemetry) {
+    bool all_written = true;
+    for (const auto& topic : image_topics_) {
+        const std::vector<uint64_t>& frame_times = frame_timestamps_us_[topic.topic_name];
+        auto topic_dir = topic_directories_.find(topic.topic_name);
+        if (frame_times.empty() || topic_dir == topic_directories_.end()) {
+            continue;
+        }
+        if (!telemetry.writeSidecar(topic_dir->second + "/" + TELEMETRY_FILENAME, frame_times)) {
+            std::cerr << "⚠️  Could not write telemetry for " << topic.topic_name << std::endl;
+            all_written = false;
+        }
+    }
+    std::cout << "📡 Telemetry: " << telemetry.messageCount() << " messages from " << telemetry.tracks().size()
+              << " topics sampled at every frame" << std::endl;
+    return all_written;
+}
+
+bool BagProcessor::process() {
+    std::cout << "Starting bag file processing..." << std::endl;
+    std::cout << "Bag file: " << bag_path_ << std::endl;
+    std::cout << "Output directory: " << output_dir_ << std::endl << std::endl;
+
+    // Cached outputs are keyed by the bag index; shards hold partial topics and are not cached
+    std::unique_ptr<OutputCache> cache;
+    uint64_t bag_hash = 0;
+    if (!options_.cache_dir.empty()) {
+        if (isSharded()) {
+            std::cout << "⚠️  Output cache is not used for sharded runs" << std::endl;
+        } else if (!BagFormat::hashIndex(bag_path_, bag_hash)) {
+            std::cout << "⚠️  Could not read the bag index, output cache disabled" << std::endl;
+        } else {
+            cache.reset(new OutputCache(options_.cache_dir));
+        }
+    }
+
+    // Step 1: Analyze bag file (single-pass mode finds the topics while extracting,
+    // unless the cache needs them up front; that only reads the index)
+    if (!options_.single_pass) {
+        if (!analyzeBag()) {
+            std::cerr << "Failed to analyze bag file" << std::endl;
+            return false;
+        }
+    } else if (cache) {
+        rosbag::Bag bag;
+        bag.open(bag_path_, rosbag::bagmode::Read);
+        bool found = discoverImageTopics(bag);
+        bag.close();
+        if (!found) {
+            return false;
+        }
+    }
+
+    if (cache) {
+        restoreCachedTopics(*cache, bag_hash);
+    }
+
+    // Step 2: Create output directories
+    if (!createOutputDirectories()) {
+        std::cerr << "Failed to create output directories" << std::endl;
+        return false;
+    }
+
+    // Step 3: Extract images (topics restored from the cache are skipped)
+    if (cached_topics_.empty() || !image_topics_.empty()) {
+        if (!extractImages()) {
+            std::cerr << "Failed to extract images" << std::endl;
+            return false;
+        }
+    }
+
+    if (!writeManifest()) {
+        std::cerr << "Failed to write manifest" << std::endl;
+        return false;
+    }
+
+    // Shards only see part of the timeline; their frame times are indexed by the merge
+    if (isSharded()) {
+        if (!writeFrameTimes()) {
+            std::cerr << "Failed to write frame times" << std::endl;
+            return false;
+        }
+    } else {
+        writeSyncIndex();
+    }
+
+    // Step 4: Convert images to videos. Topics are encoded concurrently on the shared
+    // scheduler, so a large camera does not leave the other cores idle at the end.
+    std::cout << std::endl << "=== CONVERTING IMAGES TO VIDEOS ===" << std::endl;
+    
+    bool all_conversions_success = true;
+    std::mutex encode_mutex;
+    size_t topics_skipped = 0;
+    TaskGroup encode_tasks(scheduler());
+    reportProgress(ProcessingStage::Encode, "", 0, topic_directories_.size());
+    for (const auto& topic_dir_pair : topic_directories_) {
+        const std::string& topic_name = topic_dir_pair.first;
+        const std::string& images_dir = topic_dir_pair.second;
+
+        // A shard may hold no frames of a short topic
+        if (extraction_counts_[topic_name] == 0 || cached_topics_.count(topic_name)) {
+            topics_skipped++;
+            continue;
+        }
+        
+        encode_tasks.run([this, topic_name, images_dir, &cache, &encode_mutex, &all_conversions_success]() {
+            if (cancelled_) {
+                return;
+            }
+
+            // Generate output video filename based on directory name
+            std::string dir_name = boost::filesystem::path(images_dir).filename().string();
+            std::string video_filename = dir_name + "_30fps.mp4";
+            std::string output_video_path = output_dir_ + "/" + video_filename;
+
+            std::cout << std::endl << "Converting topic: " << topic_name << std::endl;
+
+            // ffmpeg inherits the CPU mask of this thread; a pinned worker widens it first
+            ScopedAffinity affinity(scheduler().allowedCpus());
+            if (!convertImagesToVideo(images_dir, output_video_path)) {
+                std::cout << "⚠️  Video conversion failed for " << topic_name << std::endl;
+                std::lock_guard<std::mutex> lock(encode_mutex);
+                all_conversions_success = false;
+            } else if (cache) {
+                storeTopicInCache(*cache, topic_name);
+            }
+        });
+    }
+    while (!encode_tasks.waitFor(std::chrono::milliseconds(500))) {
+        reportProgress(ProcessingStage::Encode, "", topics_skipped + encode_tasks.completed(), topic_directories_.size());
+    }
+    reportProgress(ProcessingStage::Encode, "", topic_directories_.size(), topic_directories_.size());
+
+    if (cancelled_) {
+        std::cout << "⏹️  Processing cancelled" << std::endl;
+        return false;
+    }
+
+    std::cout << std::endl << "✅ Bag processing completed successfully!" << std::endl;
+    std::cout << "Images extracted to: " << output_dir_ << std::endl;
+    
+    if (all_conversions_success) {
+        std::cout << "✅ All videos converted successfully!" << std::endl;
+    } else {
+        std::cout << "⚠️  Some video conversions failed" << std::endl;
+    }
+
+    reportMemoryUsage();
+    
+    return true;
+}
+
+// One frame per preview interval: each interval is a time-bounded View over the index,
+// so only the chunks holding the selected frames are read. Returns the frames encoded.
+size_t BagProcessor::previewTopic(const TopicInfo& topic, const std::string& preview_dir,
+                                  std::atomic<size_t>& frames_read) {
+    TRACE_SPAN("preview_topic");
+    // rosbag::Bag is not thread-safe, so every topic task opens its own handle
+    rosbag::Bag bag;
+    bag.open(bag_path_, rosbag::bagmode::Read);
+    rosbag::TopicQuery query(topic.topic_name);
+    rosbag::View topic_view(bag, query);
+    if (topic_view.size() == 0) {
+        return 0;
+    }
+
+    std::string name = topicDirectoryName(topic.topic_name);
+    std::string frames_dir = preview_dir + "/" + name;
+    boost::filesystem::remove_all(frames_dir);
+    create_directories(frames_dir);
+
+    uint64_t begin_ns = topic_view.getBeginTime().toNSec();
+    uint64_t end_ns = topic_view.getEndTime().toNSec();
+    uint64_t interval_ns = options_.preview_interval_us * 1000;
+
+    JpegOptions jpeg_options;
+    jpeg_options.quality = 85;
+    std::ofstream times(preview_dir + "/" + name + "_preview_times.txt");
+    size_t frame_count = 0;
+    for (uint64_t target_ns = begin_ns; target_ns <= end_ns && !cancelled_; target_ns += interval_ns) {
+        ros::Time window_start;
+        ros::Time window_end;
+        window_start.fromNSec(target_ns);
+        window_end.fromNSec(target_ns + interval_ns - 1);
+        rosbag::View window(bag, query, window_start, window_end);
+        rosbag::View::iterator first = window.begin();
+        if (first == window.end()) {
+            continue;  // Recording gap
+        }
+
+        try {
+            TRACE_SPAN("preview_frame");
+            sensor_msgs::ImageConstPtr image_msg = first->instantiate<sensor_msgs::Image>();
+            cv_bridge::CvImagePtr cv_ptr = image_msg ? to_cv_image(image_msg) : cv_bridge::CvImagePtr();
+            frames_read++;
+            if (!cv_ptr || cv_ptr->image.empty()) {
+                continue;
+            }
+
+            // Even dimensions for yuv420p; small frames are not upscaled
+            const cv::Mat& image = cv_ptr->image;
+            int width = std::min(options_.preview_width, image.cols) & ~1;
+            int height = static_cast<int>(static_cast<int64_t>(image.rows) * width / image.cols) & ~1;
+            cv::Mat frame;
+            cv::resize(image, frame, cv::Size(std::max(2, width), std::max(2, height)), 0, 0, cv::INTER_AREA);
+
+            std::vector<uint8_t> encoded;
+            if (!JpegEncoder::forThread(jpeg_options).encode(frame, encoded)) {
+                continue;
+            }
+            std::ostringstream frame_path;
+            frame_path << frames_dir << "/frame_" << std::setfill('0') << std::setw(6) << frame_count << ".jpg";
+            std::ofstream frame_file(frame_path.str(), std::ios::binary);
+            frame_file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            if (!frame_file) {
+                continue;
+            }
+            times << first->getTime().toNSec() / 1000 << "\n";
+            frame_count++;
+        } catch (const std::exception& e) {
+            std::cerr << "Error reading preview frame from " << topic.topic_name << ": " << e.what() << std::endl;
+        }
+    }
+    bag.close();
+    times.close();
+
+    if (frame_count == 0 || cancelled_) {
+        boost::filesystem::remove_all(frames_dir);
+        return 0;
+    }
+
+    // Every frame is a keyframe, so any position of the preview can be shown at once
+    std::ostringstream cmd;
+    cmd << "ffmpeg -y -loglevel error "
+        << "-framerate " << options_.preview_fps << " "
+        << "-start_number 0 "
+        << "-i '" << frames_dir << "/frame_%06d.jpg' "
+        << "-c:v libx264 "
+        << "-preset veryfast "
+        << "-pix_fmt yuv420p "
+        << "-g 1 "
+        << "-r " << options_.preview_fps << " "
+        << "-movflags +faststart "
+        << "'" << preview_dir << "/" << name << "_preview.mp4'";
+
+    ScopedAffinity affinity(scheduler().allowedCpus());
+    TRACE_MARK(ffmpeg_start);
+    int result = system(cmd.str().c_str());
+    TRACE_SINCE("ffmpeg_encode", ffmpeg_start);
+    boost::filesystem::remove_all(frames_dir);
+    if (result != 0) {
+        std::cout << "❌ Preview encoding failed for " << topic.topic_name << " (exit code: " << result << ")" << std::endl;
+        return 0;
+    }
+    return frame_count;
+}
+
+bool BagProcessor::preview() {
+    TRACE_SPAN("preview");
+    std::cout << "=== PREVIEW ===" << std::endl;
+    std::cout << "Bag file: " << bag_path_ << std::endl;
+    std::cout << "One frame every " << options_.preview_interval_us / 1000.0 << " ms, "
+              << options_.preview_width << " px wide" << std::endl;
+
+    if (options_.preview_interval_us == 0 || options_.preview_width < 2 || options_.preview_fps < 1) {
+        std::cerr << "❌ Invalid preview interval, width or frame rate" << std::endl;
+        return false;
+    }
+
+    std::string preview_dir = output_dir_ + "/preview";
+    size_t planned_frames = 0;
+    try {
+        // Topics and time ranges come from the index; no message data is read here
+        rosbag::Bag bag;
+        bag.open(bag_path_, rosbag::bagmode::Read);
+        if (image_topics_.empty() && !discoverImageTopics(bag)) {
+            bag.close();
+            return false;
+        }
+        for (const auto& topic : image_topics_) {
+            rosbag::View topic_view(bag, rosbag::TopicQuery(topic.topic_name));
+            if (topic_view.size() > 0) {
+                uint64_t span_ns = topic_view.getEndTime().toNSec() - topic_view.getBeginTime().toNSec();
+                planned_frames += static_cast<size_t>(span_ns / (options_.preview_interval_us * 1000)) + 1;
+            }
+        }
+        bag.close();
+        create_directories(preview_dir);
+    } catch (const std::exception& e) {
+        std::cerr << "Error reading bag index: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Topics are previewed concurrently, each with its own bag handle
+    std::atomic<size_t> frames_read{0};
+    std::atomic<size_t> topics_written{0};
+    TaskGroup preview_tasks(scheduler());
+    reportProgress(ProcessingStage::Preview, "", 0, planned_frames);
+    for (const auto& topic : image_topics_) {
+        preview_tasks.run([this, topic, &preview_dir, &frames_read, &topics_written]() {
+            try {
+                size_t frames = previewTopic(topic, preview_dir, frames_read);
+                if (frames > 0) {
+                    topics_written++;
+                    std::cout << "🎞️  " << topic.topic_name << ": " << frames << " preview frames" << std::endl;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error previewing " << topic.topic_name << ": " << e.what() << std::endl;
+            }
+        });
+    }
+    while (!preview_tasks.waitFor(std::chrono::milliseconds(500))) {
+        reportProgress(ProcessingStage::Preview, "", frames_read, planned_frames);
+    }
+    reportProgress(ProcessingStage::Preview, "", frames_read, planned_frames);
+
+    if (cancelled_) {
+        std::cout << "⏹️  Preview cancelled" << std::endl;
+        return false;
+    }
+    if (topics_written == 0) {
+        std::cerr << "❌ No preview could be written" << std::endl;
+        return false;
+    }
+    std::cout << "✅ Previews of " << topics_written << " topics written to " << preview_dir << std::endl;
+    return true;
+}
+
+bool BagProcessor::framesAt(const std::vector<FrameQuery>& queries, std::vector<FrameResult>& results) {
+    TRACE_SPAN("frames_at");
+    results.assign(queries.size(), FrameResult());
+    try {
+        rosbag::Bag bag;
+        bag.open(bag_path_, rosbag::bagmode::Read);
+
+        // Queries resolving to the same message decode it once. The map orders the
+        // messages by time, which is chunk order, so rosbag's decompressed-chunk cache
+        // serves every message of a chunk from one read.
+        std::map<std::pair<uint64_t, std::string>, std::vector<size_t>> targets;
+        for (size_t i = 0; i < queries.size(); i++) {
+            results[i].topic = queries[i].topic;
+            results[i].requested = queries[i].time;
+            ros::Time nearest;
+            if (nearest_message_time(bag, queries[i].topic, queries[i].time, nearest)) {
+                targets[std::make_pair(nearest.toNSec(), queries[i].topic)].push_back(i);
+            }
+        }
+
+        for (const auto& target : targets) {
+            if (cancelled_) {
+                break;
+            }
+            ros::Time time;
+            time.fromNSec(target.first.first);
+            rosbag::View view(bag, rosbag::TopicQuery(target.first.second), time, time);
+            rosbag::View::iterator msg = view.begin();
+            if (msg == view.end()) {
+                continue;
+            }
+
+            try {
+                sensor_msgs::ImageConstPtr image_msg = msg->instantiate<sensor_msgs::Image>();
+                cv_bridge::CvImagePtr cv_ptr = image_msg ? to_cv_image(image_msg) : cv_bridge::CvImagePtr();
+                if (!cv_ptr || cv_ptr->image.empty()) {
+                    continue;
+                }
+                for (size_t index : target.second) {
+                    results[index].time = time;
+                    results[index].image = cv_ptr->image;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error decoding frame of " << target.first.second << " at " << time.toSec()
+                          << ": " << e.what() << std::endl;
+            }
+        }
+        bag.close();
+    } catch (const std::exception& e) {
+        std::cerr << "Error reading frames: " << e.what() << std::endl;
+        return false;
+    }
+    return !cancelled_;
+}
+
+// Frames are decoded and handed to the encoder as the bag arrives; ffmpeg and the
+// sample forwarder run alongside, so reading, encoding and writing overlap
+bool BagProcessor::stream(int input_fd, const std::string& topic, int output_fd) {
+    TRACE_SPAN("stream");
+    std::cout << "📡 Streaming " << topic << " as H.264 with SEI timestamps" << std::endl;
+
+    BagStreamReader reader(input_fd, {topic});
+    StreamEncoderOptions encoder_options;
+    encoder_options.gop_size = options_.gop_size;
+    H264StreamEncoder encoder(output_fd, encoder_options);
+
+    size_t messages_read = 0;
+    size_t frames_skipped = 0;
+    bool read_ok = true;
+    try {
+        BagMessage msg;
+        while (!cancelled_ && reader.next(msg)) {
+            messages_read++;
+            cv::Mat image;
+            try {
+                image = decode_frame(msg);
+            } catch (const std::exception& e) {
+                if (frames_skipped < 5) {
+                    std::cerr << "Error processing image " << messages_read << " from " << topic << ": "
+                              << e.what() << std::endl;
+                }
+            }
+            if (image.empty() || image.depth() != CV_8U) {
+                frames_skipped++;
+                continue;
+            }
+            if (!encoder.encode(image, msg.getTime().toNSec() / 1000)) {
+                break;
+            }
+            reportProgress(ProcessingStage::Extract, topic, messages_read, 0);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "❌ " << e.what() << std::endl;
+        read_ok = false;
+    }
+
+    bool encoded = encoder.finish();
+    std::cout << "📊 " << encoder.samplesWritten() << " frames streamed from "
+              << reader.bytesRead() / (1024 * 1024) << " MiB of bag";
+    if (frames_skipped > 0) {
+        std::cout << ", " << frames_skipped << " messages skipped";
+    }
+    std::cout << std::endl;
+
+    if (cancelled_) {
+        std::cout << "⏹️  Streaming cancelled" << std::endl;
+        return false;
+    }
+    if (encoder.framesEncoded() == 0) {
+        std::cerr << "❌ No frames of " << topic << " in the stream" << std::endl;
+        return false;
+    }
+    return read_ok && encoded;
+}
+
+bool BagProcessor::mergeShards(const std::vector<std::string>& shard_dirs) {
+    TRACE_SPAN("merge");
+    struct ShardTopic {
+        std::string dir_name;
+        size_t frame_count;
+        uint64_t first_us;
+        uint64_t last_us;
+    };
+    struct ShardManifest {
+        std::string dir;
+        std::map<std::string, ShardTopic> topics;
+    };
+
+    std::cout << "=== MERGING " << shard_dirs.size() << " SHARDS ===" << std::endl;
+
+    std::map<int, ShardManifest> shards;
+    int expected_count = -1;
+    std::string bag_name;
+    std::string expected_encoding;
+
+    for (const auto& shard_dir : shard_dirs) {
+        std::ifstream manifest(shard_dir + "/manifest.txt");
+        if (!manifest) {
+            std::cerr << "Missing manifest in shard: " << shard_dir << std::endl;
+            return false;
+        }
+
+        ShardManifest shard;
+        shard.dir = shard_dir;
+        int shard_index = -1;
+        int shard_count = -1;
+        std::string encoding;
+        std::string line;
+
+        while (std::getline(manifest, line)) {
+            std::istringstream fields(line);
+            std::string key;
+            fields >> key;
+            if (key == "bag") {
+                fields >> bag_name;
+            } else if (key == "shard") {
+                fields >> shard_index >> shard_count;
+            } else if (key == "segment_frames") {
+                // Shards must have been encoded with identical segment and x264 settings
+                std::getline(fields, encoding);
+                std::istringstream values(encoding);
+                values >> options_.segment_frames >> options_.gop_size >> options_.x264_threads;
+            } else if (key == "topic") {
+                std::string topic_name;
+                ShardTopic topic;
+                size_t first_message;
+                fields >> topic_name >> topic.dir_name >> first_message >> topic.frame_count
+                       >> topic.first_us >> topic.last_us;
+                shard.topics[topic_name] = topic;
+            }
+        }
+
+        if (shard_index < 0 || shard_count < 1 || (expected_count >= 0 && shard_count != expected_count) ||
+            shards.count(shard_index)) {
+            std::cerr << "Inconsistent shard manifest: " << shard_dir << std::endl;
+            return false;
+        }
+        if (expected_count >= 0 && encoding != expected_encoding) {
+            std::cerr << "Shard encoded with different segment or x264 settings: " << shard_dir << std::endl;
+            return false;
+        }
+        expected_count = shard_count;
+        expected_encoding = encoding;
+        shards[shard_index] = shard;
+    }
+
+    if (static_cast<int>(shards.size()) != expected_count) {
+        std::cerr << "Expected " << expected_count << " shards, got " << shards.size() << std::endl;
+        return false;
+    }
+
+    bag_path_ = bag_name;
+    create_directories(output_dir_);
+
+    // Collect topics in the same (sorted) order a single-node run uses
+    for (const auto& shard : shards) {
+        for (const auto& topic : shard.second.topics) {
+            topic_directories_[topic.first] = output_dir_ + "/" + topic.second.dir_name;
+            extraction_counts_[topic.first] = 0;
+            frame_timestamps_us_[topic.first].clear();
+        }
+    }
+
+    // Shard frame times in shard order form the merged timeline of every topic
+    for (const auto& shard : shards) {
+        std::ifstream times(shard.second.dir + "/frame_times.txt");
+        std::string topic_name;
+        uint64_t timestamp_us;
+        while (times >> topic_name >> timestamp_us) {
+            frame_timestamps_us_[topic_name].push_back(timestamp_us);
+        }
+    }
+
+    bool all_merges_success = true;
+    size_t topics_done = 0;
+    for (const auto& topic_dir_pair : topic_directories_) {
+        const std::string& topic_name = topic_dir_pair.first;
+        const std::string& images_dir = topic_dir_pair.second;
+
+        if (cancelled_) {
+            std::cout << "⏹️  Merge cancelled" << std::endl;
+            return false;
+        }
+        reportProgress(ProcessingStage::Merge, topic_name, topics_done++, topic_directories_.size());
+        std::string dir_name = boost::filesystem::path(images_dir).filename().string();
+        std::string output_video_path = output_dir_ + "/" + dir_name + "_30fps.mp4";
+        std::string h264_raw_path = output_video_path + ".h264";
+
+        std::cout << std::endl << "Merging topic: " << topic_name << std::endl;
+        create_directories(images_dir);
+
+        std::ofstream stream(h264_raw_path, std::ios::binary | std::ios::trunc);
+        int frame_number = 0;
+
+        for (const auto& shard : shards) {
+            auto topic_it = shard.second.topics.find(topic_name);
+            if (topic_it == shard.second.topics.end() || topic_it->second.frame_count == 0) {
+                continue;
+            }
+            const ShardTopic& topic = topic_it->second;
+
+            if (extraction_counts_[topic_name] == 0) {
+                first_timestamps_us_[topic_name] = topic.first_us;
+            }
+            last_timestamps_us_[topic_name] = topic.last_us;
+            extraction_counts_[topic_name] += topic.frame_count;
+
+            // Renumber images: "image_<local>_<time>.jpg" -> "image_<global>_<time>.jpg"
+            std::string shard_images_dir = shard.second.dir + "/" + topic.dir_name;
+            for (const auto& filename : list_frame_images(shard_images_dir)) {
+                std::string suffix = filename.substr(filename.find('_', filename.find('_') + 1));
+                std::ostringstream new_name;
+                new_name << "image_" << std::setfill('0') << std::setw(4) << frame_number++ << suffix;
+                boost::filesystem::copy_file(shard_images_dir + "/" + filename, images_dir + "/" + new_name.str(),
+                                             boost::filesystem::copy_option::overwrite_if_exists);
+            }
+
+            std::ifstream shard_stream(shard.second.dir + "/" + dir_name + "_30fps.h264", std::ios::binary);
+            if (!shard_stream) {
+                std::cerr << "Missing shard stream for " << topic_name << " in " << shard.second.dir << std::endl;
+                all_merges_success = false;
+                continue;
+            }
+            stream << shard_stream.rdbuf();
+        }
+        stream.close();
+
+        if (!packageH264Stream(images_dir, h264_raw_path, output_video_path, stream ? 0 : 1)) {
+            all_merges_success = false;
+        }
+    }
+    reportProgress(ProcessingStage::Merge, "", topics_done, topic_directories_.size());
+
+    if (!writeManifest()) {
+        std::cerr << "Failed to write manifest" << std::endl;
+        return false;
+    }
+    writeSyncIndex();
+
+    std::cout << std::endl << (all_merges_success ? "✅" : "⚠️ ") << " Merged shards into: " << output_dir_ << std::endl;
+    return all_merges_success;
+}
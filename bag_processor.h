@@ -0,0 +1,315 @@
+#ifndef BAG_PROCESSOR_H
+#define BAG_PROCESSOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+#include <ros/time.h>
+#include <opencv2/opencv.hpp>
+
+#include "memory_budget.h"
+
+namespace rosbag {
+class Bag;
+}
+struct BagMessage;
+class OutputCache;
+class TelemetryRecorder;
+class TaskScheduler;
+
+// libbagproc: bag analysis, image extraction, H264 encoding and streaming sample generation.
+//
+// A BagProcessor handles one bag. Many processors can run in one long-lived process
+// (one per thread); none of them needs ros::init.
+
+// Stages reported through ProcessorOptions::on_progress. Every stage reports done = 0
+// when it starts and a final event when it ends, so the events also time the stages.
+enum class ProcessingStage {
+    Analyze,    // done/total: messages scanned
+    Extract,    // done/total: image messages read
+    Encode,     // done/total: topics encoded
+    Merge,      // done/total: topics merged
+    Preview     // done/total: preview frames read (total: intervals of all topics)
+};
+
+struct ProgressEvent {
+    ProcessingStage stage;
+    std::string topic;    // Topic being worked on, empty for whole-bag stages
+    size_t done;
+    size_t total;         // 0 if unknown
+};
+
+// Configuration of a processing job
+struct ProcessorOptions {
+    bool packed_samples = false;     // Write samples.h264pack instead of one file per sample
+    bool per_file_samples = true;    // Keep sample-N.h264 files (compatibility export when packed)
+
+    // Time-sharded processing: this process handles slice shard_index of shard_count.
+    // Slices are whole encode segments, so a merge of all shards matches a single-node
+    // run with the same segment_frames byte for byte.
+    int shard_index = 0;
+    int shard_count = 1;
+    int gop_size = 30;               // Closed GOP length used by segmented encoding
+    int segment_frames = 0;          // Topic messages per independently encoded segment (0 = one ffmpeg run)
+    // libx264 threads per segment. x264 output depends on its thread count, so the value
+    // is fixed rather than derived from the host and is checked by the shard merge.
+    int x264_threads = 1;
+
+    // Budget for frames in flight during extraction: read messages and frames queued for
+    // JPEG encoding (0 = unlimited). Messages read ahead from a compressed bag are capped
+    // at half of it. The encode, split and merge steps run in child processes or stream
+    // from disk and are not limited by it.
+    size_t max_memory_bytes = 0;
+    // Work-stealing scheduler shared by the per-frame JPEG tasks and the per-topic
+    // encode tasks. reserved_cores leaves the first CPUs of the process mask to other
+    // services; pin_threads binds each worker to one of the remaining CPUs.
+    int worker_threads = 0;          // Scheduler threads (0 = one per available CPU)
+    int reserved_cores = 0;
+    bool pin_threads = false;
+
+    // Threads that decompress upcoming chunks during extraction (0 = several for LZ4/BZ2
+    // bags, none for uncompressed ones; 1 = read on the extraction thread). Not used by shards.
+    int read_threads = 0;
+
+    // Read uncompressed v2.0 bags from a memory mapping instead of through rosbag, using
+    // bgr8/mono8 image data in place. Falls back to rosbag for other bags and for shards.
+    bool mapped_reader = false;
+
+    // Extracted frames (input of the H.264 encode): JPEG quality 1-100 and chroma
+    // subsampling "420", "422" or "444" (subsampling needs the TurboJPEG backend)
+    int jpeg_quality = 95;
+    std::string jpeg_subsampling = "420";
+
+    // Find image topics from the connection index and extract in the same traversal,
+    // so the bag data is read once (not combinable with sharding, which plans from
+    // the message times of a full analysis pass)
+    bool single_pass = false;
+
+    // Content-addressed cache of per-topic outputs (empty = disabled). A rerun with the
+    // same bag index and output parameters links the cached topic outputs instead of
+    // extracting and encoding them again.
+    std::string cache_dir;
+
+    // Timeline sprites: every sprite_interval_us one frame is downscaled to a tile of
+    // sprite_tile_width pixels and packed into per-topic sheets of sprite_columns x
+    // sprite_rows tiles under <output_dir>/sprites/ (0 = disabled, not used by shards)
+    uint64_t sprite_interval_us = 0;
+    int sprite_tile_width = 160;
+    int sprite_columns = 10;
+    int sprite_rows = 10;
+    std::string sprite_format = "jpg";   // "jpg" or "webp"
+
+    // Cross-camera sync index: rows at every frame of sync_master (default: the topic
+    // with the most frames), or at a fixed tick when sync_tick_us > 0
+    std::string sync_master;
+    uint64_t sync_tick_us = 0;
+
+    // Non-image topics sampled at every frame during extraction and embedded as a
+    // telemetry SEI by the injector (sensor_msgs/NavSatFix is interpolated, other
+    // types use the nearest message; not used by shards)
+    std::vector<std::string> telemetry_topics;
+
+    // Preview mode (preview()): the first frame of every preview_interval_us per topic,
+    // found through the bag index, downscaled to preview_width and encoded all-intra
+    // at preview_fps into <output_dir>/preview/
+    uint64_t preview_interval_us = 1000000;
+    int preview_width = 320;
+    int preview_fps = 10;
+
+    std::string h264_root = "h264";                                  // Streaming samples go to <h264_root>/<timestamp>/
+    std::string generate_h264_script = "/workspace/generate_h264.py";  // Sample splitter
+
+    // Called on the thread running process()/mergeShards(); must not block for long
+    std::function<void(const ProgressEvent&)> on_progress;
+};
+
+// Frame requested by BagProcessor::framesAt()
+struct FrameQuery {
+    std::string topic;
+    ros::Time time;
+};
+
+struct FrameResult {
+    std::string topic;
+    ros::Time requested;
+    ros::Time time;       // Time of the nearest message (valid if image is not empty)
+    cv::Mat image;        // Converted like extracted frames; empty if none was found
+};
+
+// Per-topic slice of frames handled by this shard
+struct TopicRange {
+    size_t first_message = 0;        // Topic message number of the first message in the slice
+    size_t message_count = 0;        // Number of messages in the slice
+    size_t skip = 0;                 // Messages at start_time that belong to the previous shard
+    ros::Time start_time;
+    ros::Time end_time;
+};
+
+class BagProcessor {
+public:
+    /**
+     * @param bag_path Bag to process (unused when merging shards)
+     * @param output_dir Directory for extracted images, videos and the manifest
+     * @param timestamp Run name used for <h264_root>/<timestamp>/
+     * @param options Job configuration
+     */
+    BagProcessor(const std::string& bag_path, const std::string& output_dir = "extracted_images", const std::string& timestamp = "",
+                 const ProcessorOptions& options = ProcessorOptions());
+    ~BagProcessor();
+
+    /**
+     * Find the image topics of the bag (and plan the shard when sharded)
+     * @return true if at least one image topic was found
+     */
+    bool analyzeBag();
+
+    /**
+     * Create the output directory and one directory per known image topic
+     * @return true on success
+     */
+    bool createOutputDirectories();
+
+    /**
+     * Extract the frames of every image topic as JPG files
+     * @return true if at least one frame was extracted
+     */
+    bool extractImages();
+
+    /**
+     * Run the whole job: analyze, extract, sync index, encode and split
+     * @return false on failure or cancellation
+     */
+    bool process();
+
+    /**
+     * Quick overview of the bag: one downscaled frame per preview interval and topic,
+     * read by seeking through the bag index, encoded into
+     * <output_dir>/preview/<topic>_preview.mp4 with the frame times in <topic>_preview_times.txt
+     * @return false if no preview was written or the job was cancelled
+     */
+    bool preview();
+
+    /**
+     * Decode the frames nearest to the given times without running the pipeline. Each
+     * query is resolved through the bag index; only the chunks holding the selected
+     * messages are read, in time order, so queries in one chunk share its read.
+     * @param queries Topic and time of every wanted frame
+     * @param results One result per query, in query order
+     * @return false if the bag cannot be read or the job was cancelled
+     */
+    bool framesAt(const std::vector<FrameQuery>& queries, std::vector<FrameResult>& results);
+
+    /**
+     * Streaming mode: read the bag sequentially from input_fd (no index needed, so it can
+     * start while the bag is still arriving) and write one image topic to output_fd as an
+     * Annex-B stream with a timestamp SEI per sample. The bag path is not used. SIGPIPE is
+     * blocked around the writes, so a closed output fails the call instead of the process.
+     * @param input_fd Bag stream, e.g. stdin
+     * @param topic Image topic to encode
+     * @param output_fd Receives the H.264 stream, e.g. stdout
+     * @return false if the stream is not a readable bag, holds no frame of the topic, the
+     *         output was closed or the job was cancelled
+     */
+    bool stream(int input_fd, const std::string& topic, int output_fd);
+
+    /**
+     * Merge shard outputs into the output directory. Images are renumbered, per-topic
+     * streams are concatenated in shard order and then packaged like a single-node run.
+     * @param shard_dirs Output directories of all shards
+     * @return false on failure or cancellation
+     */
+    bool mergeShards(const std::vector<std::string>& shard_dirs);
+
+    /**
+     * Ask a running job to stop. Safe to call from any thread; the job stops at the next
+     * message, segment or topic and returns false. A running ffmpeg is not interrupted.
+     */
+    void cancel() { cancelled_ = true; }
+
+    bool cancelled() const { return cancelled_; }
+
+private:
+    struct TopicInfo {
+        std::string topic_name;
+        std::string msg_type;
+        int msg_count;
+    };
+
+    bool isSharded() const {
+        return options_.shard_count > 1;
+    }
+
+    // Output directory of a topic, created on first use
+    const std::string& topicDirectory(const std::string& topic_name);
+    std::string topicDirectoryName(const std::string& topic_name) const;
+    bool discoverImageTopics(rosbag::Bag& bag);
+
+    std::string streamingOutputDir(const std::string& images_dir) const;
+    std::string spritesDir(const std::string& topic_name) const;
+    std::string cacheParameters() const;
+    void restoreCachedTopics(const OutputCache& cache, uint64_t bag_hash);
+    void storeTopicInCache(const OutputCache& cache, const std::string& topic_name);
+
+    // Created on first use with the worker/affinity options
+    TaskScheduler& scheduler();
+    void reportProgress(ProcessingStage stage, const std::string& topic, size_t done, size_t total) const;
+
+    int encodeSegmented(const std::string& images_dir, const std::string& h264_raw_path);
+    int encodeSegment(const std::vector<std::string>& frames, size_t begin, size_t end,
+                      const std::string& abs_images_dir, const std::string& h264_raw_path, size_t segment);
+    std::string shardStreamPath(const std::string& images_dir) const;
+    bool convertImagesToVideo(const std::string& images_dir, const std::string& output_video_path);
+    bool packageH264Stream(const std::string& images_dir, const std::string& h264_raw_path,
+                           const std::string& output_video_path, int result);
+    bool file_exists(const std::string& path);
+    void create_directories(const std::string& path);
+    bool generateH264FilesForStreaming(const std::string& timestamped_h264_path, const std::string& output_dir);
+    void planShard();
+    void reportMemoryUsage() const;
+    bool writeManifest();
+    bool writeFrameTimes();
+    bool writeSyncIndex();
+    void recordTelemetry(const BagMessage& msg, TelemetryRecorder& telemetry, long& track);
+    bool writeTelemetry(const TelemetryRecorder& telemetry);
+    size_t previewTopic(const TopicInfo& topic, const std::string& preview_dir, std::atomic<size_t>& frames_read);
+
+    std::string bag_path_;
+    std::string output_dir_;
+    std::string timestamp_;
+    ProcessorOptions options_;
+    MemoryBudget memory_budget_;
+    std::atomic<bool> cancelled_{false};
+    std::unique_ptr<TaskScheduler> scheduler_;
+
+    std::vector<TopicInfo> image_topics_;
+    std::map<std::string, std::string> topic_directories_;
+    std::map<std::string, int> extraction_counts_;
+
+    // Shard planning (only filled when shard_count > 1)
+    std::map<std::string, std::vector<ros::Time>> topic_times_;
+    std::map<std::string, TopicRange> topic_ranges_;
+
+    // Extraction results recorded in the manifest
+    std::map<std::string, uint64_t> first_timestamps_us_;
+    std::map<std::string, uint64_t> last_timestamps_us_;
+
+    // Timestamp of every extracted frame per topic, in frame (= sample) order
+    std::map<std::string, std::vector<uint64_t>> frame_timestamps_us_;
+
+    // Topic message number of every extracted frame, in frame order. Encode segments are
+    // cut on message numbers, which shards and single-node runs share even when some
+    // messages do not decode.
+    std::map<std::string, std::vector<size_t>> frame_messages_;
+
+    // Output cache state: key of every topic and the topics restored from the cache
+    std::map<std::string, std::string> cache_keys_;
+    std::set<std::string> cached_topics_;
+};
+
+#endif // BAG_PROCESSOR_H
@@ -0,0 +1,204 @@
+#include "bag_stream_reader.h"
+#include "bag_format.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include <bzlib.h>
+#include <roslz4/lz4s.h>
+
+namespace {
+
+// Record headers are a few fields; anything larger means the stream is not a bag
+constexpr uint32_t MAX_RECORD_HEADER = 1 << 20;
+
+uint8_t record_op(const std::map<std::string, std::string>& fields) {
+    auto op = fields.find("op");
+    return op != fields.end() && op->second.size() == 1 ? static_cast<uint8_t>(op->second[0]) : 0;
+}
+
+bool u32_field(const std::map<std::string, std::string>& fields, const char* name, uint32_t& value) {
+    auto field = fields.find(name);
+    if (field == fields.end() || field->second.size() != 4) {
+        return false;
+    }
+    value = BagFormat::readU32(reinterpret_cast<const uint8_t*>(field->second.data()));
+    return true;
+}
+
+} // namespace
+
+BagStreamReader::BagStreamReader(int fd, const std::vector<std::string>& topics)
+    : fd_(fd), topics_(topics.begin(), topics.end()) {}
+
+// Fills buffer completely; false if the stream ends before the first byte
+bool BagStreamReader::readExact(uint8_t* buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result = ::read(fd_, buffer + done, size - done);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("bag stream read failed: ") + std::strerror(errno));
+        }
+        if (result == 0) {
+            if (done == 0) {
+                return false;
+            }
+            throw std::runtime_error("bag stream ends inside a record");
+        }
+        done += static_cast<size_t>(result);
+        bytes_read_ += static_cast<uint64_t>(result);
+    }
+    return true;
+}
+
+// Next top-level record into header_/data_; false at the end of the stream
+bool BagStreamReader::readRecord() {
+    uint8_t length[4];
+    if (!readExact(length, sizeof(length))) {
+        return false;
+    }
+    uint32_t header_size = BagFormat::readU32(length);
+    if (header_size > MAX_RECORD_HEADER) {
+        throw std::runtime_error("bag stream has an invalid record header");
+    }
+    header_.resize(header_size);
+    if (header_size > 0 && !readExact(header_.data(), header_size)) {
+        throw std::runtime_error("bag stream ends inside a record");
+    }
+    if (!readExact(length, sizeof(length))) {
+        throw std::runtime_error("bag stream ends inside a record");
+    }
+    data_.resize(BagFormat::readU32(length));
+    if (!data_.empty() && !readExact(data_.data(), data_.size())) {
+        throw std::runtime_error("bag stream ends inside a record");
+    }
+    return true;
+}
+
+void BagStreamReader::readChunk(const std::map<std::string, std::string>& fields) {
+    auto compression = fields.find("compression");
+    uint32_t size = 0;
+    if (compression == fields.end() || !u32_field(fields, "size", size)) {
+        throw std::runtime_error("bag stream has an invalid chunk header");
+    }
+
+    chunk_pos_ = 0;
+    if (compression->second == "none") {
+        chunk_.swap(data_);
+        return;
+    }
+
+    chunk_.resize(size);
+    unsigned int decompressed = size;
+    bool ok;
+    if (compression->second == "bz2") {
+        ok = BZ2_bzBuffToBuffDecompress(reinterpret_cast<char*>(chunk_.data()), &decompressed,
+                                        reinterpret_cast<char*>(data_.data()),
+                                        static_cast<unsigned int>(data_.size()), 0, 0) == BZ_OK;
+    } else if (compression->second == "lz4") {
+        ok = roslz4_buffToBuffDecompress(reinterpret_cast<char*>(data_.data()),
+                                         static_cast<unsigned int>(data_.size()),
+                                         reinterpret_cast<char*>(chunk_.data()), &decompressed) == ROSLZ4_OK;
+    } else {
+        throw std::runtime_error("bag stream has unsupported chunk compression: " + compression->second);
+    }
+    if (!ok || decompressed != size) {
+        throw std::runtime_error("bag stream chunk cannot be decompressed (" + compression->second + ")");
+    }
+}
+
+void BagStreamReader::addConnection(const std::map<std::string, std::string>& fields, const uint8_t* data,
+                                    size_t size) {
+    uint32_t id = 0;
+    auto topic = fields.find("topic");
+    std::map<std::string, std::string> connection_header;
+    if (!u32_field(fields, "conn", id) || topic == fields.end() ||
+        !BagFormat::parseRecordHeader(data, size, connection_header)) {
+        throw std::runtime_error("bag stream has an invalid connection record");
+    }
+    Connection& connection = connections_[id];
+    connection.topic = topic->second;
+    connection.datatype = connection_header["type"];
+    connection.md5sum = connection_header["md5sum"];
+}
+
+bool BagStreamReader::next(BagMessage& message) {
+    if (!started_) {
+        uint8_t magic[BAG_MAGIC_SIZE];
+        if (!readExact(magic, BAG_MAGIC_SIZE) || std::memcmp(magic, BAG_MAGIC, BAG_MAGIC_SIZE) != 0) {
+            throw std::runtime_error("stream is not a ROS bag v2.0");
+        }
+        started_ = true;
+    }
+
+    std::map<std::string, std::string> fields;
+    while (true) {
+        // Records of the current chunk
+        while (chunk_pos_ < chunk_.size()) {
+            const uint8_t* base = chunk_.data();
+            size_t left = chunk_.size() - chunk_pos_;
+            if (left < 4) {
+                throw std::runtime_error("bag stream chunk ends inside a record");
+            }
+            uint32_t header_size = BagFormat::readU32(base + chunk_pos_);
+            if (header_size > left - 4 || left - 4 - header_size < 4) {
+                throw std::runtime_error("bag stream chunk ends inside a record");
+            }
+            const uint8_t* header = base + chunk_pos_ + 4;
+            uint32_t data_size = BagFormat::readU32(header + header_size);
+            if (data_size > left - 8 - header_size) {
+                throw std::runtime_error("bag stream chunk ends inside a record");
+            }
+            const uint8_t* data = header + header_size + 4;
+            chunk_pos_ += 8 + header_size + data_size;
+
+            fields.clear();
+            if (!BagFormat::parseRecordHeader(header, header_size, fields)) {
+                throw std::runtime_error("bag stream has an invalid record header");
+            }
+            uint8_t op = record_op(fields);
+            if (op == BAG_OP_CONNECTION) {
+                addConnection(fields, data, data_size);
+                continue;
+            }
+            uint32_t conn = 0;
+            auto time = fields.find("time");
+            if (op != BAG_OP_MESSAGE_DATA || !u32_field(fields, "conn", conn) ||
+                time == fields.end() || time->second.size() != 8) {
+                continue;
+            }
+            auto connection = connections_.find(conn);
+            if (connection == connections_.end() ||
+                (!topics_.empty() && !topics_.count(connection->second.topic))) {
+                continue;
+            }
+
+            const uint8_t* stamp = reinterpret_cast<const uint8_t*>(time->second.data());
+            message.topic = connection->second.topic;
+            message.datatype = connection->second.datatype;
+            message.md5sum = connection->second.md5sum;
+            message.time = ros::Time(BagFormat::readU32(stamp), BagFormat::readU32(stamp + 4));
+            message.data.assign(data, data + data_size);
+            return true;
+        }
+
+        // Next top-level record: chunks hold the messages, everything else is index
+        if (!readRecord()) {
+            return false;
+        }
+        fields.clear();
+        if (!BagFormat::parseRecordHeader(header_.data(), header_.size(), fields)) {
+            throw std::runtime_error("bag stream has an invalid record header");
+        }
+        uint8_t op = record_op(fields);
+        if (op == BAG_OP_CHUNK) {
+            readChunk(fields);
+        } else if (op == BAG_OP_CONNECTION) {
+            addConnection(fields, data_.data(), data_.size());
+        }
+    }
+}
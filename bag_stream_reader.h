@@ -0,0 +1,68 @@
+#ifndef BAG_STREAM_READER_H
+#define BAG_STREAM_READER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdint>
+
+#include "parallel_bag_reader.h"
+
+// Sequential reader for a ROS bag v2.0 arriving on a pipe or file descriptor.
+//
+// rosbag::Bag seeks to the index at the end of the file before it reads any message, so
+// it cannot start on a bag that is still being downloaded. This reader walks the records
+// in file order instead (see bag_format.h): chunks are decompressed (bz2, lz4) as they
+// arrive and the connection and message data records inside them are decoded on the
+// fly; the index section at the end is skipped. Messages come out in chunk order, which
+// is time order per topic for bags written by rosbag record. Bags without an index (an
+// interrupted recording) read the same way.
+
+class BagStreamReader {
+public:
+    /**
+     * @param fd Readable descriptor positioned at the start of the bag (not closed)
+     * @param topics Topics to deliver (empty = all)
+     */
+    BagStreamReader(int fd, const std::vector<std::string>& topics);
+
+    BagStreamReader(const BagStreamReader&) = delete;
+    BagStreamReader& operator=(const BagStreamReader&) = delete;
+
+    /**
+     * Next message of the selected topics in file order
+     * @param message Receives the message
+     * @return false at the end of the stream
+     * @throws std::runtime_error if the stream is not a v2.0 bag, is cut inside a record
+     *         or holds a chunk that cannot be decompressed
+     */
+    bool next(BagMessage& message);
+
+    uint64_t bytesRead() const { return bytes_read_; }
+
+private:
+    struct Connection {
+        std::string topic;
+        std::string datatype;
+        std::string md5sum;
+    };
+
+    bool readExact(uint8_t* buffer, size_t size);
+    bool readRecord();
+    void readChunk(const std::map<std::string, std::string>& fields);
+    void addConnection(const std::map<std::string, std::string>& fields, const uint8_t* data, size_t size);
+
+    int fd_;
+    std::set<std::string> topics_;
+    std::map<uint32_t, Connection> connections_;
+    bool started_ = false;
+    uint64_t bytes_read_ = 0;
+
+    std::vector<uint8_t> header_;      // Current top-level record
+    std::vector<uint8_t> data_;
+    std::vector<uint8_t> chunk_;       // Decompressed records of the current chunk
+    size_t chunk_pos_ = 0;
+};
+
+#endif // BAG_STREAM_READER_H
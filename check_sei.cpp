@@ -3,99 +3,648 @@
 #include <vector>
 #include <iomanip>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <map>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <dirent.h>
+#include <sys/stat.h>
 #include "sei_generator.h"
+#include "h264_sample.h"
+#include "sample_archive.h"
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <h264_file>" << std::endl;
-        return 1;
+struct SampleCounters {
+    int sei_count = 0;
+    int frame_count = 0;
+};
+
+void printRawSEI(const uint8_t* nal, uint32_t length) {
+    std::cout << "  Raw SEI data (first 32 bytes): ";
+    for (size_t i = 0; i < std::min(length, (uint32_t)32); i++) {
+        std::cout << std::hex << std::setw(2) << std::setfill('0')
+                 << (int)nal[i] << " ";
     }
+    std::cout << std::dec << '\n';
+}
+
+// Print every NAL unit of one length-prefixed sample; base_offset is the sample position in the file
+void analyzeSample(const uint8_t* data, size_t size, uint64_t base_offset, SampleCounters& counters) {
+    std::vector<NalUnitRef> nals;
+    if (!H264Sample::parseLengthPrefixed(data, size, nals)) {
+        size_t bad_pos = nals.empty() ? 0 : nals.back().offset + nals.back().length;
+        std::cerr << "Invalid NAL unit length at position " << (base_offset + bad_pos) << std::endl;
+    }
+
+    for (const auto& nal : nals) {
+        const uint8_t* nal_data = data + nal.offset;
+
+        std::cout << "NAL unit at offset " << (base_offset + nal.offset) << ": type=" << (int)nal.type
+                 << " size=" << nal.length << '\n';
 
-    std::string file_path = argv[1];
+        if (nal.type == NAL_UNIT_TYPE_SEI) {
+            counters.sei_count++;
+            std::vector<uint8_t> sei_nalu(nal_data, nal_data + nal.length);
 
-    // Read the H264 file
+            // Check if it's our timestamp SEI (complex format)
+            uint64_t timestamp = SEIGenerator::extractTimestampFromSEI(sei_nalu);
+            uint64_t simple_timestamp = SEIGenerator::extractSimpleTimestampFromSEI(sei_nalu);
+
+            if (timestamp != 0) {
+                std::cout << "  ✅ Found complex timestamp SEI: " << timestamp << " microseconds ("
+                         << (timestamp / 1000000.0) << " seconds)" << '\n';
+            } else if (simple_timestamp != 0) {
+                std::cout << "  ✅ Found simple timestamp SEI: " << simple_timestamp << " microseconds ("
+                         << (simple_timestamp / 1000000.0) << " seconds)" << '\n';
+
+                // Print raw SEI payload for debugging
+                printRawSEI(nal_data, nal.length);
+            } else {
+                std::cout << "  ❌ SEI found but not timestamp SEI" << '\n';
+
+                // Print raw SEI for debugging
+                printRawSEI(nal_data, nal.length);
+            }
+        } else if (nal.type == NAL_UNIT_TYPE_NON_IDR || nal.type == NAL_UNIT_TYPE_IDR) { // Frame
+            counters.frame_count++;
+        }
+    }
+}
+
+// Walk a length-prefixed file one NAL unit at a time so memory use does not grow with file size
+int analyzeStream(const std::string& file_path, SampleCounters& counters) {
     std::ifstream file(file_path, std::ios::binary | std::ios::ate);
     if (!file) {
         std::cerr << "Failed to open file: " << file_path << std::endl;
         return 1;
     }
 
-    size_t size = file.tellg();
+    uint64_t size = file.tellg();
     file.seekg(0, std::ios::beg);
 
-    std::vector<uint8_t> data(size);
-    file.read(reinterpret_cast<char*>(data.data()), size);
-    file.close();
-
     std::cout << "Analyzing H264 file: " << file_path << " (" << size << " bytes)" << std::endl;
 
     // Parse NAL units (length-prefixed format)
-    size_t pos = 0;
-    int sei_count = 0;
-    int frame_count = 0;
-
-    while (pos < data.size() - 4) {
-        // Read 4-byte length (big-endian)
-        uint32_t length = (data[pos] << 24) | (data[pos+1] << 16) | (data[pos+2] << 8) | data[pos+3];
-        size_t nal_start = pos + 4;
-        size_t nal_end = nal_start + length;
+    std::vector<uint8_t> nal;
+    uint64_t pos = 0;
+    while (pos + 4 <= size) {
+        nal.resize(4);
+        file.read(reinterpret_cast<char*>(nal.data()), 4);
+        uint32_t length = (uint32_t(nal[0]) << 24) | (uint32_t(nal[1]) << 16) | (uint32_t(nal[2]) << 8) | nal[3];
 
-        if (nal_end > data.size()) {
+        if (length > size - pos - 4) {
             std::cerr << "Invalid NAL unit length at position " << pos << std::endl;
             break;
         }
 
-        if (nal_start < data.size()) {
-            uint8_t nal_type = data[nal_start] & 0x1F;
-
-            std::cout << "NAL unit at offset " << nal_start << ": type=" << (int)nal_type
-                     << " size=" << length << std::endl;
-
-            if (nal_type == 6) { // SEI
-                sei_count++;
-                std::vector<uint8_t> sei_nalu(data.begin() + nal_start, data.begin() + nal_end);
-
-                // Check if it's our timestamp SEI (complex format)
-                uint64_t timestamp = SEIGenerator::extractTimestampFromSEI(sei_nalu);
-                uint64_t simple_timestamp = SEIGenerator::extractSimpleTimestampFromSEI(sei_nalu);
-
-                if (timestamp != 0) {
-                    std::cout << "  ✅ Found complex timestamp SEI: " << timestamp << " microseconds ("
-                             << (timestamp / 1000000.0) << " seconds)" << std::endl;
-                } else if (simple_timestamp != 0) {
-                    std::cout << "  ✅ Found simple timestamp SEI: " << simple_timestamp << " microseconds ("
-                             << (simple_timestamp / 1000000.0) << " seconds)" << std::endl;
-
-                    // Print raw SEI payload for debugging
-                    std::cout << "  Raw SEI data (first 32 bytes): ";
-                    for (size_t i = 0; i < std::min(length, (uint32_t)32); i++) {
-                        std::cout << std::hex << std::setw(2) << std::setfill('0')
-                                 << (int)data[nal_start + i] << " ";
-                    }
-                    std::cout << std::endl;
-                } else {
-                    std::cout << "  ❌ SEI found but not timestamp SEI" << std::endl;
-
-                    // Print raw SEI for debugging
-                    std::cout << "  Raw SEI data (first 32 bytes): ";
-                    for (size_t i = 0; i < std::min(length, (uint32_t)32); i++) {
-                        std::cout << std::hex << std::setw(2) << std::setfill('0')
-                                 << (int)data[nal_start + i] << " ";
-                    }
-                    std::cout << std::endl;
+        nal.resize(4 + length);
+        file.read(reinterpret_cast<char*>(nal.data() + 4), length);
+        if (!file) {
+            std::cerr << "Failed to read NAL unit at position " << pos << std::endl;
+            return 1;
+        }
+
+        analyzeSample(nal.data(), nal.size(), pos, counters);
+        pos += 4 + length;
+    }
+    return 0;
+}
+
+int analyzeArchive(const std::string& file_path, SampleCounters& counters) {
+    SampleArchiveReader reader;
+    if (!reader.open(file_path)) {
+        std::cerr << "Failed to open sample archive: " << file_path << std::endl;
+        return 1;
+    }
+
+    std::cout << "Analyzing sample archive: " << file_path << " (" << reader.sampleCount() << " samples)" << std::endl;
+
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < reader.sampleCount(); i++) {
+        if (!reader.readSample(i, data)) {
+            std::cerr << "Failed to read sample " << i << std::endl;
+            return 1;
+        }
+        const SampleIndexEntry& entry = reader.entry(i);
+        std::cout << "Sample " << i << ": size=" << entry.size
+                 << (entry.flags & SAMPLE_FLAG_KEYFRAME ? " keyframe" : "")
+                 << " timestamp=" << entry.timestamp_us << '\n';
+        analyzeSample(data.data(), data.size(), entry.offset, counters);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Validation of whole output trees
+// ---------------------------------------------------------------------------
+
+// Per-sample facts gathered by the worker threads
+struct SampleCheck {
+    bool present = false;       // Sample file exists (per-file layout can have holes)
+    bool malformed = false;     // A NAL length prefix runs past the end of the sample
+    bool has_frame = false;     // Contains a slice NAL unit (type 1 or 5)
+    int timestamp_seis = 0;     // Number of timestamp SEI NAL units
+    uint64_t timestamp_us = 0;  // Timestamp of the first timestamp SEI
+};
+
+// One camera: either a directory of sample-N.h264 files or a samples.h264pack archive
+struct CameraCheck {
+    std::string name;
+    std::string path;
+    bool packed = false;
+    std::string archive;                    // Packed layout: path of the archive
+    std::vector<std::string> files;         // Per-file layout: file name by sample number ("" = missing)
+    std::vector<SampleCheck> samples;
+    bool open_failed = false;
+    size_t stray_samples = 0;               // Per-file samples numbered far beyond the others
+
+    // Results of the sequential pass
+    size_t missing_samples = 0;
+    size_t frames = 0;
+    size_t missing_sei = 0;
+    size_t duplicate_sei = 0;
+    size_t duplicate_timestamps = 0;
+    size_t non_monotonic = 0;
+    size_t gaps = 0;
+    size_t malformed = 0;
+    uint64_t max_gap_us = 0;
+    long images = -1;                       // -1 when no images directory was given
+
+    bool ok() const {
+        return !open_failed && stray_samples == 0 && missing_samples == 0 && missing_sei == 0 && duplicate_sei == 0 &&
+               duplicate_timestamps == 0 && non_monotonic == 0 && gaps == 0 && malformed == 0 &&
+               (images < 0 || static_cast<size_t>(images) == samples.size());
+    }
+};
+
+struct ValidatorOptions {
+    enum class Output { Verbose, Summary, Quiet, Json };
+    Output output = Output::Summary;
+    bool output_given = false;
+    unsigned threads = 0;
+    uint64_t max_gap_us = 0;                // 0 = three times the median frame interval
+    std::string images_dir;
+};
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isDirectory(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+std::string baseName(const std::string& path) {
+    std::string trimmed = path;
+    while (trimmed.size() > 1 && trimmed.back() == '/') {
+        trimmed.pop_back();
+    }
+    size_t pos = trimmed.find_last_of('/');
+    return pos == std::string::npos ? trimmed : trimmed.substr(pos + 1);
+}
+
+// Sample number from "sample-123.h264", -1 if the name does not match
+long sampleNumber(const std::string& filename) {
+    if (filename.compare(0, 7, "sample-") != 0 || !endsWith(filename, ".h264")) {
+        return -1;
+    }
+    std::string digits = filename.substr(7, filename.size() - 12);
+    if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) {
+        return -1;
+    }
+    // Too long for a long: still a sample, reported as out of the numbering by the caller
+    if (digits.size() > 18) {
+        return std::numeric_limits<long>::max();
+    }
+    return std::strtol(digits.c_str(), nullptr, 10);
+}
+
+// Find camera directories below root (a directory holding samples is a camera)
+void findCameras(const std::string& root, std::vector<CameraCheck>& cameras) {
+    DIR* dir = opendir(root.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+
+    CameraCheck camera;
+    camera.name = baseName(root);
+    camera.path = root;
+    std::map<long, std::string> numbered_files;
+    std::vector<std::string> subdirs;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string filename = entry->d_name;
+        if (filename == "." || filename == "..") {
+            continue;
+        }
+        if (filename == SAMPLE_ARCHIVE_FILENAME) {
+            camera.packed = true;
+            camera.archive = root + "/" + filename;
+            continue;
+        }
+        long number = sampleNumber(filename);
+        if (number >= 0) {
+            numbered_files[number] = filename;
+        } else if (isDirectory(root + "/" + filename)) {
+            subdirs.push_back(filename);
+        }
+    }
+    closedir(dir);
+
+    // Sample numbers are dense, so the table is bounded by the number of files: a stray
+    // large number is reported instead of allocating a slot for every sample below it
+    size_t max_samples = numbered_files.size() * 2;
+    for (const auto& file : numbered_files) {
+        if (static_cast<size_t>(file.first) >= max_samples) {
+            std::cerr << "⚠️  Sample outside the numbering of " << root << ": " << file.second << std::endl;
+            camera.stray_samples++;
+            continue;
+        }
+        if (static_cast<size_t>(file.first) >= camera.files.size()) {
+            camera.files.resize(file.first + 1);
+        }
+        camera.files[file.first] = file.second;
+    }
+
+    // The packed archive is authoritative when both layouts exist
+    if (camera.packed) {
+        camera.files.clear();
+        camera.stray_samples = 0;
+    }
+    if (camera.packed || !camera.files.empty() || camera.stray_samples > 0) {
+        cameras.push_back(camera);
+    }
+
+    std::sort(subdirs.begin(), subdirs.end());
+    for (const auto& subdir : subdirs) {
+        findCameras(root + "/" + subdir, cameras);
+    }
+}
+
+void checkSample(const uint8_t* data, size_t size, SampleCheck& check) {
+    std::vector<NalUnitRef> nals;
+    check.present = true;
+    check.malformed = !H264Sample::parseLengthPrefixed(data, size, nals);
+
+    for (const auto& nal : nals) {
+        if (nal.type == NAL_UNIT_TYPE_NON_IDR || nal.type == NAL_UNIT_TYPE_IDR) {
+            check.has_frame = true;
+        } else if (nal.type == NAL_UNIT_TYPE_SEI) {
+            std::vector<uint8_t> sei_nalu(data + nal.offset, data + nal.offset + nal.length);
+            uint64_t timestamp = SEIGenerator::extractSimpleTimestampFromSEI(sei_nalu);
+            if (timestamp == 0) {
+                timestamp = SEIGenerator::extractTimestampFromSEI(sei_nalu);
+            }
+            if (timestamp != 0) {
+                if (check.timestamp_seis == 0) {
+                    check.timestamp_us = timestamp;
                 }
-            } else if (nal_type == 1 || nal_type == 5) { // Frame
-                frame_count++;
+                check.timestamp_seis++;
             }
         }
+    }
+}
+
+// Unit of parallel work: a contiguous range of samples of one camera
+struct WorkUnit {
+    size_t camera;
+    size_t begin;
+    size_t end;
+};
+
+void checkRange(CameraCheck& camera, size_t begin, size_t end) {
+    std::vector<uint8_t> data;
 
-        pos = nal_end;
+    if (camera.packed) {
+        // Each unit opens its own reader: streams are not shared between threads
+        SampleArchiveReader reader;
+        if (!reader.open(camera.archive)) {
+            return;
+        }
+        for (size_t i = begin; i < end; i++) {
+            if (reader.readSample(i, data)) {
+                checkSample(data.data(), data.size(), camera.samples[i]);
+            }
+        }
+        return;
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        if (camera.files[i].empty()) {
+            continue;
+        }
+        std::ifstream file(camera.path + "/" + camera.files[i], std::ios::binary | std::ios::ate);
+        if (!file) {
+            continue;
+        }
+        size_t size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        data.resize(size);
+        file.read(reinterpret_cast<char*>(data.data()), size);
+        checkSample(data.data(), data.size(), camera.samples[i]);
+    }
+}
+
+long countImages(const std::string& images_dir) {
+    DIR* dir = opendir(images_dir.c_str());
+    if (dir == nullptr) {
+        return -1;
+    }
+    long count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (endsWith(entry->d_name, ".jpg")) {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+// Sequential pass over the per-sample results of one camera
+void summarize(CameraCheck& camera, const ValidatorOptions& options) {
+    std::vector<uint64_t> deltas;
+    uint64_t previous = 0;
+
+    for (const auto& sample : camera.samples) {
+        if (!sample.present) {
+            camera.missing_samples++;
+            continue;
+        }
+        camera.frames += sample.has_frame ? 1 : 0;
+        camera.malformed += sample.malformed ? 1 : 0;
+        camera.duplicate_sei += sample.timestamp_seis > 1 ? 1 : 0;
+        if (sample.timestamp_seis == 0) {
+            camera.missing_sei++;
+            continue;
+        }
+        if (previous != 0) {
+            if (sample.timestamp_us < previous) {
+                camera.non_monotonic++;
+            } else if (sample.timestamp_us == previous) {
+                camera.duplicate_timestamps++;
+            } else {
+                deltas.push_back(sample.timestamp_us - previous);
+            }
+        }
+        previous = sample.timestamp_us;
+    }
+
+    uint64_t max_gap_us = options.max_gap_us;
+    if (max_gap_us == 0 && !deltas.empty()) {
+        std::vector<uint64_t> sorted = deltas;
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        max_gap_us = sorted[sorted.size() / 2] * 3;
+    }
+    for (uint64_t delta : deltas) {
+        camera.max_gap_us = std::max(camera.max_gap_us, delta);
+        if (max_gap_us > 0 && delta > max_gap_us) {
+            camera.gaps++;
+        }
+    }
+
+    if (!options.images_dir.empty()) {
+        // h264 camera directories carry a "_30fps" suffix the image directories do not have
+        std::string name = camera.name;
+        if (endsWith(name, "_30fps")) {
+            name = name.substr(0, name.size() - 6);
+        }
+        camera.images = countImages(options.images_dir + "/" + name);
+    }
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            escaped += buffer;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void printJson(const std::vector<CameraCheck>& cameras, bool all_ok) {
+    std::ostringstream out;
+    out << "{\n  \"ok\": " << (all_ok ? "true" : "false") << ",\n  \"cameras\": [";
+    for (size_t i = 0; i < cameras.size(); i++) {
+        const CameraCheck& c = cameras[i];
+        out << (i ? "," : "") << "\n    {"
+            << "\"name\": \"" << jsonEscape(c.name) << "\", "
+            << "\"path\": \"" << jsonEscape(c.path) << "\", "
+            << "\"format\": \"" << (c.packed ? "packed" : "files") << "\", "
+            << "\"ok\": " << (c.ok() ? "true" : "false") << ", "
+            << "\"samples\": " << c.samples.size() << ", "
+            << "\"frames\": " << c.frames << ", "
+            << "\"images\": " << c.images << ", "
+            << "\"stray_samples\": " << c.stray_samples << ", "
+            << "\"missing_samples\": " << c.missing_samples << ", "
+            << "\"missing_sei\": " << c.missing_sei << ", "
+            << "\"duplicate_sei\": " << c.duplicate_sei << ", "
+            << "\"duplicate_timestamps\": " << c.duplicate_timestamps << ", "
+            << "\"non_monotonic\": " << c.non_monotonic << ", "
+            << "\"gaps\": " << c.gaps << ", "
+            << "\"max_gap_us\": " << c.max_gap_us << ", "
+            << "\"malformed\": " << c.malformed << ", "
+            << "\"open_failed\": " << (c.open_failed ? "true" : "false") << "}";
+    }
+    out << "\n  ]\n}\n";
+    std::cout << out.str();
+}
+
+void printSummary(const std::vector<CameraCheck>& cameras, bool quiet) {
+    std::ostringstream out;
+    for (const auto& c : cameras) {
+        if (quiet && c.ok()) {
+            continue;
+        }
+        out << (c.ok() ? "✅ " : "❌ ") << c.name << " (" << (c.packed ? "packed" : "files") << "): "
+            << c.samples.size() << " samples, " << c.frames << " frames";
+        if (c.images >= 0) {
+            out << ", " << c.images << " images";
+        }
+        if (c.open_failed) out << ", unreadable archive";
+        if (c.stray_samples) out << ", " << c.stray_samples << " stray samples";
+        if (c.missing_samples) out << ", " << c.missing_samples << " missing samples";
+        if (c.missing_sei) out << ", " << c.missing_sei << " missing SEI";
+        if (c.duplicate_sei) out << ", " << c.duplicate_sei << " duplicate SEI";
+        if (c.duplicate_timestamps) out << ", " << c.duplicate_timestamps << " duplicate timestamps";
+        if (c.non_monotonic) out << ", " << c.non_monotonic << " non-monotonic";
+        if (c.gaps) out << ", " << c.gaps << " gaps (max " << c.max_gap_us << " us)";
+        if (c.malformed) out << ", " << c.malformed << " malformed NAL lengths";
+        out << "\n";
+    }
+    std::cout << out.str();
+}
+
+int validate(const std::vector<std::string>& paths, const ValidatorOptions& options) {
+    std::vector<CameraCheck> cameras;
+    for (const auto& path : paths) {
+        if (isDirectory(path)) {
+            findCameras(path, cameras);
+        } else if (SampleArchiveReader::isArchivePath(path)) {
+            CameraCheck camera;
+            std::string dir = path.substr(0, path.find_last_of('/') == std::string::npos ? 0 : path.find_last_of('/'));
+            camera.path = dir.empty() ? "." : dir;
+            camera.name = baseName(camera.path);
+            camera.packed = true;
+            camera.archive = path;
+            cameras.push_back(camera);
+        } else {
+            std::cerr << "Not a directory or sample archive: " << path << std::endl;
+            return 2;
+        }
+    }
+
+    // Size the per-sample tables and cut the work into units
+    const size_t unit_samples = 256;
+    std::vector<WorkUnit> units;
+    for (size_t c = 0; c < cameras.size(); c++) {
+        CameraCheck& camera = cameras[c];
+        size_t count = camera.files.size();
+        if (camera.packed) {
+            SampleArchiveReader reader;
+            if (!reader.open(camera.archive)) {
+                camera.open_failed = true;
+                continue;
+            }
+            count = reader.sampleCount();
+        }
+        camera.samples.resize(count);
+        for (size_t begin = 0; begin < count; begin += unit_samples) {
+            units.push_back({c, begin, std::min(count, begin + unit_samples)});
+        }
+    }
+
+    unsigned thread_count = options.threads > 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next_unit(0);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < thread_count; i++) {
+        threads.emplace_back([&]() {
+            size_t unit;
+            while ((unit = next_unit++) < units.size()) {
+                checkRange(cameras[units[unit].camera], units[unit].begin, units[unit].end);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool all_ok = !cameras.empty();
+    for (auto& camera : cameras) {
+        summarize(camera, options);
+        all_ok = all_ok && camera.ok();
+    }
+
+    if (options.output == ValidatorOptions::Output::Json) {
+        printJson(cameras, all_ok);
+    } else {
+        bool quiet = options.output == ValidatorOptions::Output::Quiet;
+        printSummary(cameras, quiet);
+        if (!quiet) {
+            std::cout << cameras.size() << " camera(s) checked: " << (all_ok ? "all valid" : "problems found") << "\n";
+        }
+    }
+
+    return all_ok ? 0 : 1;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] <path>..." << std::endl;
+    std::cerr << "  path: h264_with_sei tree, camera directory, samples.h264pack, or a single .h264 sample" << std::endl;
+    std::cerr << "  -j <n>            Worker threads (default: one per core)" << std::endl;
+    std::cerr << "  --images <dir>    extracted_images directory to compare frame and image counts" << std::endl;
+    std::cerr << "  --max-gap-us <n>  Timestamp gap threshold (default: 3x median frame interval)" << std::endl;
+    std::cerr << "  --verbose         Print every NAL unit (single file or archive)" << std::endl;
+    std::cerr << "  --summary         One line per camera (default for directories)" << std::endl;
+    std::cerr << "  --quiet           Only print cameras with problems" << std::endl;
+    std::cerr << "  --json            Machine-readable report" << std::endl;
+    std::cerr << "Exit code: 0 if every camera is valid, 1 if problems were found, 2 on usage errors" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    ValidatorOptions options;
+    std::vector<std::string> paths;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "-j" && has_value) {
+                options.threads = std::stoul(argv[++i]);
+            } else if (arg == "--images" && has_value) {
+                options.images_dir = argv[++i];
+            } else if (arg == "--max-gap-us" && has_value) {
+                options.max_gap_us = std::stoull(argv[++i]);
+            } else if (arg == "--verbose") {
+                options.output = ValidatorOptions::Output::Verbose;
+                options.output_given = true;
+            } else if (arg == "--summary") {
+                options.output = ValidatorOptions::Output::Summary;
+                options.output_given = true;
+            } else if (arg == "--quiet") {
+                options.output = ValidatorOptions::Output::Quiet;
+                options.output_given = true;
+            } else if (arg == "--json") {
+                options.output = ValidatorOptions::Output::Json;
+                options.output_given = true;
+            } else if (!arg.empty() && arg[0] == '-') {
+                printUsage(argv[0]);
+                return 2;
+            } else {
+                paths.push_back(arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (paths.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    // A single sample file keeps the original per-NAL listing
+    bool single_file = paths.size() == 1 && !isDirectory(paths[0]) && !SampleArchiveReader::isArchivePath(paths[0]);
+    if (!single_file && options.output != ValidatorOptions::Output::Verbose) {
+        return validate(paths, options);
+    }
+    if (paths.size() != 1) {
+        std::cerr << "--verbose takes a single file" << std::endl;
+        return 2;
+    }
+
+    std::string file_path = paths[0];
+    SampleCounters counters;
+
+    if (SampleArchiveReader::isArchivePath(file_path)) {
+        if (analyzeArchive(file_path, counters) != 0) {
+            return 1;
+        }
+    } else {
+        if (analyzeStream(file_path, counters) != 0) {
+            return 1;
+        }
     }
 
     std::cout << std::endl;
     std::cout << "Summary:" << std::endl;
-    std::cout << "  Total SEI NAL units: " << sei_count << std::endl;
-    std::cout << "  Total frame NAL units: " << frame_count << std::endl;
+    std::cout << "  Total SEI NAL units: " << counters.sei_count << std::endl;
+    std::cout << "  Total frame NAL units: " << counters.frame_count << std::endl;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -42,6 +42,12 @@ rm -rf extracted_images_*
 rm -rf h264
 rm -rf h264_with_sei
 
+# SAMPLE_FORMAT=packed writes one samples.h264pack per camera instead of sample-N.h264 files
+GENERATE_FLAGS=""
+if [ "$SAMPLE_FORMAT" = "packed" ]; then
+    GENERATE_FLAGS="--packed"
+fi
+
 # The output directory will be created inside the container with timestamp
 echo "Output will be created in: $CURRENT_DIR/extracted_images_YYYYMMDD_HHMMSS"
 
@@ -93,12 +99,16 @@ if [ $? -eq 0 ]; then
             echo "  Output: $OUTPUT_DIR"
             
             # Run the H264 generation script
-            python3 "$CURRENT_DIR/generate_h264.py" -i "$MP4_FILE" -f 30 -o "$OUTPUT_DIR"
+            python3 "$CURRENT_DIR/generate_h264.py" -i "$MP4_FILE" -f 30 -o "$OUTPUT_DIR" $GENERATE_FLAGS
             
             if [ $? -eq 0 ]; then
                 echo "✅ Successfully processed $VIDEO_NAME"
-                H264_COUNT=$(find "$CURRENT_DIR/$OUTPUT_DIR" -name "*.h264" 2>/dev/null | wc -l)
-                echo "  Generated $H264_COUNT H264 samples"
+                if [ -f "$CURRENT_DIR/$OUTPUT_DIR/samples.h264pack" ]; then
+                    echo "  Generated packed archive: $OUTPUT_DIR/samples.h264pack"
+                else
+                    H264_COUNT=$(find "$CURRENT_DIR/$OUTPUT_DIR" -name "*.h264" 2>/dev/null | wc -l)
+                    echo "  Generated $H264_COUNT H264 samples"
+                fi
             else
                 echo "❌ Failed to process $VIDEO_NAME"
             fi
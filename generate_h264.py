@@ -4,11 +4,15 @@ import os
 import getopt
 import sys
 import glob
+import struct
 from functools import reduce
-from typing import Optional, List
+from itertools import islice
+from typing import Iterator, Optional, List
 
 
 class H264ByteStream:
+    CHUNK_SIZE = 1 << 20
+
     @staticmethod
     def nalu_type(nalu: bytes) -> int:
         return nalu[0] & 0x1F
@@ -21,30 +25,85 @@ class H264ByteStream:
         return result
 
     @staticmethod
-    def reduce_nalus_to_samples(samples: List[List[bytes]], current: bytes) -> List[List[bytes]]:
-        last_nalus = samples[-1]
-        samples[-1] = last_nalus + [current]
-        # Start a new sample after frame NALUs (1=non-IDR, 5=IDR)
-        # SEI (6), SPS (7), PPS (8) will be included with the next frame
-        if H264ByteStream.nalu_type(current) in [1, 5]:
-            samples.append([])
-        return samples
+    def split_nalus(byte_stream: bytes) -> List[bytes]:
+        long_split = byte_stream.split(b"\x00\x00\x00\x01")
+        splits = reduce(lambda acc, x: acc + x.split(b"\x00\x00\x01"), long_split, [])
+        return [x for x in splits if len(x) > 0]
 
-    def __init__(self, file_name: str):
+    @staticmethod
+    def read_nalus(file_name: str) -> Iterator[bytes]:
+        """Yield NAL units while reading the file in fixed-size chunks."""
+        buffer = bytes()
         with open(file_name, "rb") as file:
-            byte_stream = file.read()
-            long_split = byte_stream.split(b"\x00\x00\x00\x01")
-            splits = reduce(lambda acc, x: acc + x.split(b"\x00\x00\x01"), long_split, [])
-            nalus = filter(lambda x: len(x) > 0, splits)
-            self.samples = list(
-                filter(lambda x: len(x) > 0, reduce(H264ByteStream.reduce_nalus_to_samples, nalus, [[]])))
+            while True:
+                chunk = file.read(H264ByteStream.CHUNK_SIZE)
+                if not chunk:
+                    break
+                buffer += chunk
+                # Everything before the last start code holds complete NAL units
+                last_start = buffer.rfind(b"\x00\x00\x01")
+                if last_start <= 0:
+                    continue
+                if buffer[last_start - 1] == 0:
+                    last_start -= 1
+                for nalu in H264ByteStream.split_nalus(buffer[:last_start]):
+                    yield nalu
+                buffer = buffer[last_start:]
+        for nalu in H264ByteStream.split_nalus(buffer):
+            yield nalu
+
+    @staticmethod
+    def read_samples(file_name: str) -> Iterator[List[bytes]]:
+        sample = []
+        for nalu in H264ByteStream.read_nalus(file_name):
+            sample.append(nalu)
+            # Start a new sample after frame NALUs (1=non-IDR, 5=IDR)
+            # SEI (6), SPS (7), PPS (8) will be included with the next frame
+            if H264ByteStream.nalu_type(nalu) in [1, 5]:
+                yield sample
+                sample = []
+        if len(sample) > 0:
+            yield sample
+
+    def __init__(self, file_name: str):
+        # Samples are produced lazily so memory stays bounded by one chunk plus one sample
+        self.samples = H264ByteStream.read_samples(file_name)
+
 
+class SampleArchiveWriter:
+    """Packs all samples of a topic into one file (layout documented in sample_archive.h)."""
+    HEADER_MAGIC = b"H264PACK"
+    FOOTER_MAGIC = b"PACKINDX"
+    VERSION = 1
+    FLAG_KEYFRAME = 0x1
 
-def generate(input_file: str, output_dir: str, max_samples: Optional[int], fps: Optional[int]):
+    def __init__(self, file_name: str):
+        self.file = open(file_name, "wb")
+        self.file.write(self.HEADER_MAGIC + struct.pack(">II", self.VERSION, 0))
+        self.offset = 16
+        self.index = []
+
+    def append(self, sample: bytes, keyframe: bool, timestamp_us: int = 0):
+        flags = self.FLAG_KEYFRAME if keyframe else 0
+        self.index.append(struct.pack(">QIIQ", self.offset, len(sample), flags, timestamp_us))
+        self.file.write(sample)
+        self.offset += len(sample)
+
+    def close(self):
+        self.file.write(b"".join(self.index))
+        self.file.write(struct.pack(">QQ", self.offset, len(self.index)) + self.FOOTER_MAGIC)
+        self.file.close()
+
+
+SAMPLE_ARCHIVE_FILENAME = "samples.h264pack"
+
+
+def generate(input_file: str, output_dir: str, max_samples: Optional[int], fps: Optional[int],
+             packed: bool = False, per_file: bool = True):
     if output_dir[-1] != "/":
         output_dir += "/"
     if os.path.isdir(output_dir):
-        files_to_delete = glob.glob(output_dir + "*.h264")
+        files_to_delete = glob.glob(output_dir + "*.h264") + glob.glob(output_dir + "*.h264pack")
         if len(files_to_delete) > 0:
             print("Remove following files?")
             for file in files_to_delete:
@@ -75,18 +134,26 @@ def generate(input_file: str, output_dir: str, max_samples: Optional[int], fps:
         os.system(command)
 
         data = H264ByteStream(video_stream_file)
+    archive = SampleArchiveWriter(output_dir + SAMPLE_ARCHIVE_FILENAME) if packed else None
     index = 0
-    for sample in data.samples[:max_samples]:
+    for sample in islice(data.samples, max_samples):
         # Debug: Check NAL unit types in this sample
         # nal_types = [H264ByteStream.nalu_type(nalu) for nalu in sample]
         # if 6 in nal_types:  # SEI NAL unit
         #     print("Sample {} contains SEI (NAL types: {})".format(index, nal_types))
 
-        name = "{}sample-{}.h264".format(output_dir, index)
+        merged_sample = H264ByteStream.merge_sample(sample)
+        if archive is not None:
+            keyframe = any(H264ByteStream.nalu_type(nalu) == 5 for nalu in sample)
+            archive.append(merged_sample, keyframe)
+        if per_file:
+            name = "{}sample-{}.h264".format(output_dir, index)
+            with open(name, 'wb') as file:
+                file.write(merged_sample)
         index += 1
-        with open(name, 'wb') as file:
-            merged_sample = H264ByteStream.merge_sample(sample)
-            file.write(merged_sample)
+
+    if archive is not None:
+        archive.close()
 
     # Only remove temp file if it was created
     if not input_file.endswith('.h264') and 'video_stream_file' in locals():
@@ -97,10 +164,13 @@ def main(argv):
     input_file = None
     default_output_dir = "h264/"
     output_dir = default_output_dir
+    packed = False
+    per_file = None
     try:
-        opts, args = getopt.getopt(argv, "hi:o:m:f:", ["help", "ifile=", "odir=", "max=", "fps"])
+        opts, args = getopt.getopt(argv, "hi:o:m:f:ps", ["help", "ifile=", "odir=", "max=", "fps", "packed",
+                                                          "split-files"])
     except getopt.GetoptError:
-        print('generate_h264.py -i <input_files> [-o <output_files>] [-m <max_samples>] [-f <fps>] [-h]')
+        print('generate_h264.py -i <input_files> [-o <output_files>] [-m <max_samples>] [-f <fps>] [-p [-s]] [-h]')
         sys.exit(2)
     for opt, arg in opts:
         if opt in ("-h", "--help"):
@@ -109,16 +179,24 @@ def main(argv):
             print("\t-i,--ifile: Input file")
             print("\t-o,--odir: Output directory (default: " + default_output_dir + ")")
             print("\t-m,--max: Maximum generated samples")
+            print("\t-p,--packed: Write all samples into " + SAMPLE_ARCHIVE_FILENAME + " instead of sample-N.h264")
+            print("\t-s,--split-files: With --packed, also export sample-N.h264 files")
             print("\t-h,--help: Print this help and exit")
             sys.exit()
         elif opt in ("-i", "--ifile"):
             input_file = arg
         elif opt in ("-o", "--ofile"):
             output_dir = arg
+        elif opt in ("-p", "--packed"):
+            packed = True
+        elif opt in ("-s", "--split-files"):
+            per_file = True
     if input_file is None:
         print("Missing argument -i")
         sys.exit(2)
-    generate(input_file, output_dir, None, None)
+    if per_file is None:
+        per_file = not packed
+    generate(input_file, output_dir, None, None, packed, per_file)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,585 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <limits>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "sei_generator.h"
+#include "h264_sample.h"
+#include "sample_archive.h"
+#include "async_writer.h"
+
+// Cut and concatenate processed H.264 streams by their SEI timestamps, without decoding.
+//
+// Inputs and the output are any of the stream forms the pipeline writes: an Annex-B
+// stream (*.h264, e.g. from rosbag_analyzed --stream), a directory of length-prefixed
+// sample-N.h264 files, or a packed archive (*.h264pack). A sample's time is its simple
+// timestamp SEI (the archive index time when it has none).
+//
+// A cut starts at the last IDR picture at or before --from, so every requested frame
+// decodes, and ends with the last sample at or before --to. If that IDR sample carries
+// no SPS/PPS, the latest ones of its input are put in front of it. Inputs are cut to the
+// same range and written one after another. Samples are copied as they are; only the
+// timestamp SEI is rewritten in the form of the output (escaped in Annex-B).
+
+namespace {
+
+enum class StreamFormat { AnnexB, SampleFiles, Archive };
+
+struct Sample {
+    std::vector<std::vector<uint8_t>> nals;   // Without the timestamp SEI
+    uint64_t timestamp_us = 0;                // 0 if the sample has no timestamp
+    bool keyframe = false;
+    bool parameter_sets = false;              // Carries an SPS
+};
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] -o <output> <input>..." << std::endl;
+    std::cerr << "  --from <t>          First time to keep (default: start of each input)" << std::endl;
+    std::cerr << "  --to <t>            Last time to keep (default: end of each input)" << std::endl;
+    std::cerr << "  --duration <sec>    Keep this long after --from (instead of --to)" << std::endl;
+    std::cerr << "  -o <output>         *.h264 (Annex-B), *.h264pack (archive) or a directory of sample-N.h264" << std::endl;
+    std::cerr << "                      (an existing directory or a path ending in /)" << std::endl;
+    std::cerr << "  <t> is seconds since the epoch, or +<sec> after the first sample of the first input" << std::endl;
+    std::cerr << "  Inputs are Annex-B streams, sample-N.h264 directories or *.h264pack archives" << std::endl;
+}
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isDirectory(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+StreamFormat formatOf(const std::string& path) {
+    if (SampleArchiveReader::isArchivePath(path)) {
+        return StreamFormat::Archive;
+    }
+    if (isDirectory(path) || !endsWith(path, ".h264")) {
+        return StreamFormat::SampleFiles;
+    }
+    return StreamFormat::AnnexB;
+}
+
+// Outputs are a sample-N.h264 directory only when the path is one already or ends in '/',
+// so a mistyped or unsupported extension is not turned into a new directory
+bool outputFormatOf(const std::string& path, StreamFormat& format) {
+    if (SampleArchiveReader::isArchivePath(path)) {
+        format = StreamFormat::Archive;
+    } else if (isDirectory(path) || endsWith(path, "/")) {
+        format = StreamFormat::SampleFiles;
+    } else if (endsWith(path, ".h264")) {
+        format = StreamFormat::AnnexB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Sample number from "sample-123.h264", -1 if the name does not match
+long sampleNumber(const std::string& filename) {
+    if (filename.compare(0, 7, "sample-") != 0 || !endsWith(filename, ".h264")) {
+        return -1;
+    }
+    std::string digits = filename.substr(7, filename.size() - 12);
+    if (digits.empty() || digits.size() > 18 || digits.find_first_not_of("0123456789") != std::string::npos) {
+        return -1;
+    }
+    return std::strtol(digits.c_str(), nullptr, 10);
+}
+
+// Split off the timestamp SEI and note what the sample holds
+void makeSample(std::vector<std::vector<uint8_t>>& nals, Sample& sample) {
+    sample.nals.clear();
+    sample.timestamp_us = 0;
+    sample.keyframe = false;
+    sample.parameter_sets = false;
+    for (auto& nal : nals) {
+        uint8_t type = nal[0] & 0x1F;
+        if (type == NAL_UNIT_TYPE_SEI && sample.timestamp_us == 0) {
+            uint64_t timestamp = SEIGenerator::extractSimpleTimestampFromSEI(nal);
+            if (timestamp == 0) {
+                timestamp = SEIGenerator::extractTimestampFromSEI(nal);
+            }
+            if (timestamp != 0) {
+                sample.timestamp_us = timestamp;
+                continue;
+            }
+        }
+        sample.keyframe = sample.keyframe || type == NAL_UNIT_TYPE_IDR;
+        sample.parameter_sets = sample.parameter_sets || type == NAL_UNIT_TYPE_SPS;
+        sample.nals.push_back(std::move(nal));
+    }
+}
+
+bool parseLengthPrefixedSample(const std::vector<uint8_t>& data, Sample& sample) {
+    std::vector<NalUnitRef> refs;
+    bool valid = H264Sample::parseLengthPrefixed(data.data(), data.size(), refs);
+    std::vector<std::vector<uint8_t>> nals;
+    for (const auto& ref : refs) {
+        nals.emplace_back(data.begin() + ref.offset, data.begin() + ref.offset + ref.length);
+    }
+    makeSample(nals, sample);
+    return valid;
+}
+
+class SampleSource {
+public:
+    virtual ~SampleSource() = default;
+    virtual bool open(const std::string& path) = 0;
+
+    // Skip samples that cannot be part of a cut starting at start_us, if the format allows
+    virtual void seek(uint64_t /*start_us*/) {}
+
+    /**
+     * Next sample in stream order
+     * @return false at the end of the input
+     */
+    virtual bool next(Sample& sample) = 0;
+};
+
+class AnnexBSource : public SampleSource {
+public:
+    bool open(const std::string& path) override {
+        file_.open(path, std::ios::binary);
+        return static_cast<bool>(file_);
+    }
+
+    bool next(Sample& sample) override {
+        AnnexBSampleReader::Sample nals;
+        while (!reader_.next(nals)) {
+            if (ended_) {
+                return false;
+            }
+            file_.read(reinterpret_cast<char*>(buffer_.data()), buffer_.size());
+            if (file_.gcount() > 0) {
+                reader_.append(buffer_.data(), static_cast<size_t>(file_.gcount()));
+            }
+            if (!file_) {
+                reader_.finish();
+                ended_ = true;
+            }
+        }
+        makeSample(nals, sample);
+        return true;
+    }
+
+private:
+    std::ifstream file_;
+    std::vector<uint8_t> buffer_ = std::vector<uint8_t>(1 << 20);
+    AnnexBSampleReader reader_;
+    bool ended_ = false;
+};
+
+class SampleFilesSource : public SampleSource {
+public:
+    bool open(const std::string& path) override {
+        DIR* dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return false;
+        }
+        std::vector<std::pair<long, std::string>> files;
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            long number = sampleNumber(entry->d_name);
+            if (number >= 0) {
+                files.emplace_back(number, path + "/" + entry->d_name);
+            }
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) {
+            files_.push_back(file.second);
+        }
+        return !files_.empty();
+    }
+
+    bool next(Sample& sample) override {
+        if (position_ >= files_.size()) {
+            return false;
+        }
+        const std::string& path = files_[position_++];
+        std::ifstream file(path, std::ios::binary);
+        data_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (!parseLengthPrefixedSample(data_, sample)) {
+            std::cerr << "  ⚠️  Malformed NAL length in " << path << std::endl;
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::string> files_;
+    size_t position_ = 0;
+    std::vector<uint8_t> data_;
+};
+
+class ArchiveSource : public SampleSource {
+public:
+    bool open(const std::string& path) override {
+        path_ = path;
+        return reader_.open(path);
+    }
+
+    // The index has every sample's time and keyframe flag: start at the last keyframe at
+    // or before start_us, or at the last earlier sample carrying the SPS it needs
+    void seek(uint64_t start_us) override {
+        size_t keyframe = reader_.sampleCount();
+        for (size_t i = 0; i < reader_.sampleCount(); i++) {
+            const SampleIndexEntry& entry = reader_.entry(i);
+            if (entry.timestamp_us == 0) {
+                return;    // No index times; read from the start
+            }
+            if (entry.timestamp_us > start_us) {
+                break;
+            }
+            if (entry.flags & SAMPLE_FLAG_KEYFRAME) {
+                keyframe = i;
+            }
+        }
+        if (keyframe == reader_.sampleCount()) {
+            return;
+        }
+        for (size_t i = keyframe + 1; i-- > 0;) {
+            Sample sample;
+            if (readSample(i, sample) && sample.parameter_sets) {
+                position_ = i;
+                return;
+            }
+        }
+    }
+
+    bool next(Sample& sample) override {
+        if (position_ >= reader_.sampleCount()) {
+            return false;
+        }
+        return readSample(position_++, sample);
+    }
+
+private:
+    bool readSample(size_t i, Sample& sample) {
+        if (!reader_.readSample(i, data_)) {
+            std::cerr << "Failed to read sample " << i << " from " << path_ << std::endl;
+            return false;
+        }
+        if (!parseLengthPrefixedSample(data_, sample)) {
+            std::cerr << "  ⚠️  Malformed NAL length in sample " << i << " of " << path_ << std::endl;
+        }
+        if (sample.timestamp_us == 0) {
+            sample.timestamp_us = reader_.entry(i).timestamp_us;
+        }
+        return true;
+    }
+
+    std::string path_;
+    SampleArchiveReader reader_;
+    size_t position_ = 0;
+    std::vector<uint8_t> data_;
+};
+
+std::unique_ptr<SampleSource> openSource(const std::string& path) {
+    std::unique_ptr<SampleSource> source;
+    switch (formatOf(path)) {
+        case StreamFormat::AnnexB:
+            source.reset(new AnnexBSource());
+            break;
+        case StreamFormat::SampleFiles:
+            source.reset(new SampleFilesSource());
+            break;
+        case StreamFormat::Archive:
+            source.reset(new ArchiveSource());
+            break;
+    }
+    if (!source->open(path)) {
+        std::cerr << "❌ Cannot read " << path << std::endl;
+        source.reset();
+    }
+    return source;
+}
+
+class SampleSink {
+public:
+    bool open(const std::string& path, StreamFormat format) {
+        path_ = path;
+        format_ = format;
+        switch (format_) {
+            case StreamFormat::AnnexB:
+                file_.open(path, std::ios::binary | std::ios::trunc);
+                return static_cast<bool>(file_);
+            case StreamFormat::SampleFiles:
+                mkdir(path.c_str(), 0755);
+                return isDirectory(path);
+            case StreamFormat::Archive:
+                return archive_.open(path, &writer_);
+        }
+        return false;
+    }
+
+    void write(const Sample& sample) {
+        std::vector<uint8_t> data;
+        if (format_ == StreamFormat::AnnexB) {
+            static const uint8_t start_code[4] = {0x00, 0x00, 0x00, 0x01};
+            if (sample.timestamp_us != 0) {
+                std::vector<uint8_t> sei_nal = SEIGenerator::createSimpleTimestampSEIAnnexB(sample.timestamp_us);
+                data.insert(data.end(), start_code, start_code + 4);
+                data.insert(data.end(), sei_nal.begin(), sei_nal.end());
+            }
+            for (const auto& nal : sample.nals) {
+                data.insert(data.end(), start_code, start_code + 4);
+                data.insert(data.end(), nal.begin(), nal.end());
+            }
+            file_.write(reinterpret_cast<const char*>(data.data()), data.size());
+        } else {
+            if (sample.timestamp_us != 0) {
+                std::vector<uint8_t> sei_nal = SEIGenerator::createSimpleTimestampSEI(sample.timestamp_us);
+                H264Sample::appendLengthPrefixed(data, sei_nal.data(), sei_nal.size());
+            }
+            for (const auto& nal : sample.nals) {
+                H264Sample::appendLengthPrefixed(data, nal.data(), nal.size());
+            }
+            if (format_ == StreamFormat::Archive) {
+                archive_.appendSample(data.data(), data.size(), sample.keyframe ? SAMPLE_FLAG_KEYFRAME : 0,
+                                      sample.timestamp_us);
+            } else {
+                writer_.writeFile(path_ + "/sample-" + std::to_string(count_) + ".h264", std::move(data));
+            }
+        }
+        count_++;
+    }
+
+    bool close() {
+        bool ok = true;
+        if (format_ == StreamFormat::AnnexB) {
+            file_.close();
+            ok = static_cast<bool>(file_);
+        } else if (format_ == StreamFormat::Archive) {
+            ok = archive_.close();
+        }
+        return writer_.flush() && ok;
+    }
+
+    size_t count() const { return count_; }
+
+private:
+    std::string path_;
+    StreamFormat format_ = StreamFormat::AnnexB;
+    std::ofstream file_;
+    AsyncWriter writer_;
+    SampleArchiveWriter archive_;
+    size_t count_ = 0;
+};
+
+struct CutResult {
+    size_t samples = 0;
+    uint64_t first_us = 0;
+    uint64_t last_us = 0;
+    size_t untimed = 0;     // Samples without a timestamp
+};
+
+// Copy the samples of one input from the last IDR at or before from_us up to to_us.
+// Samples before the cut point are only buffered for the current GOP.
+bool cutInput(SampleSource& source, uint64_t from_us, uint64_t to_us, SampleSink& sink, CutResult& result) {
+    source.seek(from_us);
+
+    std::vector<std::vector<uint8_t>> parameter_sets;      // Latest SPS/PPS of the input
+    std::vector<std::vector<uint8_t>> gop_parameter_sets;  // Those in effect at the buffered IDR
+    std::vector<Sample> gop;
+    bool started = false;
+    Sample sample;
+
+    auto emit = [&](const Sample& output) {
+        if (result.samples == 0) {
+            result.first_us = output.timestamp_us;
+        }
+        result.last_us = output.timestamp_us;
+        result.untimed += output.timestamp_us == 0 ? 1 : 0;
+        result.samples++;
+        sink.write(output);
+    };
+
+    while (source.next(sample)) {
+        if (sample.parameter_sets) {
+            parameter_sets.clear();
+            for (const auto& nal : sample.nals) {
+                uint8_t type = nal[0] & 0x1F;
+                if (type == NAL_UNIT_TYPE_SPS || type == NAL_UNIT_TYPE_PPS) {
+                    parameter_sets.push_back(nal);
+                }
+            }
+        }
+
+        if (started) {
+            if (sample.timestamp_us > to_us) {
+                break;
+            }
+            emit(sample);
+            continue;
+        }
+
+        // Before the cut: keep the GOP that would have to be decoded to reach it
+        if (sample.keyframe) {
+            gop.clear();
+            gop_parameter_sets = parameter_sets;
+        }
+        if (gop.empty() && !sample.keyframe) {
+            continue;
+        }
+        gop.push_back(sample);
+        if (sample.timestamp_us < from_us) {
+            continue;
+        }
+
+        started = true;
+        if (!gop.front().parameter_sets) {
+            if (gop_parameter_sets.empty()) {
+                std::cerr << "❌ No SPS/PPS before the IDR at " << gop.front().timestamp_us << std::endl;
+                return false;
+            }
+            gop.front().nals.insert(gop.front().nals.begin(), gop_parameter_sets.begin(), gop_parameter_sets.end());
+            gop.front().parameter_sets = true;
+        }
+        for (const Sample& buffered : gop) {
+            if (buffered.timestamp_us > to_us) {
+                break;
+            }
+            emit(buffered);
+        }
+        gop.clear();
+        if (sample.timestamp_us > to_us) {
+            break;
+        }
+    }
+    return started;
+}
+
+// Seconds since the epoch, or "+<sec>" relative to base_us
+uint64_t parseTime(const std::string& text, uint64_t base_us) {
+    bool relative = !text.empty() && text[0] == '+';
+    double seconds = std::stod(relative ? text.substr(1) : text);
+    if (seconds < 0) {
+        throw std::invalid_argument(text);
+    }
+    uint64_t us = static_cast<uint64_t>(std::llround(seconds * 1e6));
+    return relative ? base_us + us : us;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string from_text;
+    std::string to_text;
+    double duration = -1.0;
+    std::string output_path;
+    std::vector<std::string> inputs;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--from" && has_value) {
+                from_text = argv[++i];
+            } else if (arg == "--to" && has_value) {
+                to_text = argv[++i];
+            } else if (arg == "--duration" && has_value) {
+                duration = std::stod(argv[++i]);
+            } else if (arg == "-o" && has_value) {
+                output_path = argv[++i];
+            } else if (!arg.empty() && arg[0] == '-') {
+                printUsage(argv[0]);
+                return 2;
+            } else {
+                inputs.push_back(arg);
+            }
+        }
+    } catch (const std::exception& e) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    StreamFormat output_format = StreamFormat::AnnexB;
+    if (inputs.empty() || output_path.empty() || (duration >= 0 && !to_text.empty()) ||
+        (duration >= 0 && from_text.empty()) || !outputFormatOf(output_path, output_format)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    // Relative times count from the first sample of the first input
+    uint64_t base_us = 0;
+    bool relative = (!from_text.empty() && from_text[0] == '+') || (!to_text.empty() && to_text[0] == '+');
+    if (relative) {
+        std::unique_ptr<SampleSource> first = openSource(inputs[0]);
+        Sample sample;
+        if (!first || !first->next(sample) || sample.timestamp_us == 0) {
+            std::cerr << "❌ No timestamp on the first sample of " << inputs[0] << std::endl;
+            return 1;
+        }
+        base_us = sample.timestamp_us;
+    }
+
+    uint64_t from_us = 0;
+    uint64_t to_us = std::numeric_limits<uint64_t>::max();
+    try {
+        if (!from_text.empty()) {
+            from_us = parseTime(from_text, base_us);
+        }
+        if (!to_text.empty()) {
+            to_us = parseTime(to_text, base_us);
+        } else if (duration >= 0) {
+            to_us = from_us + static_cast<uint64_t>(std::llround(duration * 1e6));
+        }
+    } catch (const std::exception& e) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (to_us < from_us) {
+        std::cerr << "❌ --to is before --from" << std::endl;
+        return 2;
+    }
+
+    SampleSink sink;
+    if (!sink.open(output_path, output_format)) {
+        std::cerr << "❌ Cannot create " << output_path << std::endl;
+        return 1;
+    }
+
+    bool ok = true;
+    uint64_t last_us = 0;
+    for (const std::string& input : inputs) {
+        std::unique_ptr<SampleSource> source = openSource(input);
+        if (!source) {
+            ok = false;
+            continue;
+        }
+        CutResult result;
+        if (!cutInput(*source, from_us, to_us, sink, result)) {
+            std::cout << "  ⚠️  " << input << ": no samples in range" << std::endl;
+            continue;
+        }
+        std::cout << "✂️  " << input << ": " << result.samples << " samples, " << std::fixed
+                  << std::setprecision(3) << result.first_us / 1e6 << " - " << result.last_us / 1e6 << std::endl;
+        if (result.untimed > 0) {
+            std::cout << "  ⚠️  " << result.untimed << " samples have no timestamp SEI" << std::endl;
+        }
+        if (result.first_us < last_us) {
+            std::cout << "  ⚠️  Timestamps go back at the start of " << input << std::endl;
+        }
+        last_us = std::max(last_us, result.last_us);
+    }
+
+    if (!sink.close()) {
+        std::cerr << "❌ Failed to write " << output_path << std::endl;
+        return 1;
+    }
+    if (sink.count() == 0) {
+        std::cerr << "❌ No samples in the requested range" << std::endl;
+        return 1;
+    }
+    std::cout << "✅ " << sink.count() << " samples written to " << output_path << std::endl;
+    return ok ? 0 : 1;
+}
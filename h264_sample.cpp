@@ -0,0 +1,165 @@
+#include "h264_sample.h"
+
+bool H264Sample::parseLengthPrefixed(const uint8_t* data, size_t size, std::vector<NalUnitRef>& nals) {
+    size_t pos = 0;
+
+    while (pos + 4 <= size) {
+        // Read 4-byte length (big-endian)
+        uint32_t length = (uint32_t(data[pos]) << 24) | (uint32_t(data[pos + 1]) << 16) |
+                          (uint32_t(data[pos + 2]) << 8) | uint32_t(data[pos + 3]);
+        size_t nal_start = pos + 4;
+
+        if (length > size - nal_start) {
+            return false;
+        }
+
+        if (length > 0) {
+            NalUnitRef nal;
+            nal.offset = nal_start;
+            nal.length = length;
+            nal.type = data[nal_start] & 0x1F;
+            nals.push_back(nal);
+        }
+
+        pos = nal_start + length;
+    }
+
+    // Trailing bytes that cannot hold a length prefix
+    return pos == size;
+}
+
+void H264Sample::parseAnnexB(const uint8_t* data, size_t size, std::vector<NalUnitRef>& nals) {
+    size_t nal_start = 0;
+    bool in_nal = false;
+
+    auto add_nal = [&](size_t end) {
+        // Zero bytes before a start code are trailing_zero_8bits (or the 4-byte code's first byte)
+        while (end > nal_start && data[end - 1] == 0) {
+            end--;
+        }
+        if (end > nal_start) {
+            NalUnitRef nal;
+            nal.offset = nal_start;
+            nal.length = static_cast<uint32_t>(end - nal_start);
+            nal.type = data[nal_start] & 0x1F;
+            nals.push_back(nal);
+        }
+    };
+
+    size_t pos = 0;
+    while (pos + 3 <= size) {
+        if (data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1) {
+            if (in_nal) {
+                add_nal(pos);
+            }
+            nal_start = pos + 3;
+            in_nal = true;
+            pos += 3;
+        } else {
+            pos++;
+        }
+    }
+    if (in_nal) {
+        add_nal(size);
+    }
+}
+
+void H264Sample::appendLengthPrefixed(std::vector<uint8_t>& out, const uint8_t* nal, size_t size) {
+    uint32_t length = static_cast<uint32_t>(size);
+    out.push_back((length >> 24) & 0xFF);
+    out.push_back((length >> 16) & 0xFF);
+    out.push_back((length >> 8) & 0xFF);
+    out.push_back(length & 0xFF);
+    out.insert(out.end(), nal, nal + size);
+}
+
+bool H264Sample::isKeyframe(const std::vector<NalUnitRef>& nals) {
+    for (const auto& nal : nals) {
+        if (nal.type == NAL_UNIT_TYPE_IDR) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t H264Sample::countPictures(const std::vector<NalUnitRef>& nals) {
+    size_t pictures = 0;
+    for (const auto& nal : nals) {
+        if (nal.type == NAL_UNIT_TYPE_NON_IDR || nal.type == NAL_UNIT_TYPE_IDR) {
+            pictures++;
+        }
+    }
+    return pictures;
+}
+
+void AnnexBSampleReader::append(const uint8_t* data, size_t size) {
+    buffer_.insert(buffer_.end(), data, data + size);
+
+    // Resume the start code search where the previous piece ended (a start code can
+    // straddle two pieces), so a large NAL unit arriving in small pieces is scanned once
+    const uint8_t* bytes = buffer_.data();
+    size_t pos = scan_;
+    while (pos + 3 <= buffer_.size()) {
+        if (bytes[pos] == 0 && bytes[pos + 1] == 0 && bytes[pos + 2] == 1) {
+            if (in_nal_) {
+                completeNal(pos);
+            }
+            nal_start_ = pos + 3;
+            in_nal_ = true;
+            pos += 3;
+        } else {
+            pos++;
+        }
+    }
+    scan_ = pos;
+
+    // Only the NAL unit still being received stays buffered
+    size_t consumed = in_nal_ ? nal_start_ : scan_;
+    if (consumed > 0) {
+        buffer_.erase(buffer_.begin(), buffer_.begin() + consumed);
+        scan_ -= consumed;
+        nal_start_ -= in_nal_ ? consumed : 0;
+    }
+}
+
+void AnnexBSampleReader::finish() {
+    if (in_nal_) {
+        completeNal(buffer_.size());
+    }
+    buffer_.clear();
+    pending_.clear();
+    scan_ = 0;
+    nal_start_ = 0;
+    in_nal_ = false;
+}
+
+bool AnnexBSampleReader::next(Sample& sample) {
+    if (samples_.empty()) {
+        return false;
+    }
+    sample.swap(samples_.front());
+    samples_.pop_front();
+    return true;
+}
+
+// The NAL unit starting at nal_start_ ends before end
+void AnnexBSampleReader::completeNal(size_t end) {
+    // Zero bytes before a start code are trailing_zero_8bits (or the 4-byte code's first byte)
+    while (end > nal_start_ && buffer_[end - 1] == 0) {
+        end--;
+    }
+    if (end > nal_start_) {
+        addNal(buffer_.data() + nal_start_, end - nal_start_);
+    }
+}
+
+void AnnexBSampleReader::addNal(const uint8_t* nal, size_t size) {
+    pending_.emplace_back(nal, nal + size);
+
+    // A picture completes the sample
+    uint8_t type = nal[0] & 0x1F;
+    if (type == NAL_UNIT_TYPE_NON_IDR || type == NAL_UNIT_TYPE_IDR) {
+        samples_.push_back(Sample());
+        samples_.back().swap(pending_);
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef H264_SAMPLE_H
+#define H264_SAMPLE_H
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+// NAL unit types used when walking samples
+constexpr uint8_t NAL_UNIT_TYPE_NON_IDR = 1;
+constexpr uint8_t NAL_UNIT_TYPE_IDR = 5;
+constexpr uint8_t NAL_UNIT_TYPE_SPS = 7;
+constexpr uint8_t NAL_UNIT_TYPE_PPS = 8;
+
+// Location of one NAL unit inside a length-prefixed sample or an Annex-B stream
+struct NalUnitRef {
+    size_t offset;      // Offset of the NAL header byte (after the length or start code)
+    uint32_t length;    // NAL unit size in bytes
+    uint8_t type;       // nal_unit_type (low 5 bits of the header)
+};
+
+class H264Sample {
+public:
+    /**
+     * Split a length-prefixed sample (4-byte big-endian size + NAL) into NAL units
+     * @param data Sample bytes
+     * @param size Sample size in bytes
+     * @param nals Output list of NAL units found before the first error
+     * @return false if a length prefix runs past the end of the sample
+     */
+    static bool parseLengthPrefixed(const uint8_t* data, size_t size, std::vector<NalUnitRef>& nals);
+
+    /**
+     * Split an Annex-B byte stream (3- or 4-byte start codes) into NAL units
+     * @param data Stream bytes
+     * @param size Stream size in bytes
+     * @param nals Output list of NAL units (offsets point past the start codes)
+     */
+    static void parseAnnexB(const uint8_t* data, size_t size, std::vector<NalUnitRef>& nals);
+
+    /**
+     * Append a NAL unit to a buffer with its 4-byte big-endian length prefix
+     * @param out Destination buffer
+     * @param nal NAL unit data (without start code)
+     * @param size NAL unit size in bytes
+     */
+    static void appendLengthPrefixed(std::vector<uint8_t>& out, const uint8_t* nal, size_t size);
+
+    /**
+     * Check whether a sample contains an IDR slice
+     * @param nals NAL units of the sample
+     * @return true if any NAL unit is of type 5
+     */
+    static bool isKeyframe(const std::vector<NalUnitRef>& nals);
+
+    /**
+     * Count the coded pictures of a stream (one slice per picture, as x264 writes them)
+     * @param nals NAL units of the stream
+     * @return Number of IDR and non-IDR slices
+     */
+    static size_t countPictures(const std::vector<NalUnitRef>& nals);
+};
+
+// Groups an Annex-B byte stream into samples the way generate_h264.py does: parameter
+// sets, SEI and other non-picture NAL units go with the next picture. Bytes can arrive in
+// pieces of any size; only the NAL unit still being received stays buffered.
+class AnnexBSampleReader {
+public:
+    typedef std::vector<std::vector<uint8_t>> Sample;    // NAL units without start codes
+
+    /**
+     * Add stream bytes
+     * @param data Next bytes of the stream
+     * @param size Number of bytes
+     */
+    void append(const uint8_t* data, size_t size);
+
+    // The stream has ended, so its last NAL unit is complete
+    void finish();
+
+    /**
+     * Take the next complete sample
+     * @param sample Receives the sample's NAL units
+     * @return false if no complete sample is buffered
+     */
+    bool next(Sample& sample);
+
+private:
+    void completeNal(size_t end);
+    void addNal(const uint8_t* nal, size_t size);
+
+    std::vector<uint8_t> buffer_;
+    size_t scan_ = 0;                // Where the start code search resumes in buffer_
+    size_t nal_start_ = 0;           // First byte of the NAL unit being received
+    bool in_nal_ = false;            // A start code has been seen
+    Sample pending_;                 // NAL units waiting for their picture
+    std::deque<Sample> samples_;
+};
+
+#endif // H264_SAMPLE_H
@@ -0,0 +1,273 @@
+#include "h264_stream_encoder.h"
+#include "h264_sample.h"
+#include "sei_generator.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace {
+
+const uint8_t START_CODE[4] = {0x00, 0x00, 0x00, 0x01};
+
+// Blocks SIGPIPE on the calling thread for a scope, so a closed pipe fails the write with
+// EPIPE instead of killing a process that did not ignore the signal. A SIGPIPE raised in
+// the scope is consumed before the mask is restored.
+class SigpipeBlock {
+public:
+    SigpipeBlock() {
+        sigemptyset(&sigpipe_);
+        sigaddset(&sigpipe_, SIGPIPE);
+        sigset_t pending;
+        sigpending(&pending);
+        was_pending_ = sigismember(&pending, SIGPIPE) == 1;
+        blocked_ = pthread_sigmask(SIG_BLOCK, &sigpipe_, &previous_) == 0;
+    }
+
+    ~SigpipeBlock() {
+        if (!blocked_) {
+            return;
+        }
+        int saved_errno = errno;
+        sigset_t pending;
+        sigpending(&pending);
+        if (!was_pending_ && sigismember(&pending, SIGPIPE) == 1) {
+            struct timespec no_wait = {0, 0};
+            while (sigtimedwait(&sigpipe_, nullptr, &no_wait) < 0 && errno == EINTR) {
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &previous_, nullptr);
+        errno = saved_errno;
+    }
+
+    SigpipeBlock(const SigpipeBlock&) = delete;
+    SigpipeBlock& operator=(const SigpipeBlock&) = delete;
+
+private:
+    sigset_t sigpipe_;
+    sigset_t previous_;
+    bool was_pending_ = false;
+    bool blocked_ = false;
+};
+
+bool write_all(int fd, const uint8_t* data, size_t size) {
+    SigpipeBlock sigpipe_block;
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+void append_annexb(std::vector<uint8_t>& out, const uint8_t* nal, size_t size) {
+    out.insert(out.end(), START_CODE, START_CODE + sizeof(START_CODE));
+    out.insert(out.end(), nal, nal + size);
+}
+
+} // namespace
+
+H264StreamEncoder::H264StreamEncoder(int output_fd, const StreamEncoderOptions& options)
+    : output_fd_(output_fd), options_(options) {}
+
+H264StreamEncoder::~H264StreamEncoder() {
+    finish();
+}
+
+bool H264StreamEncoder::start(int width, int height) {
+    width_ = width;
+    height_ = height;
+
+    int input_pipe[2];
+    int output_pipe[2];
+    if (pipe2(input_pipe, O_CLOEXEC) != 0) {
+        return false;
+    }
+    if (pipe2(output_pipe, O_CLOEXEC) != 0) {
+        close(input_pipe[0]);
+        close(input_pipe[1]);
+        return false;
+    }
+
+    std::vector<std::string> args = {
+        "ffmpeg", "-hide_banner", "-loglevel", "error",
+        "-f", "rawvideo", "-pix_fmt", "bgr24",
+        "-s", std::to_string(width) + "x" + std::to_string(height),
+        "-framerate", std::to_string(options_.fps),
+        "-i", "-",
+        "-vf", "scale=trunc(iw/2)*2:trunc(ih/2)*2",  // Ensure even dimensions
+        "-c:v", "libx264",
+        "-pix_fmt", "yuv420p",
+        "-bf", "0",                                    // Output order = frame order
+        "-g", std::to_string(options_.gop_size),
+        "-keyint_min", std::to_string(options_.gop_size),
+        "-sc_threshold", "0",
+        "-bsf:v", "h264_mp4toannexb",
+        "-f", "h264", "-"};
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    // The child gets the pipes as stdin/stdout and keeps our stderr for its errors
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, input_pipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, output_pipe[1], STDOUT_FILENO);
+    int result = posix_spawnp(&child_, "ffmpeg", &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    close(input_pipe[0]);
+    close(output_pipe[1]);
+    if (result != 0) {
+        std::cerr << "❌ Cannot start ffmpeg: " << std::strerror(result) << std::endl;
+        close(input_pipe[1]);
+        close(output_pipe[0]);
+        child_ = -1;
+        return false;
+    }
+    to_encoder_ = input_pipe[1];
+    from_encoder_ = output_pipe[0];
+    forwarder_ = std::thread(&H264StreamEncoder::forward, this);
+    return true;
+}
+
+bool H264StreamEncoder::encode(const cv::Mat& frame, uint64_t timestamp_us) {
+    if (failed_ || finished_ || frame.empty()) {
+        return false;
+    }
+    if (child_ < 0 && !start(frame.cols, frame.rows)) {
+        failed_ = true;
+        return false;
+    }
+
+    const cv::Mat* bgr = &frame;
+    if (frame.channels() == 1) {
+        cv::cvtColor(frame, converted_, cv::COLOR_GRAY2BGR);
+        bgr = &converted_;
+    } else if (frame.channels() == 4) {
+        cv::cvtColor(frame, converted_, cv::COLOR_BGRA2BGR);
+        bgr = &converted_;
+    }
+    if (bgr->cols != width_ || bgr->rows != height_) {
+        cv::Mat resized;
+        cv::resize(*bgr, resized, cv::Size(width_, height_));
+        converted_ = resized;
+        bgr = &converted_;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timestamps_.push_back(timestamp_us);
+    }
+    size_t row_bytes = static_cast<size_t>(width_) * 3;
+    for (int y = 0; y < height_; y++) {
+        if (!write_all(to_encoder_, bgr->ptr<uint8_t>(y), row_bytes)) {
+            failed_ = true;
+            return false;
+        }
+    }
+    frames_++;
+    return true;
+}
+
+// Reads ffmpeg's Annex-B output and writes one sample per picture. Keeps draining after
+// a failed write, so ffmpeg never blocks on a full pipe.
+void H264StreamEncoder::forward() {
+    AnnexBSampleReader reader;
+    AnnexBSampleReader::Sample nals;
+    std::vector<uint8_t> sample;     // Annex-B NAL units of the sample, without the encoder's SEI
+    std::vector<uint8_t> buffer(1 << 16);
+    bool end = false;
+
+    while (!end) {
+        ssize_t count = ::read(from_encoder_, buffer.data(), buffer.size());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        end = count <= 0;
+        if (end) {
+            reader.finish();
+        } else {
+            reader.append(buffer.data(), static_cast<size_t>(count));
+        }
+
+        while (reader.next(nals)) {
+            sample.clear();
+            for (const auto& nal : nals) {
+                if ((nal[0] & 0x1F) != NAL_UNIT_TYPE_SEI) {
+                    append_annexb(sample, nal.data(), nal.size());
+                }
+            }
+            if (!failed_ && !writeSample(sample)) {
+                std::cerr << "❌ Stream output closed: " << std::strerror(errno) << std::endl;
+                failed_ = true;
+            }
+        }
+    }
+}
+
+bool H264StreamEncoder::writeSample(const std::vector<uint8_t>& nals) {
+    uint64_t timestamp_us = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!timestamps_.empty()) {
+            timestamp_us = timestamps_.front();
+            timestamps_.pop_front();
+        }
+    }
+
+    std::vector<uint8_t> sei_nal = SEIGenerator::createSimpleTimestampSEIAnnexB(timestamp_us);
+    std::vector<uint8_t> sample;
+    sample.reserve(sizeof(START_CODE) + sei_nal.size() + nals.size());
+    append_annexb(sample, sei_nal.data(), sei_nal.size());
+    sample.insert(sample.end(), nals.begin(), nals.end());
+    if (!write_all(output_fd_, sample.data(), sample.size())) {
+        return false;
+    }
+    samples_++;
+    return true;
+}
+
+bool H264StreamEncoder::finish() {
+    if (finished_) {
+        return !failed_;
+    }
+    finished_ = true;
+    if (child_ < 0) {
+        return !failed_;
+    }
+
+    // EOF on stdin makes ffmpeg flush its remaining frames and exit
+    close(to_encoder_);
+    forwarder_.join();
+    close(from_encoder_);
+    int status = 0;
+    while (waitpid(child_, &status, 0) < 0 && errno == EINTR) {
+    }
+    child_ = -1;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "❌ ffmpeg failed (status " << status << ")" << std::endl;
+        failed_ = true;
+    } else if (!failed_ && samples_ != frames_) {
+        std::cerr << "❌ Encoder wrote " << samples_ << " samples for " << frames_ << " frames" << std::endl;
+        failed_ = true;
+    }
+    return !failed_;
+}
@@ -0,0 +1,85 @@
+#ifndef H264_STREAM_ENCODER_H
+#define H264_STREAM_ENCODER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+
+#include <opencv2/opencv.hpp>
+
+// Encodes frames to an Annex-B H.264 stream on a file descriptor, one timestamp SEI per
+// sample, without intermediate files.
+//
+// Frames are piped to an ffmpeg child as raw BGR; a forwarding thread reads its Annex-B
+// output, groups the NAL units into samples the way generate_h264.py does (SPS, PPS and
+// AUD go with the next picture), drops the encoder's own SEI and writes each sample with
+// a simple timestamp SEI in front (SEIGenerator::createSimpleTimestampSEIAnnexB). B-frames
+// are disabled, so samples leave the encoder in frame order and sample n carries the
+// timestamp of frame n.
+
+struct StreamEncoderOptions {
+    int gop_size = 30;           // IDR interval (where a consumer can join)
+    int fps = 30;                // Nominal rate; real times travel in the SEI
+};
+
+class H264StreamEncoder {
+public:
+    /**
+     * @param output_fd Descriptor receiving the stream (not closed)
+     * @param options GOP length and nominal frame rate
+     */
+    H264StreamEncoder(int output_fd, const StreamEncoderOptions& options = StreamEncoderOptions());
+
+    // Finishes the stream if finish() was not called
+    ~H264StreamEncoder();
+
+    H264StreamEncoder(const H264StreamEncoder&) = delete;
+    H264StreamEncoder& operator=(const H264StreamEncoder&) = delete;
+
+    /**
+     * Encode one frame; the first frame fixes the stream size (later frames are scaled)
+     * @param frame BGR, BGRA or mono8 image
+     * @param timestamp_us Timestamp written in the frame's SEI
+     * @return false if ffmpeg cannot be started or the stream is broken
+     */
+    bool encode(const cv::Mat& frame, uint64_t timestamp_us);
+
+    /**
+     * Flush the encoder and write the remaining samples
+     * @return false if ffmpeg or a write to the output failed
+     */
+    bool finish();
+
+    size_t framesEncoded() const { return frames_; }
+    size_t samplesWritten() const { return samples_; }
+
+private:
+    bool start(int width, int height);
+    void forward();
+    bool writeSample(const std::vector<uint8_t>& nals);
+
+    int output_fd_;
+    StreamEncoderOptions options_;
+    int width_ = 0;
+    int height_ = 0;
+    cv::Mat converted_;
+
+    pid_t child_ = -1;
+    int to_encoder_ = -1;      // ffmpeg stdin
+    int from_encoder_ = -1;    // ffmpeg stdout
+    std::thread forwarder_;
+    bool finished_ = false;
+
+    std::mutex mutex_;
+    std::deque<uint64_t> timestamps_;    // Frames sent, not yet written as samples
+    std::atomic<bool> failed_{false};
+    size_t frames_ = 0;
+    std::atomic<size_t> samples_{0};
+};
+
+#endif // H264_STREAM_ENCODER_H
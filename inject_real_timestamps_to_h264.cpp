@@ -9,6 +9,11 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include "sei_generator.h"
+#include "h264_sample.h"
+#include "sample_archive.h"
+#include "async_writer.h"
+#include "telemetry.h"
+#include "trace.h"
 
 // Helper function to check if a string ends with a suffix
 bool endsWith(const std::string& str, const std::string& suffix) {
@@ -81,18 +86,145 @@ int extractFrameNumberFromJpg(const std::string& filename) {
     return -1;
 }
 
+// Build one output sample: real timestamp SEI, the frame's telemetry SEI when available,
+// then the original NAL units (existing SEI dropped)
+bool injectTimestamp(const std::vector<uint8_t>& data, uint64_t real_timestamp, const TelemetrySidecar* telemetry,
+                     size_t frame_index, std::vector<uint8_t>& output, bool& keyframe) {
+    TRACE_SPAN("inject");
+    std::vector<NalUnitRef> nals;
+    bool valid = H264Sample::parseLengthPrefixed(data.data(), data.size(), nals);
+    keyframe = H264Sample::isKeyframe(nals);
+
+    output.clear();
+    output.reserve(data.size() + 16);
+
+    // Create SEI with real timestamp, written as length-prefixed (big-endian)
+    std::vector<uint8_t> sei_nal = SEIGenerator::createSimpleTimestampSEI(real_timestamp);
+    H264Sample::appendLengthPrefixed(output, sei_nal.data(), sei_nal.size());
+
+    // Keyframes carry the track table so playback can start at any of them
+    if (telemetry) {
+        std::vector<uint8_t> payload = telemetry->seiPayload(frame_index, keyframe);
+        if (!payload.empty()) {
+            std::vector<uint8_t> telemetry_nal = SEIGenerator::createTelemetrySEI(payload);
+            H264Sample::appendLengthPrefixed(output, telemetry_nal.data(), telemetry_nal.size());
+        }
+    }
+
+    // Copy original content (skip any existing SEI)
+    for (const auto& nal : nals) {
+        if (nal.type != NAL_UNIT_TYPE_SEI) {
+            H264Sample::appendLengthPrefixed(output, &data[nal.offset], nal.length);
+        }
+    }
+
+    return valid;
+}
+
+std::string sampleFilename(size_t sample_number) {
+    return "sample-" + std::to_string(sample_number) + ".h264";
+}
+
+// Inject timestamps into a packed archive, optionally exporting sample-N.h264 files as well
+int processArchive(const std::string& archive_path, const std::map<int, uint64_t>& frame_timestamps,
+                   const TelemetrySidecar* telemetry, const std::string& h264_output_dir, bool export_per_file,
+                   AsyncWriter& writer) {
+    SampleArchiveReader reader;
+    if (!reader.open(archive_path)) {
+        std::cerr << "Failed to open sample archive: " << archive_path << std::endl;
+        return 1;
+    }
+
+    std::string output_archive_path = h264_output_dir + "/" + SAMPLE_ARCHIVE_FILENAME;
+    SampleArchiveWriter archive;
+    if (!archive.open(output_archive_path, &writer)) {
+        std::cerr << "Failed to create: " << output_archive_path << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> output;
+    int processed_count = 0;
+
+    for (size_t i = 0; i < reader.sampleCount(); i++) {
+        auto timestamp_it = frame_timestamps.find(static_cast<int>(i));
+        if (timestamp_it == frame_timestamps.end()) {
+            // Keep numbering continuous: the archive cannot have holes
+            std::cerr << "  ❌ No timestamp found for sample " << i << ", stopping" << std::endl;
+            break;
+        }
+
+        TRACE_MARK(read_start);
+        bool read = reader.readSample(i, data);
+        TRACE_SINCE("read_sample", read_start);
+        if (!read) {
+            std::cerr << "Failed to read sample " << i << " from " << archive_path << std::endl;
+            break;
+        }
+
+        bool keyframe = false;
+        if (!injectTimestamp(data, timestamp_it->second, telemetry, i, output, keyframe)) {
+            std::cerr << "  ⚠️  Malformed NAL length in sample " << i << std::endl;
+        }
+
+        if (!archive.appendSample(output.data(), output.size(), keyframe ? SAMPLE_FLAG_KEYFRAME : 0,
+                                  timestamp_it->second)) {
+            std::cerr << "Failed to write sample " << i << " to " << output_archive_path << std::endl;
+            return 1;
+        }
+
+        if (export_per_file) {
+            std::string output_file = h264_output_dir + "/" + sampleFilename(i);
+            if (!writer.writeFile(output_file, output)) {
+                std::cerr << "Failed to create: " << output_file << std::endl;
+            }
+        }
+        processed_count++;
+    }
+
+    bool closed = archive.close();
+    if (!writer.flush() || !closed) {
+        std::cerr << "Failed to finalize: " << output_archive_path << std::endl;
+        return 1;
+    }
+
+    std::cout << "Injected " << processed_count << " of " << reader.sampleCount() << " samples into "
+              << output_archive_path << std::endl;
+    // A truncated archive is not a finished camera
+    return static_cast<size_t>(processed_count) < reader.sampleCount() ? 1 : 0;
+}
+
 int main(int argc, char** argv) {
     if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <images_directory> <h264_input_directory> <h264_output_directory>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <images_directory> <h264_input_directory> <h264_output_directory> [--per-file] [--trace <file>]" << std::endl;
         std::cerr << "  images_directory: Directory with timestamped JPG files" << std::endl;
-        std::cerr << "  h264_input_directory: Directory with H264 files to process" << std::endl;
+        std::cerr << "  h264_input_directory: Directory with H264 files (or " << SAMPLE_ARCHIVE_FILENAME << ") to process" << std::endl;
         std::cerr << "  h264_output_directory: Output directory for H264 files with real timestamps" << std::endl;
+        std::cerr << "  --per-file: With a packed archive input, also export sample-N.h264 files" << std::endl;
+        std::cerr << "  --trace <file>: Write a Chrome trace (needs a build with -DENABLE_TRACING)" << std::endl;
         return 1;
     }
 
     std::string images_dir = argv[1];
     std::string h264_input_dir = argv[2];
     std::string h264_output_dir = argv[3];
+    bool export_per_file = false;
+    std::string trace_path;
+    for (int i = 4; i < argc; i++) {
+        if (std::string(argv[i]) == "--per-file") {
+            export_per_file = true;
+        } else if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        }
+    }
+    if (!trace_path.empty()) {
+        if (Trace::compiledIn()) {
+            Trace::start(trace_path);
+            TRACE_THREAD_NAME("injector");
+        } else {
+            std::cerr << "  ⚠️  Tracing is not compiled in (build with -DENABLE_TRACING), --trace ignored" << std::endl;
+        }
+    }
 
     // Create output directory
     createDirectories(h264_output_dir);
@@ -126,9 +258,38 @@ int main(int argc, char** argv) {
 
     std::cout << "Found " << frame_timestamps.size() << " timestamped frames" << std::endl;
 
+    // Telemetry sampled at the frame times during extraction (optional)
+    TelemetrySidecar telemetry_sidecar;
+    const TelemetrySidecar* telemetry = nullptr;
+    std::string telemetry_path = images_dir + "/" + TELEMETRY_FILENAME;
+    struct stat telemetry_stat;
+    if (stat(telemetry_path.c_str(), &telemetry_stat) == 0) {
+        if (telemetry_sidecar.read(telemetry_path)) {
+            telemetry = &telemetry_sidecar;
+            std::cout << "Embedding telemetry of " << telemetry_sidecar.tracks().size() << " topics for "
+                      << telemetry_sidecar.frameCount() << " frames" << std::endl;
+        } else {
+            std::cerr << "  ⚠️  Ignoring unreadable telemetry file: " << telemetry_path << std::endl;
+        }
+    }
+
     // Step 2: Process H264 files and inject corresponding timestamps
     std::cout << "Processing H264 files and injecting real timestamps..." << std::endl;
 
+    // All output goes through one batched writer so reading and injecting never wait on disk
+    AsyncWriter writer;
+
+    // A packed archive replaces the per-file samples when present
+    std::string archive_path = h264_input_dir + "/" + SAMPLE_ARCHIVE_FILENAME;
+    struct stat archive_stat;
+    if (stat(archive_path.c_str(), &archive_stat) == 0) {
+        std::cout << "Using packed sample archive: " << archive_path << std::endl;
+        int result = processArchive(archive_path, frame_timestamps, telemetry, h264_output_dir, export_per_file, writer);
+        Trace::write();
+        std::cout << "Output directory: " << h264_output_dir << std::endl;
+        return result;
+    }
+
     int processed_count = 0;
 
     // Process sample-0.h264, sample-1.h264, etc.
@@ -155,6 +316,7 @@ int main(int argc, char** argv) {
                     uint64_t real_timestamp = timestamp_it->second;
 
                     // Read input H264 file
+                    TRACE_MARK(read_start);
                     std::ifstream input(input_file, std::ios::binary | std::ios::ate);
                     if (!input) {
                         std::cerr << "Failed to open: " << input_file << std::endl;
@@ -166,51 +328,21 @@ int main(int argc, char** argv) {
                     std::vector<uint8_t> data(size);
                     input.read(reinterpret_cast<char*>(data.data()), size);
                     input.close();
+                    TRACE_SINCE("read_sample", read_start);
 
                     // Create output file with real timestamp SEI
+                    std::vector<uint8_t> output;
+                    bool keyframe = false;
+                    if (!injectTimestamp(data, real_timestamp, telemetry, static_cast<size_t>(sample_number),
+                                         output, keyframe)) {
+                        std::cerr << "  ⚠️  Malformed NAL length in " << filename << std::endl;
+                    }
+
                     std::string output_file = h264_output_dir + "/" + filename;
-                    std::ofstream output(output_file, std::ios::binary);
-                    if (!output) {
+                    if (!writer.writeFile(output_file, std::move(output))) {
                         std::cerr << "Failed to create: " << output_file << std::endl;
                         continue;
                     }
-
-                    // Create SEI with real timestamp
-                    std::vector<uint8_t> sei_nal = SEIGenerator::createSimpleTimestampSEI(real_timestamp);
-
-                    // Write SEI as length-prefixed (big-endian)
-                    uint32_t sei_length = sei_nal.size();
-                    uint8_t length_bytes[4];
-                    length_bytes[0] = (sei_length >> 24) & 0xFF;
-                    length_bytes[1] = (sei_length >> 16) & 0xFF;
-                    length_bytes[2] = (sei_length >> 8) & 0xFF;
-                    length_bytes[3] = sei_length & 0xFF;
-                    output.write(reinterpret_cast<char*>(length_bytes), 4);
-                    output.write(reinterpret_cast<char*>(sei_nal.data()), sei_nal.size());
-
-                    // Copy original file content (skip any existing SEI)
-                    size_t pos = 0;
-                    while (pos < data.size() - 4) {
-                        uint32_t length = (data[pos] << 24) | (data[pos+1] << 16) | (data[pos+2] << 8) | data[pos+3];
-                        size_t nal_start = pos + 4;
-                        size_t nal_end = nal_start + length;
-
-                        if (nal_end > data.size()) break;
-
-                        if (nal_start < data.size()) {
-                            uint8_t nal_type = data[nal_start] & 0x1F;
-
-                            // Skip existing SEI units, copy everything else
-                            if (nal_type != 6) {
-                                // Copy as length-prefixed
-                                output.write(reinterpret_cast<char*>(&data[pos]), 4); // Length
-                                output.write(reinterpret_cast<char*>(&data[nal_start]), length); // NAL
-                            }
-                        }
-                        pos = nal_end;
-                    }
-
-                    output.close();
                     processed_count++;
                 } else {
                     std::cout << "  ⚠️  No timestamp found for " << filename << " (frame " << sample_number << ")" << std::endl;
@@ -220,6 +352,13 @@ int main(int argc, char** argv) {
     }
     closedir(dir);
 
+    bool flushed = writer.flush();
+    Trace::write();
+    if (!flushed) {
+        std::cerr << "Some H264 files could not be written" << std::endl;
+        return 1;
+    }
+
     std::cout << "Output directory: " << h264_output_dir << std::endl;
 
     return 0;
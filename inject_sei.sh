@@ -26,9 +26,16 @@ fi
 
 echo "Using H264 files from: $H264_BASE_DIR"
 
+# Packed archives (samples.h264pack) are detected by the injector; set PER_FILE_SAMPLES=1
+# to also export sample-N.h264 files for consumers that still expect the per-file layout
+INJECT_FLAGS=""
+if [ "$PER_FILE_SAMPLES" = "1" ]; then
+    INJECT_FLAGS="--per-file"
+fi
+
 # Build the timestamp injection tool (using POSIX dirent for cross-platform compatibility)
 echo "Building timestamp injection tool..."
-g++ -std=c++14 inject_real_timestamps_to_h264.cpp sei_generator.cpp -o inject_real_timestamps_to_h264
+g++ -std=c++14 inject_real_timestamps_to_h264.cpp sei_generator.cpp telemetry.cpp trace.cpp h264_sample.cpp sample_archive.cpp async_writer.cpp -pthread -o inject_real_timestamps_to_h264
 
 if [ $? -ne 0 ]; then
     echo "ERROR: Failed to build inject_real_timestamps_to_h264!"
@@ -62,7 +69,7 @@ for H264_DIR in "$H264_BASE_DIR"/*; do
 
             # Use the tool to inject real timestamps
             echo "  Injecting real timestamps..."
-            ./inject_real_timestamps_to_h264 "$CAMERA_IMAGES_DIR" "$H264_DIR" "$OUTPUT_DIR"
+            ./inject_real_timestamps_to_h264 "$CAMERA_IMAGES_DIR" "$H264_DIR" "$OUTPUT_DIR" $INJECT_FLAGS
 
             if [ $? -eq 0 ]; then
                 echo "  ✓ SUCCESS for $CAMERA_NAME -> $OUTPUT_DIR"
@@ -89,4 +96,14 @@ if [ $PROCESSED_COUNT -eq 0 ]; then
     exit 1
 else
     echo "SUCCESS! H264 files with SEI timestamps are injected !"
+fi
+
+# Validate every camera in one parallel pass (SEI presence, timestamp order, image counts)
+echo ""
+echo "Validating injected streams..."
+g++ -std=c++14 check_sei.cpp sei_generator.cpp h264_sample.cpp sample_archive.cpp async_writer.cpp -pthread -o check_sei
+if [ $? -eq 0 ]; then
+    ./check_sei --summary --images "$IMAGES_DIR" "$CURRENT_DIR/h264_with_sei" || echo "WARNING: Validation found problems (see above)"
+else
+    echo "WARNING: Failed to build check_sei, skipping validation"
 fi
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <functional>
+
+#include <opencv2/opencv.hpp>
+#include <boost/filesystem.hpp>
+
+#include "jpeg_encoder.h"
+
+// JPEG frame encode benchmark.
+//
+// Encodes the same synthetic frames three ways and prints frames/s and output size:
+//   imwrite   cv::imwrite(path, frame) per frame (the former extraction path)
+//   imencode  cv::imencode into a fresh buffer (no file, new encoder per call)
+//   encoder   JpegEncoder kept across frames (TurboJPEG when built with it)
+// imwrite includes the file write, so run it on the disk that holds extracted images
+// (--dir) or on tmpfs to isolate the encoder cost.
+
+namespace fs = boost::filesystem;
+using Clock = std::chrono::steady_clock;
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --size <W>x<H>        Frame size (default: 1920x1080)" << std::endl;
+    std::cerr << "  --frames <n>          Frames per method (default: 200)" << std::endl;
+    std::cerr << "  --quality <q>         JPEG quality (default: 95)" << std::endl;
+    std::cerr << "  --subsampling <s>     420, 422 or 444 (default: 420)" << std::endl;
+    std::cerr << "  --dir <dir>           Scratch directory for imwrite (default: jpeg_bench_work)" << std::endl;
+}
+
+// Moving gradient with per-pixel noise, so the encoder does representative work
+std::vector<cv::Mat> makeFrames(int width, int height, size_t count) {
+    std::vector<cv::Mat> frames;
+    cv::RNG rng(12345);
+    for (size_t i = 0; i < count; i++) {
+        cv::Mat frame(height, width, CV_8UC3);
+        for (int y = 0; y < height; y++) {
+            uint8_t* row = frame.ptr<uint8_t>(y);
+            for (int x = 0; x < width; x++) {
+                row[x * 3 + 0] = static_cast<uint8_t>((x + i * 4) & 0xFF);
+                row[x * 3 + 1] = static_cast<uint8_t>((y + i * 2) & 0xFF);
+                row[x * 3 + 2] = static_cast<uint8_t>(((x ^ y) + rng.uniform(0, 16)) & 0xFF);
+            }
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// Runs encode on every frame; returns false if any frame failed
+bool measure(const std::string& name, const std::vector<cv::Mat>& frames,
+             const std::function<bool(size_t, size_t&)>& encode) {
+    size_t total_bytes = 0;
+    auto start = Clock::now();
+    for (size_t i = 0; i < frames.size(); i++) {
+        size_t bytes = 0;
+        if (!encode(i, bytes)) {
+            std::cerr << "❌ " << name << " failed at frame " << i << std::endl;
+            return false;
+        }
+        total_bytes += bytes;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << std::left << std::setw(10) << name << std::right
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << frames.size() / seconds << " frames/s"
+              << std::setw(12) << seconds * 1000.0 / frames.size() << " ms/frame"
+              << std::setw(12) << total_bytes / 1024.0 / frames.size() << " KiB/frame" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int width = 1920;
+    int height = 1080;
+    size_t frame_count = 200;
+    JpegOptions options;
+    std::string work_dir = "jpeg_bench_work";
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--size" && has_value) {
+                std::string size = argv[++i];
+                size_t x = size.find('x');
+                if (x == std::string::npos) {
+                    throw std::invalid_argument(size);
+                }
+                width = std::stoi(size.substr(0, x));
+                height = std::stoi(size.substr(x + 1));
+            } else if (arg == "--frames" && has_value) {
+                frame_count = static_cast<size_t>(std::stoul(argv[++i]));
+            } else if (arg == "--quality" && has_value) {
+                options.quality = std::stoi(argv[++i]);
+            } else if (arg == "--subsampling" && has_value) {
+                options.subsampling = argv[++i];
+            } else if (arg == "--dir" && has_value) {
+                work_dir = argv[++i];
+            } else {
+                printUsage(argv[0]);
+                return 2;
+            }
+        }
+    } catch (const std::exception& e) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (width < 1 || height < 1 || frame_count == 0 || options.quality < 1 || options.quality > 100 ||
+        !JpegEncoder::validSubsampling(options.subsampling)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    // Frames are distinct but few, so the working set stays comparable to extraction
+    const size_t distinct = 8;
+    std::vector<cv::Mat> pool = makeFrames(width, height, distinct);
+    std::vector<cv::Mat> frames;
+    for (size_t i = 0; i < frame_count; i++) {
+        frames.push_back(pool[i % distinct]);
+    }
+
+    fs::create_directories(work_dir);
+    std::cout << "📊 " << frame_count << " frames of " << width << "x" << height
+              << ", quality " << options.quality << ", subsampling " << options.subsampling
+              << ", encoder backend " << JpegEncoder::backend() << std::endl;
+
+    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, options.quality};
+    bool ok = measure("imwrite", frames, [&](size_t i, size_t& bytes) {
+        std::string path = work_dir + "/frame_" + std::to_string(i % distinct) + ".jpg";
+        if (!cv::imwrite(path, frames[i], params)) {
+            return false;
+        }
+        bytes = static_cast<size_t>(fs::file_size(path));
+        return true;
+    });
+
+    ok = ok && measure("imencode", frames, [&](size_t i, size_t& bytes) {
+        std::vector<uint8_t> encoded;
+        if (!cv::imencode(".jpg", frames[i], encoded, params)) {
+            return false;
+        }
+        bytes = encoded.size();
+        return true;
+    });
+
+    JpegEncoder encoder(options);
+    ok = ok && measure("encoder", frames, [&](size_t i, size_t& bytes) {
+        std::vector<uint8_t> encoded;
+        if (!encoder.encode(frames[i], encoded)) {
+            return false;
+        }
+        bytes = encoded.size();
+        return true;
+    });
+
+    fs::remove_all(work_dir);
+    return ok ? 0 : 1;
+}
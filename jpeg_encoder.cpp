@@ -0,0 +1,113 @@
+#include "jpeg_encoder.h"
+#include <memory>
+
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+namespace {
+
+#ifdef HAVE_TURBOJPEG
+int turbo_subsampling(const std::string& subsampling) {
+    if (subsampling == "444") {
+        return TJSAMP_444;
+    }
+    if (subsampling == "422") {
+        return TJSAMP_422;
+    }
+    return TJSAMP_420;
+}
+#endif
+
+} // namespace
+
+JpegEncoder::JpegEncoder(const JpegOptions& options) : options_(options) {
+#ifdef HAVE_TURBOJPEG
+    compressor_ = tjInitCompress();
+#endif
+}
+
+JpegEncoder::~JpegEncoder() {
+#ifdef HAVE_TURBOJPEG
+    if (buffer_) {
+        tjFree(buffer_);
+    }
+    if (compressor_) {
+        tjDestroy(static_cast<tjhandle>(compressor_));
+    }
+#endif
+}
+
+JpegEncoder& JpegEncoder::forThread(const JpegOptions& options) {
+    thread_local std::unique_ptr<JpegEncoder> encoder;
+    if (!encoder || !(encoder->options() == options)) {
+        encoder.reset(new JpegEncoder(options));
+    }
+    return *encoder;
+}
+
+const char* JpegEncoder::backend() {
+#ifdef HAVE_TURBOJPEG
+    return "turbojpeg";
+#else
+    return "opencv";
+#endif
+}
+
+bool JpegEncoder::validSubsampling(const std::string& subsampling) {
+    return subsampling == "420" || subsampling == "422" || subsampling == "444";
+}
+
+bool JpegEncoder::encodeOpenCv(const cv::Mat& image, std::vector<uint8_t>& output) {
+    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, options_.quality};
+    return cv::imencode(".jpg", image, output, params);
+}
+
+bool JpegEncoder::encode(const cv::Mat& image, std::vector<uint8_t>& output) {
+#ifdef HAVE_TURBOJPEG
+    if (!compressor_ || image.depth() != CV_8U || image.empty()) {
+        return encodeOpenCv(image, output);
+    }
+
+    int pixel_format;
+    int subsampling = turbo_subsampling(options_.subsampling);
+    switch (image.channels()) {
+        case 1:
+            pixel_format = TJPF_GRAY;
+            subsampling = TJSAMP_GRAY;
+            break;
+        case 3:
+            pixel_format = TJPF_BGR;
+            break;
+        case 4:
+            pixel_format = TJPF_BGRX;
+            break;
+        default:
+            return encodeOpenCv(image, output);
+    }
+
+    // Worst-case size for this frame; the buffer only grows
+    unsigned long needed = tjBufSize(image.cols, image.rows, subsampling);
+    if (needed > buffer_size_) {
+        if (buffer_) {
+            tjFree(buffer_);
+        }
+        buffer_ = tjAlloc(static_cast<int>(needed));
+        buffer_size_ = buffer_ ? needed : 0;
+        if (!buffer_) {
+            return encodeOpenCv(image, output);
+        }
+    }
+
+    unsigned long size = buffer_size_;
+    if (tjCompress2(static_cast<tjhandle>(compressor_), image.data, image.cols, static_cast<int>(image.step),
+                    image.rows, pixel_format, &buffer_, &size, subsampling, options_.quality,
+                    TJFLAG_NOREALLOC) != 0) {
+        return encodeOpenCv(image, output);
+    }
+    output.assign(buffer_, buffer_ + size);
+    return true;
+#else
+    return encodeOpenCv(image, output);
+#endif
+}
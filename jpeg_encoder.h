@@ -0,0 +1,72 @@
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+// Persistent JPEG encoder for extracted frames.
+//
+// With HAVE_TURBOJPEG the encoder keeps one TurboJPEG compressor and one output buffer
+// sized for the largest frame seen, so encoding a frame allocates nothing but the
+// result handed to the writer. Without it, cv::imencode is used with the same quality
+// (chroma subsampling is then left to OpenCV's default, 4:2:0).
+//
+// An encoder is not thread-safe; forThread() returns the calling thread's instance.
+
+struct JpegOptions {
+    int quality = 95;                  // 1-100 (95 = cv::imwrite default)
+    std::string subsampling = "420";   // "420", "422" or "444"
+
+    bool operator==(const JpegOptions& other) const {
+        return quality == other.quality && subsampling == other.subsampling;
+    }
+};
+
+class JpegEncoder {
+public:
+    explicit JpegEncoder(const JpegOptions& options = JpegOptions());
+    ~JpegEncoder();
+
+    JpegEncoder(const JpegEncoder&) = delete;
+    JpegEncoder& operator=(const JpegEncoder&) = delete;
+
+    /**
+     * Encode an 8-bit gray, BGR or BGRA frame
+     * @param image Frame to encode
+     * @param output Receives the JPEG file contents
+     * @return true on success
+     */
+    bool encode(const cv::Mat& image, std::vector<uint8_t>& output);
+
+    const JpegOptions& options() const { return options_; }
+
+    /**
+     * Encoder of the calling thread, recreated when the options change
+     * @param options Encoding options
+     */
+    static JpegEncoder& forThread(const JpegOptions& options);
+
+    /**
+     * @return "turbojpeg" or "opencv"
+     */
+    static const char* backend();
+
+    /**
+     * Check a subsampling name
+     * @return true for "420", "422" and "444"
+     */
+    static bool validSubsampling(const std::string& subsampling);
+
+private:
+    bool encodeOpenCv(const cv::Mat& image, std::vector<uint8_t>& output);
+
+    JpegOptions options_;
+    void* compressor_ = nullptr;           // tjhandle
+    unsigned char* buffer_ = nullptr;      // Reused TurboJPEG output buffer
+    unsigned long buffer_size_ = 0;
+};
+
+#endif // JPEG_ENCODER_H
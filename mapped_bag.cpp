@@ -0,0 +1,304 @@
+#include "mapped_bag.h"
+#include "bag_format.h"
+#include <algorithm>
+#include <set>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+// One record of the file: u32 header_len, header, u32 data_len, data
+struct Record {
+    const uint8_t* header = nullptr;
+    uint32_t header_size = 0;
+    const uint8_t* data = nullptr;
+    uint32_t data_size = 0;
+    size_t end = 0;              // Offset after the record
+};
+
+bool read_record(const uint8_t* base, size_t size, size_t pos, Record& record) {
+    if (pos > size || size - pos < 4) {
+        return false;
+    }
+    record.header_size = BagFormat::readU32(base + pos);
+    pos += 4;
+    if (record.header_size > size - pos || size - pos - record.header_size < 4) {
+        return false;
+    }
+    record.header = base + pos;
+    pos += record.header_size;
+    record.data_size = BagFormat::readU32(base + pos);
+    pos += 4;
+    if (record.data_size > size - pos) {
+        return false;
+    }
+    record.data = base + pos;
+    record.end = pos + record.data_size;
+    return true;
+}
+
+bool record_fields(const Record& record, std::map<std::string, std::string>& fields) {
+    return BagFormat::parseRecordHeader(record.header, record.header_size, fields);
+}
+
+uint8_t record_op(const std::map<std::string, std::string>& fields) {
+    auto op = fields.find("op");
+    return op != fields.end() && op->second.size() == 1 ? static_cast<uint8_t>(op->second[0]) : 0;
+}
+
+bool u32_field(const std::map<std::string, std::string>& fields, const char* name, uint32_t& value) {
+    auto field = fields.find(name);
+    if (field == fields.end() || field->second.size() != 4) {
+        return false;
+    }
+    value = BagFormat::readU32(reinterpret_cast<const uint8_t*>(field->second.data()));
+    return true;
+}
+
+// Sequential reader over serialized message fields
+class FieldCursor {
+public:
+    FieldCursor(const uint8_t* data, size_t size) : data_(data), left_(size) {}
+
+    bool skip(size_t bytes) {
+        if (bytes > left_) {
+            return false;
+        }
+        data_ += bytes;
+        left_ -= bytes;
+        return true;
+    }
+
+    bool u8(uint8_t& value) {
+        if (left_ < 1) {
+            return false;
+        }
+        value = *data_;
+        return skip(1);
+    }
+
+    bool u32(uint32_t& value) {
+        if (left_ < 4) {
+            return false;
+        }
+        value = BagFormat::readU32(data_);
+        return skip(4);
+    }
+
+    // Length-prefixed string or uint8[]
+    bool bytes(const uint8_t*& value, uint32_t& size) {
+        if (!u32(size) || size > left_) {
+            return false;
+        }
+        value = data_;
+        return skip(size);
+    }
+
+private:
+    const uint8_t* data_;
+    size_t left_;
+};
+
+} // namespace
+
+bool ImageView::encodingIs(const char* name) const {
+    return encoding && std::strlen(name) == encoding_size && std::memcmp(encoding, name, encoding_size) == 0;
+}
+
+bool MappedMessage::imageView(ImageView& view) const {
+    // std_msgs/Header header, uint32 height, uint32 width, string encoding,
+    // uint8 is_bigendian, uint32 step, uint8[] data
+    FieldCursor cursor(data, data_size);
+    uint32_t seq;
+    const uint8_t* frame_id;
+    uint32_t frame_id_size;
+    const uint8_t* encoding;
+    uint8_t is_bigendian;
+    if (!cursor.u32(seq) || !cursor.skip(8) || !cursor.bytes(frame_id, frame_id_size) ||
+        !cursor.u32(view.height) || !cursor.u32(view.width) || !cursor.bytes(encoding, view.encoding_size) ||
+        !cursor.u8(is_bigendian) || !cursor.u32(view.step) || !cursor.bytes(view.data, view.data_size)) {
+        return false;
+    }
+    view.encoding = reinterpret_cast<const char*>(encoding);
+    view.is_bigendian = is_bigendian != 0;
+    return static_cast<uint64_t>(view.step) * view.height <= view.data_size;
+}
+
+MappedBag::~MappedBag() {
+    close();
+}
+
+void MappedBag::close() {
+    if (data_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    connections_.clear();
+    entries_.clear();
+}
+
+bool MappedBag::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(mapping);
+    size_ = static_cast<size_t>(st.st_size);
+
+    // Frames are consumed roughly in file order
+    madvise(mapping, size_, MADV_SEQUENTIAL);
+
+    if (!readIndex()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MappedBag::readIndex() {
+    if (size_ < BAG_MAGIC_SIZE || std::memcmp(data_, BAG_MAGIC, BAG_MAGIC_SIZE) != 0) {
+        return false;
+    }
+
+    Record header_record;
+    std::map<std::string, std::string> fields;
+    if (!read_record(data_, size_, BAG_MAGIC_SIZE, header_record) || !record_fields(header_record, fields) ||
+        record_op(fields) != BAG_OP_BAG_HEADER) {
+        return false;
+    }
+    auto index_pos_field = fields.find("index_pos");
+    if (index_pos_field == fields.end() || index_pos_field->second.size() != 8) {
+        return false;
+    }
+    uint64_t index_pos = BagFormat::readU64(reinterpret_cast<const uint8_t*>(index_pos_field->second.data()));
+    uint32_t chunk_count = 0;
+    if (index_pos <= BAG_MAGIC_SIZE || index_pos >= size_ || !u32_field(fields, "chunk_count", chunk_count)) {
+        return false;
+    }
+
+    // Connection records, then one chunk info record per chunk
+    uint32_t chunks_read = 0;
+    size_t pos = static_cast<size_t>(index_pos);
+    while (pos < size_) {
+        Record record;
+        fields.clear();
+        if (!read_record(data_, size_, pos, record) || !record_fields(record, fields)) {
+            return false;
+        }
+        pos = record.end;
+
+        uint8_t op = record_op(fields);
+        if (op == BAG_OP_CONNECTION) {
+            MappedConnection connection;
+            auto topic = fields.find("topic");
+            std::map<std::string, std::string> connection_header;
+            if (!u32_field(fields, "conn", connection.id) || topic == fields.end() ||
+                !BagFormat::parseRecordHeader(record.data, record.data_size, connection_header)) {
+                return false;
+            }
+            connection.topic = topic->second;
+            connection.datatype = connection_header["type"];
+            connection.md5sum = connection_header["md5sum"];
+            connections_[connection.id] = connection;
+        } else if (op == BAG_OP_CHUNK_INFO) {
+            auto chunk_pos = fields.find("chunk_pos");
+            uint32_t connection_count = 0;
+            if (chunk_pos == fields.end() || chunk_pos->second.size() != 8 ||
+                !u32_field(fields, "count", connection_count) ||
+                !readChunk(BagFormat::readU64(reinterpret_cast<const uint8_t*>(chunk_pos->second.data())),
+                           connection_count)) {
+                return false;
+            }
+            chunks_read++;
+        }
+    }
+    return chunks_read == chunk_count;
+}
+
+// A chunk record is followed by one index data record per connection in the chunk,
+// listing (time, offset into the chunk data) of each message
+bool MappedBag::readChunk(uint64_t chunk_pos, uint32_t connection_count) {
+    Record chunk;
+    std::map<std::string, std::string> fields;
+    if (!read_record(data_, size_, static_cast<size_t>(chunk_pos), chunk) || !record_fields(chunk, fields) ||
+        record_op(fields) != BAG_OP_CHUNK) {
+        return false;
+    }
+    auto compression = fields.find("compression");
+    if (compression == fields.end() || compression->second != "none") {
+        return false;
+    }
+    size_t chunk_data_pos = static_cast<size_t>(chunk.data - data_);
+
+    size_t pos = chunk.end;
+    for (uint32_t i = 0; i < connection_count; i++) {
+        Record index;
+        fields.clear();
+        uint32_t version = 0;
+        uint32_t conn = 0;
+        uint32_t count = 0;
+        if (!read_record(data_, size_, pos, index) || !record_fields(index, fields) ||
+            record_op(fields) != BAG_OP_INDEX_DATA || !u32_field(fields, "ver", version) || version != 1 ||
+            !u32_field(fields, "conn", conn) || !u32_field(fields, "count", count) ||
+            index.data_size < static_cast<uint64_t>(count) * 12) {
+            return false;
+        }
+        pos = index.end;
+
+        for (uint32_t j = 0; j < count; j++) {
+            const uint8_t* entry = index.data + j * 12;
+            uint32_t offset = BagFormat::readU32(entry + 8);
+            if (offset >= chunk.data_size) {
+                return false;
+            }
+            uint64_t time_ns = static_cast<uint64_t>(BagFormat::readU32(entry)) * 1000000000ULL +
+                               BagFormat::readU32(entry + 4);
+            entries_.push_back(IndexEntry{conn, time_ns, chunk_data_pos + offset});
+        }
+    }
+    return true;
+}
+
+std::vector<MappedMessage> MappedBag::messages(const std::vector<std::string>& topics) const {
+    std::set<std::string> wanted(topics.begin(), topics.end());
+    std::vector<IndexEntry> selected;
+    for (const IndexEntry& entry : entries_) {
+        auto connection = connections_.find(entry.conn);
+        if (connection != connections_.end() && wanted.count(connection->second.topic)) {
+            selected.push_back(entry);
+        }
+    }
+    std::stable_sort(selected.begin(), selected.end(),
+                     [](const IndexEntry& a, const IndexEntry& b) { return a.time_ns < b.time_ns; });
+
+    std::vector<MappedMessage> messages;
+    messages.reserve(selected.size());
+    for (const IndexEntry& entry : selected) {
+        Record record;
+        if (!read_record(data_, size_, static_cast<size_t>(entry.record_pos), record)) {
+            continue;
+        }
+        MappedMessage message;
+        message.connection = &connections_.at(entry.conn);
+        message.time.fromNSec(entry.time_ns);
+        message.data = record.data;
+        message.data_size = record.data_size;
+        messages.push_back(message);
+    }
+    return messages;
+}
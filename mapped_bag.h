@@ -0,0 +1,123 @@
+#ifndef MAPPED_BAG_H
+#define MAPPED_BAG_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+
+#include <ros/time.h>
+#include <ros/serialization.h>
+#include <ros/message_traits.h>
+#include <boost/make_shared.hpp>
+
+// Memory-mapped reader for uncompressed ROS bag v2.0 files (see bag_format.h).
+//
+// The connection and chunk info records of the index section and the index data
+// records after every chunk locate each message record, so messages are found without
+// parsing their record headers and their data is used in place. sensor_msgs/Image
+// fields can be read straight from the mapping through MappedMessage::imageView().
+// Message order equals a rosbag::View over the same topics: by time, ties in file order.
+
+struct MappedConnection {
+    uint32_t id = 0;
+    std::string topic;
+    std::string datatype;
+    std::string md5sum;
+};
+
+// sensor_msgs/Image fields pointing into the mapped file
+struct ImageView {
+    uint32_t height = 0;
+    uint32_t width = 0;
+    const char* encoding = nullptr;
+    uint32_t encoding_size = 0;
+    bool is_bigendian = false;
+    uint32_t step = 0;
+    const uint8_t* data = nullptr;
+    uint32_t data_size = 0;
+
+    bool encodingIs(const char* name) const;
+};
+
+// A message record inside the mapping; valid while its MappedBag is open
+struct MappedMessage {
+    const MappedConnection* connection = nullptr;
+    ros::Time time;
+    const uint8_t* data = nullptr;
+    uint32_t data_size = 0;
+
+    const std::string& getTopic() const { return connection->topic; }
+    const std::string& getDataType() const { return connection->datatype; }
+    const std::string& getMD5Sum() const { return connection->md5sum; }
+    const ros::Time& getTime() const { return time; }
+    uint32_t size() const { return data_size; }
+
+    /**
+     * Deserialize the message (copies, like rosbag::MessageInstance::instantiate)
+     * @return Message, or null if T does not match the recorded type
+     */
+    template <class T>
+    boost::shared_ptr<T> instantiate() const {
+        const std::string expected = ros::message_traits::MD5Sum<T>::value();
+        if (expected != "*" && getMD5Sum() != "*" && expected != getMD5Sum()) {
+            return boost::shared_ptr<T>();
+        }
+        boost::shared_ptr<T> message = boost::make_shared<T>();
+        ros::serialization::IStream stream(const_cast<uint8_t*>(data), data_size);
+        ros::serialization::deserialize(stream, *message);
+        return message;
+    }
+
+    /**
+     * Read a serialized sensor_msgs/Image in place
+     * @param view Receives the image fields
+     * @return false if the message is not a well-formed sensor_msgs/Image
+     */
+    bool imageView(ImageView& view) const;
+};
+
+class MappedBag {
+public:
+    MappedBag() = default;
+    ~MappedBag();
+
+    MappedBag(const MappedBag&) = delete;
+    MappedBag& operator=(const MappedBag&) = delete;
+
+    /**
+     * Map a bag and read its index
+     * @param path Bag file path
+     * @return false if the file is not a complete v2.0 bag or has compressed chunks
+     */
+    bool open(const std::string& path);
+
+    void close();
+
+    /**
+     * Messages of the given topics in time order
+     * @param topics Topic names
+     * @return Messages pointing into the mapping
+     */
+    std::vector<MappedMessage> messages(const std::vector<std::string>& topics) const;
+
+    const std::map<uint32_t, MappedConnection>& connections() const { return connections_; }
+
+private:
+    struct IndexEntry {
+        uint32_t conn;
+        uint64_t time_ns;
+        uint64_t record_pos;    // Offset of the message record in the file
+    };
+
+    bool readIndex();
+    bool readChunk(uint64_t chunk_pos, uint32_t connection_count);
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::map<uint32_t, MappedConnection> connections_;
+    std::vector<IndexEntry> entries_;   // File order
+};
+
+#endif // MAPPED_BAG_H
@@ -0,0 +1,73 @@
+#include "memory_budget.h"
+#include <iomanip>
+#include <cctype>
+
+MemoryBudget::MemoryBudget(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+void MemoryBudget::acquire(const std::string& stage, size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (max_bytes_ > 0) {
+        released_.wait(lock, [this, bytes] {
+            return in_use_ + bytes <= max_bytes_ || in_use_ == 0;
+        });
+    }
+
+    in_use_ += bytes;
+    if (in_use_ > peak_) {
+        peak_ = in_use_;
+    }
+
+    StageUsage& usage = stages_[stage];
+    usage.current += bytes;
+    if (usage.current > usage.peak) {
+        usage.peak = usage.current;
+    }
+}
+
+void MemoryBudget::release(const std::string& stage, size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_use_ -= bytes;
+        stages_[stage].current -= bytes;
+    }
+    released_.notify_all();
+}
+
+void MemoryBudget::report(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto mib = [](size_t bytes) { return bytes / (1024.0 * 1024.0); };
+
+    out << "Memory usage (peak):" << std::endl;
+    for (const auto& stage : stages_) {
+        out << "  " << stage.first << ": " << std::fixed << std::setprecision(1)
+            << mib(stage.second.peak) << " MiB" << std::endl;
+    }
+    out << "  Total: " << std::fixed << std::setprecision(1) << mib(peak_) << " MiB";
+    if (max_bytes_ > 0) {
+        out << " of " << mib(max_bytes_) << " MiB budget";
+    }
+    out << std::endl;
+}
+
+size_t MemoryBudget::parseSize(const std::string& text) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return 0;
+    }
+
+    size_t pos = 0;
+    unsigned long long value = std::stoull(text, &pos);
+    std::string suffix = text.substr(pos);
+
+    if (suffix.empty() || suffix == "B") {
+        return value;
+    }
+
+    switch (std::toupper(static_cast<unsigned char>(suffix[0]))) {
+        case 'K': return value << 10;
+        case 'M': return value << 20;
+        case 'G': return value << 30;
+        default: return 0;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <ostream>
+#include <utility>
+
+// Process-wide memory budget shared by the in-process pipeline stages (bag reading,
+// decoding and the JPEG queue of extraction). Child processes such as ffmpeg and the
+// sample splitter are outside of it; their peak is only reported.
+//
+// Stages acquire bytes before holding a buffer and release them once the buffer is
+// gone. acquire() blocks while the budget is exhausted, which propagates backpressure
+// to whoever produces the data (ultimately the bag reader). Peak usage is tracked
+// per stage so devices can be sized from a real run.
+class MemoryBudget {
+public:
+    /**
+     * @param max_bytes Budget in bytes, 0 for unlimited (usage is still tracked)
+     */
+    explicit MemoryBudget(size_t max_bytes = 0);
+
+    /**
+     * Reserve memory for a stage, blocking until enough budget is free.
+     * A request larger than the whole budget is granted once nothing else is held,
+     * so an oversized frame slows the pipeline down instead of deadlocking it.
+     * @param stage Stage name used for reporting
+     * @param bytes Bytes to reserve
+     */
+    void acquire(const std::string& stage, size_t bytes);
+
+    /**
+     * Return memory previously reserved by acquire()
+     * @param stage Stage name passed to acquire()
+     * @param bytes Bytes to return
+     */
+    void release(const std::string& stage, size_t bytes);
+
+    size_t limit() const { return max_bytes_; }
+
+    /**
+     * Print the peak usage of every stage and of the whole budget
+     * @param out Output stream
+     */
+    void report(std::ostream& out) const;
+
+    /**
+     * Parse a size such as "512M", "8G" or "1048576"
+     * @param text Size text with an optional K/M/G suffix (powers of 1024)
+     * @return Size in bytes, 0 if the text is not a valid size
+     */
+    static size_t parseSize(const std::string& text);
+
+private:
+    struct StageUsage {
+        size_t current = 0;
+        size_t peak = 0;
+    };
+
+    size_t max_bytes_;
+    size_t in_use_ = 0;
+    size_t peak_ = 0;
+    std::map<std::string, StageUsage> stages_;
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+};
+
+// RAII reservation: releases its bytes when it goes out of scope
+class MemoryReservation {
+public:
+    MemoryReservation() = default;
+    MemoryReservation(MemoryBudget& budget, const std::string& stage, size_t bytes)
+        : budget_(&budget), stage_(stage), bytes_(bytes) {
+        budget_->acquire(stage_, bytes_);
+    }
+    ~MemoryReservation() { reset(); }
+
+    MemoryReservation(MemoryReservation&& other) noexcept
+        : budget_(other.budget_), stage_(std::move(other.stage_)), bytes_(other.bytes_) {
+        other.budget_ = nullptr;
+    }
+    MemoryReservation& operator=(MemoryReservation&& other) noexcept {
+        if (this != &other) {
+            reset();
+            budget_ = other.budget_;
+            stage_ = std::move(other.stage_);
+            bytes_ = other.bytes_;
+            other.budget_ = nullptr;
+        }
+        return *this;
+    }
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+    void reset() {
+        if (budget_) {
+            budget_->release(stage_, bytes_);
+            budget_ = nullptr;
+        }
+    }
+
+private:
+    MemoryBudget* budget_ = nullptr;
+    std::string stage_;
+    size_t bytes_ = 0;
+};
+
+#endif // MEMORY_BUDGET_H
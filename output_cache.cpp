@@ -0,0 +1,127 @@
+#include "output_cache.h"
+#include "bag_format.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+constexpr const char* METADATA_FILENAME = "metadata.txt";
+
+// Hard-link a file, falling back to a copy across file systems
+void link_or_copy_file(const fs::path& from, const fs::path& to) {
+    boost::system::error_code error;
+    fs::create_hard_link(from, to, error);
+    if (error) {
+        fs::copy_file(from, to, fs::copy_option::overwrite_if_exists);
+    }
+}
+
+// Link or copy a file or a whole directory tree
+void link_or_copy(const fs::path& from, const fs::path& to) {
+    if (!fs::is_directory(from)) {
+        link_or_copy_file(from, to);
+        return;
+    }
+
+    fs::create_directories(to);
+    for (fs::recursive_directory_iterator it(from), end; it != end; ++it) {
+        fs::path relative = fs::relative(it->path(), from);
+        if (fs::is_directory(it->path())) {
+            fs::create_directories(to / relative);
+        } else {
+            link_or_copy_file(it->path(), to / relative);
+        }
+    }
+}
+
+} // namespace
+
+OutputCache::OutputCache(const std::string& root) : root_(root) {}
+
+std::string OutputCache::topicKey(uint64_t bag_hash, const std::string& topic_name, const std::string& parameters) {
+    uint64_t hash = BagFormat::fnv1a(&bag_hash, sizeof(bag_hash));
+    hash = BagFormat::fnv1a(topic_name.data(), topic_name.size(), hash);
+    hash = BagFormat::fnv1a("\n", 1, hash);
+    hash = BagFormat::fnv1a(parameters.data(), parameters.size(), hash);
+
+    std::ostringstream key;
+    key << std::hex << std::setfill('0') << std::setw(16) << hash;
+    return key.str();
+}
+
+bool OutputCache::contains(const std::string& key) const {
+    return fs::exists(fs::path(root_) / key / METADATA_FILENAME);
+}
+
+bool OutputCache::restore(const std::string& key, const std::map<std::string, std::string>& destinations,
+                          std::string& metadata) const {
+    fs::path entry = fs::path(root_) / key;
+    try {
+        std::ifstream metadata_file((entry / METADATA_FILENAME).string());
+        if (!metadata_file) {
+            return false;
+        }
+        std::ostringstream contents;
+        contents << metadata_file.rdbuf();
+        metadata = contents.str();
+
+        for (const auto& artifact : destinations) {
+            fs::path source = entry / artifact.first;
+            if (!fs::exists(source)) {
+                return false;
+            }
+            fs::remove_all(artifact.second);
+            if (fs::path(artifact.second).has_parent_path()) {
+                fs::create_directories(fs::path(artifact.second).parent_path());
+            }
+            link_or_copy(source, artifact.second);
+        }
+        return true;
+    } catch (const std::exception& e) {
+        return false;
+    }
+}
+
+bool OutputCache::store(const std::string& key, const std::map<std::string, std::string>& sources,
+                        const std::string& metadata) const {
+    fs::path entry = fs::path(root_) / key;
+    fs::path staging = fs::path(root_) / (key + ".tmp" + std::to_string(getpid()));
+    try {
+        if (contains(key)) {
+            return true;
+        }
+
+        fs::remove_all(staging);
+        fs::create_directories(staging);
+        for (const auto& artifact : sources) {
+            link_or_copy(artifact.second, staging / artifact.first);
+        }
+
+        // The metadata file marks the entry as complete
+        std::ofstream metadata_file((staging / METADATA_FILENAME).string());
+        metadata_file << metadata;
+        metadata_file.close();
+        if (!metadata_file) {
+            fs::remove_all(staging);
+            return false;
+        }
+
+        // Another process may have stored the same key meanwhile; either copy is valid
+        boost::system::error_code error;
+        fs::rename(staging, entry, error);
+        if (error) {
+            fs::remove_all(staging);
+            return contains(key);
+        }
+        return true;
+    } catch (const std::exception& e) {
+        boost::system::error_code error;
+        fs::remove_all(staging, error);
+        return false;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef OUTPUT_CACHE_H
+#define OUTPUT_CACHE_H
+
+#include <string>
+#include <map>
+#include <cstdint>
+
+// Content-addressed cache of per-topic processing outputs.
+//
+// An entry lives in <root>/<key>/ where the key hashes the bag index and every parameter
+// that changes the outputs of the topic. Each artifact (a file or a directory tree) is
+// stored under a name chosen by the caller, next to a free-form metadata file. Entries are
+// built in a temporary directory and renamed into place, so a lookup never sees a partial
+// entry. Files are hard-linked when the cache and output share a file system and copied
+// otherwise.
+
+class OutputCache {
+public:
+    /**
+     * @param root Cache directory (created on first store)
+     */
+    explicit OutputCache(const std::string& root);
+
+    /**
+     * Build the key of one topic
+     * @param bag_hash Hash of the bag index (BagFormat::hashIndex)
+     * @param topic_name Topic the outputs belong to
+     * @param parameters Description of every option that affects the outputs
+     * @return 16-digit hex key
+     */
+    static std::string topicKey(uint64_t bag_hash, const std::string& topic_name, const std::string& parameters);
+
+    /**
+     * Check whether a complete entry exists
+     * @param key Entry key
+     * @return true if the entry can be restored
+     */
+    bool contains(const std::string& key) const;
+
+    /**
+     * Link or copy the artifacts of an entry to their destinations
+     * @param key Entry key
+     * @param destinations Artifact name -> destination path (replaced if it exists)
+     * @param metadata Output metadata stored with the entry
+     * @return false if the entry or one of the artifacts is missing
+     */
+    bool restore(const std::string& key, const std::map<std::string, std::string>& destinations,
+                 std::string& metadata) const;
+
+    /**
+     * Store artifacts under a key (an existing entry is kept)
+     * @param key Entry key
+     * @param sources Artifact name -> source path
+     * @param metadata Metadata stored with the entry
+     * @return true on success
+     */
+    bool store(const std::string& key, const std::map<std::string, std::string>& sources,
+               const std::string& metadata) const;
+
+private:
+    std::string root_;
+};
+
+#endif // OUTPUT_CACHE_H
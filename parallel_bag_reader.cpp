@@ -0,0 +1,168 @@
+#include "parallel_bag_reader.h"
+#include "bag_format.h"
+#include "trace.h"
+#include <algorithm>
+#include <stdexcept>
+
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+BagMessage BagMessage::fromInstance(const rosbag::MessageInstance& instance) {
+    BagMessage message;
+    message.topic = instance.getTopic();
+    message.datatype = instance.getDataType();
+    message.md5sum = instance.getMD5Sum();
+    message.time = instance.getTime();
+    message.data.resize(instance.size());
+    ros::serialization::OStream stream(message.data.data(), static_cast<uint32_t>(message.data.size()));
+    instance.write(stream);
+    return message;
+}
+
+ParallelBagReader::ParallelBagReader(const std::string& bag_path, const std::vector<std::string>& topics,
+                                     const ParallelReadOptions& options)
+    : bag_path_(bag_path), topics_(topics), options_(options) {}
+
+ParallelBagReader::~ParallelBagReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    space_available_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+std::string ParallelBagReader::chunkCompression(const std::string& bag_path) {
+    std::vector<BagChunkInfo> chunks;
+    std::string compression;
+    if (!BagFormat::readChunkInfos(bag_path, chunks, compression)) {
+        return "";
+    }
+    return compression;
+}
+
+bool ParallelBagReader::start() {
+    std::vector<BagChunkInfo> chunks;
+    std::string compression;
+    if (!BagFormat::readChunkInfos(bag_path_, chunks, compression)) {
+        return false;
+    }
+
+    // Cut at the start of the first chunk after every window_bytes of chunk data.
+    // Chunks may overlap in time; a chunk spanning a cut is read by both windows.
+    std::sort(chunks.begin(), chunks.end(),
+              [](const BagChunkInfo& a, const BagChunkInfo& b) { return a.start_ns < b.start_ns; });
+    std::vector<uint64_t> cuts;
+    uint64_t window_bytes = 0;
+    for (const auto& chunk : chunks) {
+        uint64_t last_cut = cuts.empty() ? ros::TIME_MIN.toNSec() : cuts.back();
+        if (window_bytes >= options_.window_bytes && chunk.start_ns > last_cut) {
+            cuts.push_back(chunk.start_ns);
+            window_bytes = 0;
+        }
+        window_bytes += chunk.size;
+    }
+
+    // Time bounds of a View are inclusive, so a window ends 1 ns before the next cut
+    ros::Time start = ros::TIME_MIN;
+    for (uint64_t cut : cuts) {
+        Window window;
+        window.start = start;
+        window.end.fromNSec(cut - 1);
+        windows_.push_back(std::move(window));
+        start.fromNSec(cut);
+    }
+    Window last;
+    last.start = start;
+    last.end = ros::TIME_MAX;
+    windows_.push_back(std::move(last));
+
+    size_t thread_count = std::max<size_t>(1, std::min(options_.threads, windows_.size()));
+    lookahead_ = options_.lookahead > 0 ? options_.lookahead : thread_count * 2;
+    for (size_t i = 0; i < thread_count; i++) {
+        threads_.emplace_back(&ParallelBagReader::run, this);
+    }
+    return true;
+}
+
+void ParallelBagReader::run() {
+    TRACE_THREAD_NAME("chunk_reader");
+    rosbag::Bag bag;
+    try {
+        bag.open(bag_path_, rosbag::bagmode::Read);
+    } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = e.what();
+        window_ready_.notify_all();
+        return;
+    }
+
+    while (true) {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            space_available_.wait(lock, [this] {
+                return stopping_ || next_window_ >= windows_.size() || next_window_ == current_window_ ||
+                       (next_window_ < current_window_ + lookahead_ && buffered_bytes_ < options_.max_buffered_bytes);
+            });
+            if (stopping_ || next_window_ >= windows_.size()) {
+                return;
+            }
+            index = next_window_++;
+        }
+
+        Window& window = windows_[index];
+        std::vector<BagMessage> messages;
+        uint64_t bytes = 0;
+        try {
+            TRACE_SPAN("read_window");
+            rosbag::View view(bag, rosbag::TopicQuery(topics_), window.start, window.end);
+            for (const rosbag::MessageInstance& instance : view) {
+                if (stopping_) {
+                    return;
+                }
+                messages.push_back(BagMessage::fromInstance(instance));
+                bytes += messages.back().data.size();
+            }
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = e.what();
+            window_ready_.notify_all();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            window.messages = std::move(messages);
+            window.bytes = bytes;
+            window.ready = true;
+            buffered_bytes_ += bytes;
+        }
+        window_ready_.notify_all();
+    }
+}
+
+bool ParallelBagReader::next(BagMessage& message) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (current_window_ < windows_.size()) {
+        Window& window = windows_[current_window_];
+        window_ready_.wait(lock, [&window, this] { return window.ready || !error_.empty(); });
+        if (!window.ready) {
+            throw std::runtime_error("Bag reader failed: " + error_);
+        }
+        if (current_message_ < window.messages.size()) {
+            message = std::move(window.messages[current_message_++]);
+            return true;
+        }
+
+        // Window consumed: free it and let the readers move on
+        buffered_bytes_ -= window.bytes;
+        std::vector<BagMessage>().swap(window.messages);
+        current_window_++;
+        current_message_ = 0;
+        space_available_.notify_all();
+    }
+    return false;
+}
@@ -0,0 +1,150 @@
+#ifndef PARALLEL_BAG_READER_H
+#define PARALLEL_BAG_READER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include <ros/time.h>
+#include <ros/serialization.h>
+#include <ros/message_traits.h>
+#include <boost/make_shared.hpp>
+
+namespace rosbag {
+class MessageInstance;
+}
+
+// A message copied out of its chunk, so it can outlive the rosbag::Bag that read it.
+// Offers the subset of rosbag::MessageInstance used by the extraction loop.
+struct BagMessage {
+    std::string topic;
+    std::string datatype;
+    std::string md5sum;
+    ros::Time time;
+    std::vector<uint8_t> data;   // Serialized message
+
+    static BagMessage fromInstance(const rosbag::MessageInstance& instance);
+
+    const std::string& getTopic() const { return topic; }
+    const std::string& getDataType() const { return datatype; }
+    const std::string& getMD5Sum() const { return md5sum; }
+    const ros::Time& getTime() const { return time; }
+    uint32_t size() const { return static_cast<uint32_t>(data.size()); }
+
+    /**
+     * Deserialize the message
+     * @return Message, or null if T does not match the recorded type
+     */
+    template <class T>
+    boost::shared_ptr<T> instantiate() const {
+        const std::string expected = ros::message_traits::MD5Sum<T>::value();
+        if (expected != "*" && md5sum != "*" && expected != md5sum) {
+            return boost::shared_ptr<T>();
+        }
+        boost::shared_ptr<T> message = boost::make_shared<T>();
+        ros::serialization::IStream stream(const_cast<uint8_t*>(data.data()), size());
+        ros::serialization::deserialize(stream, *message);
+        return message;
+    }
+
+    template <class Stream>
+    void write(Stream& stream) const {
+        std::memcpy(stream.advance(size()), data.data(), data.size());
+    }
+};
+
+// Reads a compressed bag on several threads and delivers its messages in time order.
+//
+// rosbag::View decompresses chunks one at a time on the thread that iterates it. This
+// reader cuts the bag into time windows along chunk boundaries (from the chunk index,
+// see BagFormat::readChunkInfos); reader threads, each with its own rosbag::Bag handle,
+// copy the messages of upcoming windows out of their chunks while the consumer works
+// through the current one. Windows are disjoint in time and each is read with a time
+// bounded View, so concatenating them gives the order of a single View over the bag.
+//
+// Readers start a window only while fewer than lookahead windows and max_buffered_bytes
+// of message data are waiting for the consumer; the window the consumer waits for is
+// always read.
+
+struct ParallelReadOptions {
+    size_t threads = 4;
+    uint64_t window_bytes = 8ULL << 20;           // Chunk data per window (compressed)
+    size_t lookahead = 0;                         // Windows read ahead (0 = 2 per thread)
+    uint64_t max_buffered_bytes = 256ULL << 20;   // Message data read ahead
+};
+
+class ParallelBagReader {
+public:
+    /**
+     * @param bag_path Bag file
+     * @param topics Topics to read
+     * @param options Thread count and read-ahead limits
+     */
+    ParallelBagReader(const std::string& bag_path, const std::vector<std::string>& topics,
+                      const ParallelReadOptions& options = ParallelReadOptions());
+
+    // Stops the readers (after their current window)
+    ~ParallelBagReader();
+
+    ParallelBagReader(const ParallelBagReader&) = delete;
+    ParallelBagReader& operator=(const ParallelBagReader&) = delete;
+
+    /**
+     * Plan the windows and start the reader threads
+     * @return false if the chunk index cannot be read (use a rosbag::View instead)
+     */
+    bool start();
+
+    /**
+     * Next message in time order, waiting for its window
+     * @param message Receives the message
+     * @return false after the last message
+     * @throws std::runtime_error if a reader failed
+     */
+    bool next(BagMessage& message);
+
+    size_t windowCount() const { return windows_.size(); }
+    size_t threadCount() const { return threads_.size(); }
+
+    /**
+     * Compression of the bag's chunks
+     * @param bag_path Bag file
+     * @return "none", "bz2", "lz4", or empty if the chunk index cannot be read
+     */
+    static std::string chunkCompression(const std::string& bag_path);
+
+private:
+    struct Window {
+        ros::Time start;
+        ros::Time end;                   // Inclusive
+        std::vector<BagMessage> messages;
+        uint64_t bytes = 0;
+        bool ready = false;
+    };
+
+    void run();
+
+    std::string bag_path_;
+    std::vector<std::string> topics_;
+    ParallelReadOptions options_;
+    std::vector<Window> windows_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable window_ready_;
+    std::condition_variable space_available_;
+    size_t next_window_ = 0;       // Next window to hand to a reader
+    size_t current_window_ = 0;    // Window the consumer reads from
+    size_t current_message_ = 0;
+    size_t lookahead_ = 0;
+    uint64_t buffered_bytes_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::string error_;
+};
+
+#endif // PARALLEL_BAG_READER_H
@@ -0,0 +1,403 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <rosbag/bag.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/NavSatFix.h>
+
+#include <boost/filesystem.hpp>
+
+#include "bag_processor.h"
+#include "sei_generator.h"
+#include "h264_sample.h"
+
+// Performance regression gate.
+//
+// Writes a fixed synthetic bag (two 640x360 cameras at 30 fps and a 10 Hz GPS topic),
+// runs it through BagProcessor::process() and a batch of SEI injections, and compares
+// throughput and peak memory with a checked-in baseline:
+//   # comment
+//   <metric> <baseline> <tolerance> <higher|lower>
+// A "higher" metric fails below baseline * (1 - tolerance), a "lower" one above
+// baseline * (1 + tolerance). Values are measurements, not hand-set floors: a value of 0
+// means "not measured yet" and fails the gate. --update-baseline rewrites the values,
+// keeping tolerances, and records the command, host and date of the measurement.
+// Stage times come from the progress events, which mark the start and end of each stage.
+
+namespace fs = boost::filesystem;
+using Clock = std::chrono::steady_clock;
+
+constexpr int FRAME_WIDTH = 640;
+constexpr int FRAME_HEIGHT = 360;
+constexpr int FRAME_RATE = 30;
+constexpr int DURATION_S = 4;
+constexpr int GPS_RATE = 10;
+constexpr size_t SEI_SAMPLES = 20000;
+constexpr uint32_t BAG_START_S = 1700000000;
+
+const std::vector<std::string> CAMERA_TOPICS = {"/camera_front/image_raw", "/camera_rear/image_raw"};
+const std::string GPS_TOPIC = "/gps/fix";
+
+struct BaselineEntry {
+    double value = 0;
+    double tolerance = 0;
+    bool higher_is_better = true;
+};
+
+struct StageTimes {
+    std::map<ProcessingStage, Clock::time_point> first;
+    std::map<ProcessingStage, Clock::time_point> last;
+
+    double seconds(ProcessingStage stage) const {
+        auto begin = first.find(stage);
+        auto end = last.find(stage);
+        if (begin == first.end() || end == last.end()) {
+            return 0;
+        }
+        return std::chrono::duration<double>(end->second - begin->second).count();
+    }
+};
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " --baseline <file> [options]" << std::endl;
+    std::cerr << "  --baseline <file>     Baseline metrics (see perf_baseline.txt)" << std::endl;
+    std::cerr << "  --work-dir <dir>      Scratch directory (default: perf_gate_work)" << std::endl;
+    std::cerr << "  --splitter <script>   Sample splitter (default: generate_h264.py)" << std::endl;
+    std::cerr << "  --runs <n>            Best of n pipeline runs (default: 1)" << std::endl;
+    std::cerr << "  --update-baseline     Store the measured values as the new baseline" << std::endl;
+}
+
+// Deterministic frame content: a moving gradient with per-pixel noise, so JPEG and
+// x264 do representative work
+void fillFrame(sensor_msgs::Image& image, int frame, uint32_t& seed) {
+    image.width = FRAME_WIDTH;
+    image.height = FRAME_HEIGHT;
+    image.encoding = "bgr8";
+    image.step = FRAME_WIDTH * 3;
+    image.data.resize(static_cast<size_t>(image.step) * FRAME_HEIGHT);
+
+    for (int y = 0; y < FRAME_HEIGHT; y++) {
+        uint8_t* row = &image.data[static_cast<size_t>(y) * image.step];
+        for (int x = 0; x < FRAME_WIDTH; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            uint8_t noise = static_cast<uint8_t>(seed >> 28);
+            row[x * 3] = static_cast<uint8_t>(x + frame * 4 + noise);
+            row[x * 3 + 1] = static_cast<uint8_t>(y + frame * 2 + noise);
+            row[x * 3 + 2] = static_cast<uint8_t>((x ^ y) + noise);
+        }
+    }
+}
+
+bool writeSyntheticBag(const std::string& path) {
+    try {
+        rosbag::Bag bag;
+        bag.open(path, rosbag::bagmode::Write);
+
+        uint32_t seed = 12345;
+        sensor_msgs::Image image;
+        uint64_t frame_step_ns = 1000000000ull / FRAME_RATE;
+        for (int frame = 0; frame < FRAME_RATE * DURATION_S; frame++) {
+            for (size_t camera = 0; camera < CAMERA_TOPICS.size(); camera++) {
+                ros::Time stamp;
+                stamp.fromNSec(BAG_START_S * 1000000000ull + frame * frame_step_ns + camera * 1000000ull);
+                image.header.stamp = stamp;
+                image.header.seq = frame;
+                fillFrame(image, frame, seed);
+                bag.write(CAMERA_TOPICS[camera], stamp, image);
+            }
+        }
+
+        sensor_msgs::NavSatFix fix;
+        uint64_t gps_step_ns = 1000000000ull / GPS_RATE;
+        for (int i = 0; i < GPS_RATE * DURATION_S; i++) {
+            ros::Time stamp;
+            stamp.fromNSec(BAG_START_S * 1000000000ull + i * gps_step_ns);
+            fix.header.stamp = stamp;
+            fix.latitude = 48.0 + i * 1e-5;
+            fix.longitude = 11.0 + i * 2e-5;
+            fix.altitude = 500.0;
+            bag.write(GPS_TOPIC, stamp, fix);
+        }
+
+        bag.close();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to write synthetic bag: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// One full process() run; returns false if the pipeline failed
+bool runPipeline(const std::string& bag_path, const std::string& work_dir, const std::string& splitter,
+                 std::map<std::string, double>& metrics) {
+    std::string output_dir = work_dir + "/output";
+    fs::remove_all(output_dir);
+    fs::remove_all(work_dir + "/h264");
+
+    ProcessorOptions options;
+    options.h264_root = work_dir + "/h264";
+    options.generate_h264_script = splitter;
+    options.telemetry_topics = {GPS_TOPIC};
+
+    StageTimes times;
+    options.on_progress = [&times](const ProgressEvent& event) {
+        Clock::time_point now = Clock::now();
+        times.first.emplace(event.stage, now);
+        times.last[event.stage] = now;
+    };
+
+    BagProcessor processor(bag_path, output_dir, "perf_gate", options);
+    if (!processor.process()) {
+        return false;
+    }
+
+    double frames = static_cast<double>(FRAME_RATE * DURATION_S * CAMERA_TOPICS.size());
+    double messages = frames + GPS_RATE * DURATION_S;
+    double analyze_s = times.seconds(ProcessingStage::Analyze);
+    double extract_s = times.seconds(ProcessingStage::Extract);
+    double encode_s = times.seconds(ProcessingStage::Encode);
+    if (analyze_s <= 0 || extract_s <= 0 || encode_s <= 0) {
+        std::cerr << "Missing stage timings" << std::endl;
+        return false;
+    }
+
+    metrics["analyze_msgs_per_s"] = std::max(metrics["analyze_msgs_per_s"], messages / analyze_s);
+    metrics["extract_frames_per_s"] = std::max(metrics["extract_frames_per_s"], frames / extract_s);
+    metrics["encode_frames_per_s"] = std::max(metrics["encode_frames_per_s"], frames / encode_s);
+    return true;
+}
+
+// Timestamp and telemetry SEI injection into synthetic samples, as done by the injector
+double measureSeiInjection() {
+    std::vector<uint8_t> sample;
+    std::vector<uint8_t> slice(12000);
+    uint32_t seed = 777;
+    for (auto& byte : slice) {
+        seed = seed * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(seed >> 24);
+    }
+    slice[0] = 0x65;  // IDR slice header
+    H264Sample::appendLengthPrefixed(sample, slice.data(), slice.size());
+
+    std::vector<uint8_t> telemetry_payload(64, 0x42);
+    std::vector<NalUnitRef> nals;
+    std::vector<uint8_t> output;
+    size_t checksum = 0;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < SEI_SAMPLES; i++) {
+        nals.clear();
+        H264Sample::parseLengthPrefixed(sample.data(), sample.size(), nals);
+        output.clear();
+        std::vector<uint8_t> sei = SEIGenerator::createSimpleTimestampSEI(BAG_START_S * 1000000ull + i * 33333);
+        H264Sample::appendLengthPrefixed(output, sei.data(), sei.size());
+        std::vector<uint8_t> telemetry = SEIGenerator::createTelemetrySEI(telemetry_payload);
+        H264Sample::appendLengthPrefixed(output, telemetry.data(), telemetry.size());
+        for (const auto& nal : nals) {
+            H264Sample::appendLengthPrefixed(output, &sample[nal.offset], nal.length);
+        }
+        checksum += output.size();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (checksum == 0 || seconds <= 0) {
+        return 0;
+    }
+    return SEI_SAMPLES / seconds;
+}
+
+double peakMemoryMb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;  // ru_maxrss is in KiB on Linux
+}
+
+bool readBaseline(const std::string& path, std::map<std::string, BaselineEntry>& baseline,
+                  std::vector<std::string>& order) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name, direction;
+        BaselineEntry entry;
+        if (!(fields >> name >> entry.value >> entry.tolerance >> direction)) {
+            std::cerr << "Malformed baseline line: " << line << std::endl;
+            return false;
+        }
+        entry.higher_is_better = direction != "lower";
+        baseline[name] = entry;
+        order.push_back(name);
+    }
+    return true;
+}
+
+// Command, host and UTC date of a measurement, for the baseline header
+std::string measurementSource(int argc, char** argv) {
+    std::ostringstream source;
+    for (int i = 0; i < argc; i++) {
+        source << (i > 0 ? " " : "") << argv[i];
+    }
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M UTC", std::gmtime(&now));
+    source << " (host " << host << ", " << date << ")";
+    return source.str();
+}
+
+bool writeBaseline(const std::string& path, const std::map<std::string, BaselineEntry>& baseline,
+                   const std::vector<std::string>& order, const std::string& source) {
+    std::ofstream file(path, std::ios::trunc);
+    file << "# perf_gate baseline: <metric> <value> <tolerance> <higher|lower>" << std::endl;
+    file << "# Refresh on the reference machine with: cmake --build . --target perf_baseline" << std::endl;
+    file << "# Measured with: " << source << std::endl;
+    for (const auto& name : order) {
+        const BaselineEntry& entry = baseline.at(name);
+        file << name << " " << std::fixed << std::setprecision(1) << entry.value << " "
+             << std::setprecision(2) << entry.tolerance << " " << (entry.higher_is_better ? "higher" : "lower")
+             << std::endl;
+    }
+    return static_cast<bool>(file);
+}
+
+// Print baseline vs measured for every metric; returns the number of regressions
+int compareWithBaseline(const std::map<std::string, BaselineEntry>& baseline, const std::vector<std::string>& order,
+                        const std::map<std::string, double>& metrics) {
+    int regressions = 0;
+    std::cout << std::left << std::setw(24) << "metric" << std::right << std::setw(12) << "baseline"
+              << std::setw(12) << "measured" << std::setw(10) << "change" << std::setw(14) << "limit"
+              << "  result" << std::endl;
+
+    for (const auto& name : order) {
+        const BaselineEntry& entry = baseline.at(name);
+        auto measured_it = metrics.find(name);
+        if (measured_it == metrics.end()) {
+            std::cout << std::left << std::setw(24) << name << "  not measured" << std::endl;
+            regressions++;
+            continue;
+        }
+
+        double measured = measured_it->second;
+        if (entry.value <= 0) {
+            std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(24) << measured << "  no measured baseline" << std::endl;
+            regressions++;
+            continue;
+        }
+        double limit = entry.higher_is_better ? entry.value * (1.0 - entry.tolerance)
+                                              : entry.value * (1.0 + entry.tolerance);
+        bool ok = entry.higher_is_better ? measured >= limit : measured <= limit;
+        double change = entry.value > 0 ? (measured - entry.value) / entry.value * 100.0 : 0.0;
+
+        std::ostringstream limit_text;
+        limit_text << (entry.higher_is_better ? ">= " : "<= ") << std::fixed << std::setprecision(1) << limit;
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << entry.value << std::setw(12) << measured
+                  << std::setw(9) << std::showpos << change << std::noshowpos << "%"
+                  << std::setw(14) << limit_text.str() << "  " << (ok ? "ok" : "REGRESSION") << std::endl;
+        if (!ok) {
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    std::string baseline_path;
+    std::string work_dir = "perf_gate_work";
+    std::string splitter = "generate_h264.py";
+    int runs = 1;
+    bool update_baseline = false;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--baseline" && has_value) {
+                baseline_path = argv[++i];
+            } else if (arg == "--work-dir" && has_value) {
+                work_dir = argv[++i];
+            } else if (arg == "--splitter" && has_value) {
+                splitter = argv[++i];
+            } else if (arg == "--runs" && has_value) {
+                runs = std::max(1, std::stoi(argv[++i]));
+            } else if (arg == "--update-baseline") {
+                update_baseline = true;
+            } else {
+                printUsage(argv[0]);
+                return 2;
+            }
+        }
+    } catch (const std::exception& e) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::map<std::string, BaselineEntry> baseline;
+    std::vector<std::string> order;
+    if (baseline_path.empty() || !readBaseline(baseline_path, baseline, order)) {
+        std::cerr << "❌ Cannot read baseline: " << baseline_path << std::endl;
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    fs::create_directories(work_dir);
+    std::string bag_path = work_dir + "/synthetic.bag";
+    std::cout << "📦 Writing synthetic bag: " << bag_path << std::endl;
+    if (!writeSyntheticBag(bag_path)) {
+        return 1;
+    }
+
+    std::map<std::string, double> metrics;
+    for (int run = 0; run < runs; run++) {
+        std::cout << "🏃 Pipeline run " << (run + 1) << "/" << runs << std::endl;
+        if (!runPipeline(bag_path, work_dir, splitter, metrics)) {
+            std::cerr << "❌ Pipeline failed on the synthetic bag" << std::endl;
+            return 1;
+        }
+    }
+    metrics["sei_samples_per_s"] = measureSeiInjection();
+    metrics["peak_rss_mb"] = peakMemoryMb();
+
+    std::cout << std::endl << "=== PERFORMANCE GATE ===" << std::endl;
+    int regressions = compareWithBaseline(baseline, order, metrics);
+
+    if (update_baseline) {
+        for (const auto& name : order) {
+            auto measured = metrics.find(name);
+            if (measured != metrics.end()) {
+                baseline[name].value = measured->second;
+            }
+        }
+        if (!writeBaseline(baseline_path, baseline, order, measurementSource(argc, argv))) {
+            std::cerr << "❌ Failed to update baseline: " << baseline_path << std::endl;
+            return 1;
+        }
+        std::cout << "📝 Baseline updated: " << baseline_path << std::endl;
+        return 0;
+    }
+
+    if (regressions > 0) {
+        std::cout << "❌ " << regressions << " metric(s) outside tolerance" << std::endl;
+        return 1;
+    }
+    std::cout << "✅ All metrics within tolerance" << std::endl;
+    return 0;
+}
@@ -1,30 +1,26 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <map>
-#include <fstream>
-#include <memory>
 #include <sstream>
 #include <iomanip>
-#include <sys/stat.h>
-#include <sys/types.h>
 #include <chrono>
 #include <ctime>
+#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
 
 // ROS includes
 #include <ros/ros.h>
-#include <rosbag/bag.h>
-#include <rosbag/view.h>
-#include <sensor_msgs/Image.h>
-#include <cv_bridge/cv_bridge.h>
-
-// OpenCV includes
-#include <opencv2/opencv.hpp>
-#include <opencv2/imgcodecs.hpp>
 
 // Boost for filesystem (C++14 compatible)
 #include <boost/filesystem.hpp>
 
+#include "bag_processor.h"
+#include "trace.h"
+#include "task_scheduler.h"
+#include "jpeg_encoder.h"
+
 // Helper function to generate timestamp string
 std::string generate_timestamp() {
     auto now = std::chrono::system_clock::now();
@@ -35,472 +31,352 @@ std::string generate_timestamp() {
     return ss.str();
 }
 
-class BagProcessor {
-private:
-    std::string bag_path_;
-    std::string output_dir_;
-    std::string timestamp_;
-    
-    struct TopicInfo {
-        std::string topic_name;
-        std::string msg_type;
-        int msg_count;
-    };
-    
-    std::vector<TopicInfo> image_topics_;
-    std::map<std::string, std::string> topic_directories_;
-    std::map<std::string, int> extraction_counts_;
-    
-    bool convertImagesToVideo(const std::string& images_dir, const std::string& output_video_path) {
-        std::cout << "🎬 Converting images to H264 video..." << std::endl;
-        std::cout << "  Input: " << images_dir << std::endl;
-        std::cout << "  Output: " << output_video_path << std::endl;
-
-        // First, create a raw H264 stream without container
-        std::string h264_raw_path = output_video_path + ".h264";
-
-        // ffmpeg command to convert images to raw H264 stream
-        std::ostringstream cmd;
-        cmd << "ffmpeg -y "  // -y to overwrite output file
-            << "-framerate 30 "  // Input framerate
-            << "-pattern_type glob "  // Use glob pattern
-            << "-i '" << images_dir << "/*.jpg' "  // Input pattern
-            << "-vf 'scale=trunc(iw/2)*2:trunc(ih/2)*2' "  // Ensure even dimensions
-            << "-c:v libx264 "  // H264 codec
-            << "-pix_fmt yuv420p "  // Pixel format
-            << "-r 30 "  // Output framerate
-            << "-bsf:v h264_mp4toannexb "  // Convert to Annex B format
-            << "-f h264 "  // Raw H264 output
-            << "'" << h264_raw_path << "'";
-
-        std::cout << "Running: " << cmd.str() << std::endl;
-
-        int result = system(cmd.str().c_str());
-
-        if (result == 0) {
-            std::cout << "✅ H264 stream creation successful: " << h264_raw_path << std::endl;
-
-            // Now inject timestamps into the H264 stream
-            std::string h264_timestamped_path = output_video_path + ".timestamped.h264";
-            // Skip old timestamp injection - we'll inject real timestamps later
-            std::cout << "⏭️  Skipping intermediate timestamp injection (will inject real timestamps later)" << std::endl;
+// Parse "<topic>@<seconds>" into a frame query
+FrameQuery parse_frame_query(const std::string& text) {
+    size_t at = text.rfind('@');
+    if (at == std::string::npos || at == 0) {
+        throw std::invalid_argument(text);
+    }
+    FrameQuery query;
+    query.topic = text.substr(0, at);
+    query.time = ros::Time(std::stod(text.substr(at + 1)));
+    return query;
+}
 
-            // Just copy the raw H264 to timestamped path for now
-            std::ostringstream copy_cmd;
-            copy_cmd << "cp '" << h264_raw_path << "' '" << h264_timestamped_path << "'";
-            int inject_result = system(copy_cmd.str().c_str());
+// Write the frames found by --frame-at to <output_dir>/frames/<topic>_<requested_us>.jpg
+int write_frames(BagProcessor& processor, const std::vector<FrameQuery>& queries, const std::string& output_dir) {
+    std::vector<FrameResult> results;
+    if (!processor.framesAt(queries, results)) {
+        return 1;
+    }
 
-            if (inject_result == 0) {
-                std::cout << "✅ H264 file prepared for timestamp injection: " << h264_timestamped_path << std::endl;
+    std::string frames_dir = output_dir + "/frames";
+    boost::filesystem::create_directories(frames_dir);
+    JpegEncoder encoder;
+    size_t written = 0;
+    for (const FrameResult& result : results) {
+        if (result.image.empty()) {
+            std::cout << "❌ " << result.topic << " @ " << std::fixed << std::setprecision(3)
+                      << result.requested.toSec() << ": no frame" << std::endl;
+            continue;
+        }
+        std::string topic_name = result.topic;
+        std::replace(topic_name.begin(), topic_name.end(), '/', '_');
+        std::ostringstream path;
+        path << frames_dir << "/" << topic_name.substr(topic_name[0] == '_' ? 1 : 0) << "_"
+             << result.requested.toNSec() / 1000 << ".jpg";
+
+        std::vector<uint8_t> encoded;
+        std::ofstream file(path.str(), std::ios::binary);
+        if (!encoder.encode(result.image, encoded) ||
+            !file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size())) {
+            std::cerr << "Failed to write " << path.str() << std::endl;
+            continue;
+        }
+        double offset_ms = (static_cast<double>(result.time.toNSec()) - static_cast<double>(result.requested.toNSec())) / 1e6;
+        std::cout << "🖼️  " << result.topic << " @ " << std::fixed << std::setprecision(3) << result.requested.toSec()
+                  << " -> " << result.time.toSec() << " (" << std::showpos << offset_ms << std::noshowpos
+                  << " ms): " << path.str() << std::endl;
+        written++;
+    }
+    std::cout << "✅ " << written << " of " << results.size() << " frames written to " << frames_dir << std::endl;
+    return written == results.size() ? 0 : 1;
+}
 
-                // Package the timestamped H264 stream into MP4 container
-                std::ostringstream package_cmd;
-                package_cmd << "ffmpeg -y "
-                           << "-f h264 "
-                           << "-i '" << h264_timestamped_path << "' "
-                           << "-c:v copy "
-                           << "'" << output_video_path << "'";
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --bag <file>              Bag to process (default: first .bag in /workspace/jetson)" << std::endl;
+    std::cerr << "  --output-dir <dir>        Output directory (default: output/extracted_images_<timestamp>)" << std::endl;
+    std::cerr << "  --packed                  Write samples.h264pack instead of sample-N.h264 files" << std::endl;
+    std::cerr << "  --per-file-samples        With --packed, also export sample-N.h264 files" << std::endl;
+    std::cerr << "  --single-pass             Discover image topics from the bag index and extract in one read" << std::endl;
+    std::cerr << "  --cache-dir <dir>         Reuse per-topic outputs of earlier runs on the same bag" << std::endl;
+    std::cerr << "  --frame-at <topic>@<sec>  Only decode the frame nearest to this time (repeatable)" << std::endl;
+    std::cerr << "  --frame-list <file>       Frame queries, one \"<topic> <sec>\" per line" << std::endl;
+    std::cerr << "  --preview <interval_ms>   Only write low-res all-intra previews, one frame per interval" << std::endl;
+    std::cerr << "  --preview-width <px>      Preview frame width (default: 320)" << std::endl;
+    std::cerr << "  --stream <topic>          Read the bag sequentially (--bag, --bag-fd or stdin) and write the" << std::endl;
+    std::cerr << "                            topic to stdout as H.264 Annex-B with SEI timestamps" << std::endl;
+    std::cerr << "  --bag-fd <n>              Read the bag for --stream from this file descriptor" << std::endl;
+    std::cerr << "  --sprites <interval_ms>   Build timeline sprite sheets with one tile per interval" << std::endl;
+    std::cerr << "  --sprite-width <px>       Sprite tile width (default: 160)" << std::endl;
+    std::cerr << "  --sprite-grid <C>x<R>     Tiles per sprite sheet (default: 10x10)" << std::endl;
+    std::cerr << "  --sprite-format <fmt>     Sprite sheet format: jpg or webp (default: jpg)" << std::endl;
+    std::cerr << "  --max-memory <size>       Memory budget for frames in flight during extraction, e.g. 2G" << std::endl;
+    std::cerr << "                            (default: unlimited; ffmpeg, the splitter and merges are not limited)" << std::endl;
+    std::cerr << "  --threads <n>             Worker threads for JPEG and encode tasks (default: one per core)" << std::endl;
+    std::cerr << "  --reserve-cores <n>       Leave the first n CPUs to other services" << std::endl;
+    std::cerr << "  --pin-threads             Bind each worker thread to one CPU" << std::endl;
+    std::cerr << "  --read-threads <n>        Threads decompressing compressed bags (default: auto, 1 = off)" << std::endl;
+    std::cerr << "  --mmap                    Read uncompressed bags through a memory mapping" << std::endl;
+    std::cerr << "  --jpeg-quality <q>        JPEG quality of extracted frames, 1-100 (default: 95)" << std::endl;
+    std::cerr << "  --jpeg-subsampling <s>    Chroma subsampling of extracted frames: 420, 422 or 444 (default: 420)" << std::endl;
+    std::cerr << "  --segment-frames <n>      Encode in independent closed-GOP segments of n frames" << std::endl;
+    std::cerr << "  --gop <n>                 GOP length for segmented encoding (default: 30)" << std::endl;
+    std::cerr << "  --x264-threads <n>        x264 threads per segment, same on every shard (default: 1)" << std::endl;
+    std::cerr << "  --shard <i>/<N>           Process time slice i of N (GOP-aligned, implies segments)" << std::endl;
+    std::cerr << "  --sync-master <topic>     Sync index rows at each frame of this topic (default: most frames)" << std::endl;
+    std::cerr << "  --sync-tick-ms <ms>       Sync index rows at a fixed tick instead of master frames" << std::endl;
+    std::cerr << "  --telemetry <topic>       Embed this non-image topic in every frame's SEI (repeatable)" << std::endl;
+    std::cerr << "  --trace <file>            Write a Chrome trace of all stages (build with -DBAGPROC_TRACING=ON)" << std::endl;
+    std::cerr << "  --h264-dir <dir>          Root of the streaming sample output (default: h264)" << std::endl;
+    std::cerr << "  --splitter <script>       Sample splitter script (default: /workspace/generate_h264.py)" << std::endl;
+    std::cerr << "  --merge <shard_dir>...    Merge shard outputs into --output-dir" << std::endl;
+}
 
-                int package_result = system(package_cmd.str().c_str());
+int main(int argc, char** argv) {
+    // Strip ROS remapping arguments (libbagproc itself does not need ros::init)
+    ros::init(argc, argv, "bag_processor");
 
-                if (package_result == 0) {
-                    std::cout << "✅ Final MP4 packaging successful: " << output_video_path << std::endl;
+    std::string bag_file;
+    std::string timestamp = generate_timestamp();
+    std::string output_dir = "output/extracted_images_" + timestamp;
 
-                    // Generate H264 files for streaming
-                    std::string h264_output_dir = "h264/" + timestamp_ + "/" + boost::filesystem::path(images_dir).filename().string() + "_30fps";
-                    if (generateH264FilesForStreaming(h264_timestamped_path, h264_output_dir)) {
-                        std::cout << "✅ H264 streaming files generated: " << h264_output_dir << std::endl;
-                    } else {
-                        std::cout << "⚠️  H264 streaming file generation failed" << std::endl;
-                    }
+    // Parse options (ros::init has already removed ROS remapping arguments)
+    ProcessorOptions options;
+    bool per_file_export = false;
+    bool output_dir_given = false;
+    std::vector<std::string> merge_dirs;
+    bool merge_mode = false;
+    bool preview_mode = false;
+    std::vector<FrameQuery> frame_queries;
+    std::string trace_path;
+    std::string stream_topic;
+    int bag_fd = -1;
 
-                    // Clean up intermediate files
-                    std::remove(h264_raw_path.c_str());
-                    std::remove(h264_timestamped_path.c_str());
-                } else {
-                    std::cout << "⚠️  MP4 packaging failed, keeping raw H264 files" << std::endl;
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--packed") {
+                options.packed_samples = true;
+            } else if (arg == "--cache-dir" && has_value) {
+                options.cache_dir = argv[++i];
+            } else if (arg == "--frame-at" && has_value) {
+                frame_queries.push_back(parse_frame_query(argv[++i]));
+            } else if (arg == "--frame-list" && has_value) {
+                std::ifstream list(argv[++i]);
+                if (!list) {
+                    throw std::invalid_argument(argv[i]);
                 }
-            } else {
-                std::cout << "⚠️  Timestamp injection failed, creating standard MP4 without timestamps" << std::endl;
-
-                // Fall back to creating MP4 without timestamps
-                std::ostringstream fallback_cmd;
-                fallback_cmd << "ffmpeg -y "
-                            << "-f h264 "
-                            << "-i '" << h264_raw_path << "' "
-                            << "-c:v copy "
-                            << "'" << output_video_path << "'";
-                int fallback_result = system(fallback_cmd.str().c_str());
-
-                if (fallback_result == 0) {
-                    // Still generate H264 files for streaming (without timestamps)
-                    std::string h264_output_dir = "h264/" + timestamp_ + "/" + boost::filesystem::path(images_dir).filename().string() + "_30fps";
-                    if (generateH264FilesForStreaming(h264_raw_path, h264_output_dir)) {
-                        std::cout << "✅ H264 streaming files generated (without timestamps): " << h264_output_dir << std::endl;
-                    }
+                std::string topic;
+                std::string seconds;
+                while (list >> topic >> seconds) {
+                    frame_queries.push_back(parse_frame_query(topic + "@" + seconds));
                 }
-
-                std::remove(h264_raw_path.c_str());
+            } else if (arg == "--preview" && has_value) {
+                preview_mode = true;
+                options.preview_interval_us = static_cast<uint64_t>(std::stod(argv[++i]) * 1000.0);
+                if (options.preview_interval_us == 0) {
+                    throw std::invalid_argument(argv[i]);
+                }
+            } else if (arg == "--preview-width" && has_value) {
+                options.preview_width = std::stoi(argv[++i]);
+            } else if (arg == "--sprites" && has_value) {
+                options.sprite_interval_us = static_cast<uint64_t>(std::stod(argv[++i]) * 1000.0);
+            } else if (arg == "--sprite-width" && has_value) {
+                options.sprite_tile_width = std::stoi(argv[++i]);
+            } else if (arg == "--sprite-grid" && has_value) {
+                std::string grid = argv[++i];
+                size_t x = grid.find('x');
+                if (x == std::string::npos) {
+                    throw std::invalid_argument(grid);
+                }
+                options.sprite_columns = std::stoi(grid.substr(0, x));
+                options.sprite_rows = std::stoi(grid.substr(x + 1));
+            } else if (arg == "--sprite-format" && has_value) {
+                options.sprite_format = argv[++i];
+                if (options.sprite_format != "jpg" && options.sprite_format != "webp") {
+                    throw std::invalid_argument(options.sprite_format);
+                }
+            } else if (arg == "--single-pass") {
+                options.single_pass = true;
+            } else if (arg == "--per-file-samples") {
+                per_file_export = true;
+            } else if (arg == "--bag" && has_value) {
+                bag_file = argv[++i];
+            } else if (arg == "--bag-fd" && has_value) {
+                bag_fd = std::stoi(argv[++i]);
+                if (bag_fd < 0) {
+                    throw std::invalid_argument(argv[i]);
+                }
+            } else if (arg == "--stream" && has_value) {
+                stream_topic = argv[++i];
+            } else if (arg == "--output-dir" && has_value) {
+                output_dir = argv[++i];
+                output_dir_given = true;
+            } else if (arg == "--segment-frames" && has_value) {
+                options.segment_frames = std::stoi(argv[++i]);
+            } else if (arg == "--max-memory" && has_value) {
+                options.max_memory_bytes = MemoryBudget::parseSize(argv[++i]);
+                if (options.max_memory_bytes == 0) {
+                    throw std::invalid_argument(argv[i]);
+                }
+            } else if (arg == "--threads" && has_value) {
+                options.worker_threads = std::stoi(argv[++i]);
+            } else if (arg == "--reserve-cores" && has_value) {
+                options.reserved_cores = std::stoi(argv[++i]);
+            } else if (arg == "--pin-threads") {
+                options.pin_threads = true;
+            } else if (arg == "--read-threads" && has_value) {
+                options.read_threads = std::stoi(argv[++i]);
+            } else if (arg == "--mmap") {
+                options.mapped_reader = true;
+            } else if (arg == "--jpeg-quality" && has_value) {
+                options.jpeg_quality = std::stoi(argv[++i]);
+            } else if (arg == "--jpeg-subsampling" && has_value) {
+                options.jpeg_subsampling = argv[++i];
+            } else if (arg == "--gop" && has_value) {
+                options.gop_size = std::stoi(argv[++i]);
+            } else if (arg == "--x264-threads" && has_value) {
+                options.x264_threads = std::stoi(argv[++i]);
+            } else if (arg == "--shard" && has_value) {
+                std::string shard = argv[++i];
+                size_t slash = shard.find('/');
+                if (slash == std::string::npos) {
+                    throw std::invalid_argument(shard);
+                }
+                options.shard_index = std::stoi(shard.substr(0, slash));
+                options.shard_count = std::stoi(shard.substr(slash + 1));
+            } else if (arg == "--trace" && has_value) {
+                trace_path = argv[++i];
+            } else if (arg == "--telemetry" && has_value) {
+                options.telemetry_topics.push_back(argv[++i]);
+            } else if (arg == "--sync-master" && has_value) {
+                options.sync_master = argv[++i];
+            } else if (arg == "--sync-tick-ms" && has_value) {
+                options.sync_tick_us = static_cast<uint64_t>(std::stod(argv[++i]) * 1000.0);
+                if (options.sync_tick_us == 0) {
+                    throw std::invalid_argument(argv[i]);
+                }
+            } else if (arg == "--h264-dir" && has_value) {
+                options.h264_root = argv[++i];
+            } else if (arg == "--splitter" && has_value) {
+                options.generate_h264_script = argv[++i];
+            } else if (arg == "--merge") {
+                merge_mode = true;
+                merge_dirs.assign(argv + i + 1, argv + argc);
+                break;
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                print_usage(argv[0]);
+                return 1;
             }
-
-            return true;
-        } else {
-            std::cout << "❌ Video conversion failed (exit code: " << result << ")" << std::endl;
-            return false;
         }
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid option value: " << e.what() << std::endl;
+        print_usage(argv[0]);
+        return 1;
     }
+    options.per_file_samples = !options.packed_samples || per_file_export;
 
-    // Helper function to replace filesystem functionality
-    bool file_exists(const std::string& path) {
-        struct stat buffer;
-        return (stat(path.c_str(), &buffer) == 0);
+    // The H.264 stream owns stdout; progress and diagnostics go to stderr
+    if (!stream_topic.empty()) {
+        std::cout.rdbuf(std::cerr.rdbuf());
     }
 
-    void create_directories(const std::string& path) {
-        boost::filesystem::create_directories(path);
+    if (options.shard_count < 1 || options.shard_index < 0 || options.shard_index >= options.shard_count) {
+        std::cerr << "❌ Error: invalid shard " << options.shard_index << "/" << options.shard_count << std::endl;
+        return 1;
     }
-
-    bool generateH264FilesForStreaming(const std::string& timestamped_h264_path, const std::string& output_dir) {
-        std::cout << "🎬 Generating H264 files for streaming..." << std::endl;
-        std::cout << "  Input: " << timestamped_h264_path << std::endl;
-        std::cout << "  Output: " << output_dir << std::endl;
-
-        // Create output directory
-        create_directories(output_dir);
-
-        // Step 1: Split H264 into individual frame files
-        std::ostringstream cmd;
-        cmd << "python3 /workspace/generate_h264.py "
-            << "-i '" << timestamped_h264_path << "' "
-            << "-o '" << output_dir << "/'";
-
-        std::cout << "Running: " << cmd.str() << std::endl;
-
-        int result = system(cmd.str().c_str());
-
-        if (result == 0) {
-            std::cout << "✅ H264 streaming files generated successfully" << std::endl;
-
-            // Skip automatic timestamp injection - will be done manually after Docker
-            std::cout << "INFO: H264 files generated without SEI timestamps" << std::endl;
-            std::cout << "INFO: Use fix_sei_for_flutter.sh script after copying files to backend" << std::endl;
-
-            return true;
-        } else {
-            std::cout << "❌ H264 streaming file generation failed (exit code: " << result << ")" << std::endl;
-            return false;
-        }
+    if (options.shard_count > 1 && options.single_pass) {
+        std::cerr << "❌ Error: --single-pass cannot be combined with --shard" << std::endl;
+        return 1;
+    }
+    if (options.sprite_tile_width < 1 || options.sprite_columns < 1 || options.sprite_rows < 1) {
+        std::cerr << "❌ Error: sprite width and grid must be positive" << std::endl;
+        return 1;
+    }
+    if (options.jpeg_quality < 1 || options.jpeg_quality > 100) {
+        std::cerr << "❌ Error: --jpeg-quality must be between 1 and 100" << std::endl;
+        return 1;
+    }
+    if (!JpegEncoder::validSubsampling(options.jpeg_subsampling)) {
+        std::cerr << "❌ Error: --jpeg-subsampling must be 420, 422 or 444" << std::endl;
+        return 1;
+    }
+    if (options.jpeg_subsampling != "420" && std::string(JpegEncoder::backend()) != "turbojpeg") {
+        std::cout << "⚠️  Built without TurboJPEG, frames use OpenCV's 4:2:0 subsampling" << std::endl;
+    }
+    if (options.shard_count > 1 && options.sprite_interval_us > 0) {
+        std::cout << "⚠️  Sprite sheets are not built by shards" << std::endl;
+    }
+    if (options.shard_count > 1 && !options.telemetry_topics.empty()) {
+        std::cout << "⚠️  Telemetry is not sampled by shards" << std::endl;
+    }
+    if (options.shard_count > 1 && options.segment_frames == 0) {
+        options.segment_frames = options.gop_size * 10;
+    }
+    if (options.gop_size < 1 || options.segment_frames < 0 || options.segment_frames % options.gop_size != 0) {
+        std::cerr << "❌ Error: --segment-frames must be a multiple of --gop" << std::endl;
+        return 1;
+    }
+    if (options.x264_threads < 1) {
+        std::cerr << "❌ Error: --x264-threads must be at least 1" << std::endl;
+        return 1;
     }
 
-public:
-    BagProcessor(const std::string& bag_path, const std::string& output_dir = "extracted_images", const std::string& timestamp = "")
-        : bag_path_(bag_path), output_dir_(output_dir), timestamp_(timestamp) {}
-
-    bool analyzeBag() {
-        std::cout << "=== ANALYZING BAG FILE ===" << std::endl;
-        std::cout << "Bag file: " << bag_path_ << std::endl;
-        std::cout << "==============================" << std::endl;
-
-        try {
-            rosbag::Bag bag;
-            bag.open(bag_path_, rosbag::bagmode::Read);
-
-            // Get bag info
-            rosbag::View view(bag);
-            
-            // Count total messages and get duration
-            int total_messages = 0;
-            ros::Time start_time = ros::TIME_MAX;
-            ros::Time end_time = ros::TIME_MIN;
-            
-            std::map<std::string, int> topic_counts;
-            std::map<std::string, std::string> topic_types;
-
-            // First pass: collect metadata
-            for (const rosbag::MessageInstance& msg : view) {
-                total_messages++;
-                
-                if (msg.getTime() < start_time) start_time = msg.getTime();
-                if (msg.getTime() > end_time) end_time = msg.getTime();
-                
-                std::string topic = msg.getTopic();
-                topic_counts[topic]++;
-                topic_types[topic] = msg.getDataType();
-            }
-
-            double duration = (end_time - start_time).toSec();
-            
-            for (const auto& topic_pair : topic_counts) {
-                const std::string& topic_name = topic_pair.first;
-                int count = topic_pair.second;
-                const std::string& msg_type = topic_types[topic_name];
-                
-                // Check if this is an image topic
-                if (msg_type.find("Image") != std::string::npos || 
-                    topic_name.find("image") != std::string::npos) {
-                    
-                    TopicInfo info;
-                    info.topic_name = topic_name;
-                    info.msg_type = msg_type;
-                    info.msg_count = count;
-                    image_topics_.push_back(info);
-                }
-            }
-
-            // Display found image topics
-            if (!image_topics_.empty()) {
-                std::cout << "Found " << image_topics_.size() << " image topics:" << std::endl;
-                // for (const auto& topic : image_topics_) {
-                //     std::cout << "  - " << topic.topic_name << ": " << topic.msg_count << " images" << std::endl;
-                // }
-            } else {
-                std::cout << "No image topics found!" << std::endl;
-                bag.close();
-                return false;
-            }
-
-            bag.close();
-            std::cout << std::endl;
-            return true;
-
-        } catch (const std::exception& e) {
-            std::cerr << "Error analyzing bag file: " << e.what() << std::endl;
-            return false;
-        }
+    // Streaming samples go to <h264-dir>/<timestamp>; reuse the timestamp of an explicit extracted_images_<timestamp> dir
+    if (output_dir_given) {
+        std::string dir_name = boost::filesystem::path(output_dir).filename().string();
+        const std::string prefix = "extracted_images_";
+        timestamp = dir_name.compare(0, prefix.size(), prefix) == 0 ? dir_name.substr(prefix.size()) : dir_name;
     }
 
-    bool createOutputDirectories() {
-        try {
-            // Create main output directory
-            create_directories(output_dir_);
-            
-            // Create directories for each image topic
-            for (const auto& topic : image_topics_) {
-                // Clean topic name for directory (replace / with _)
-                std::string dir_name = topic.topic_name;
-                std::replace(dir_name.begin(), dir_name.end(), '/', '_');
-                std::replace(dir_name.begin(), dir_name.end(), ':', '_');
-                
-                // Remove leading/trailing underscores
-                if (!dir_name.empty() && dir_name[0] == '_') {
-                    dir_name = dir_name.substr(1);
-                }
-                
-                std::string topic_dir = output_dir_ + "/" + dir_name;
-                create_directories(topic_dir);
-                
-                topic_directories_[topic.topic_name] = topic_dir;
-                extraction_counts_[topic.topic_name] = 0;
-            }
-            
-            std::cout << std::endl;
-            return true;
-            
-        } catch (const std::exception& e) {
-            std::cerr << "Error creating directories: " << e.what() << std::endl;
-            return false;
+    if (!trace_path.empty()) {
+        if (Trace::compiledIn()) {
+            Trace::start(trace_path);
+            TRACE_THREAD_NAME("main");
+        } else {
+            std::cout << "⚠️  Tracing is not compiled in (build with -DBAGPROC_TRACING=ON), --trace ignored" << std::endl;
         }
     }
 
-    bool extractImages() {
-        try {
-            rosbag::Bag bag;
-            bag.open(bag_path_, rosbag::bagmode::Read);
-
-            // Create view for image topics only
-            std::vector<std::string> image_topic_names;
-            for (const auto& topic : image_topics_) {
-                image_topic_names.push_back(topic.topic_name);
-            }
-            
-            rosbag::View view(bag, rosbag::TopicQuery(image_topic_names));
-            
-            int processed_messages = 0;
-            std::map<std::string, int> success_counts;
-            std::map<std::string, int> attempt_counts;
-            
-            // Initialize counters
-            for (const auto& topic : image_topics_) {
-                success_counts[topic.topic_name] = 0;
-                attempt_counts[topic.topic_name] = 0;
-            }
-
-            for (const rosbag::MessageInstance& msg : view) {
-                std::string topic_name = msg.getTopic();
-                attempt_counts[topic_name]++;
-                processed_messages++;
-
-                try {
-                    // Convert ROS message to sensor_msgs::Image
-                    sensor_msgs::ImageConstPtr image_msg = msg.instantiate<sensor_msgs::Image>();
-                    
-                    if (image_msg) {
-                        // Convert to OpenCV image using cv_bridge
-                        cv_bridge::CvImagePtr cv_ptr;
-                        
-                        try {
-                            // Try to convert the image
-                            if (image_msg->encoding == "bgr8" || image_msg->encoding == "rgb8") {
-                                cv_ptr = cv_bridge::toCvCopy(image_msg, "bgr8");
-                            } else if (image_msg->encoding == "mono8") {
-                                cv_ptr = cv_bridge::toCvCopy(image_msg, "mono8");
-                            } else if (image_msg->encoding == "mono16") {
-                                cv_ptr = cv_bridge::toCvCopy(image_msg, "mono16");
-                                // Convert 16-bit to 8-bit
-                                cv_ptr->image.convertTo(cv_ptr->image, CV_8UC1, 1.0/256.0);
-                            } else {
-                                // Try default conversion
-                                cv_ptr = cv_bridge::toCvCopy(image_msg, "bgr8");
-                            }
-                        } catch (cv_bridge::Exception& e) {
-                            // If conversion fails, try with original encoding
-                            cv_ptr = cv_bridge::toCvCopy(image_msg);
-                        }
-
-                        if (cv_ptr && !cv_ptr->image.empty()) {
-                            // Generate filename with timestamp
-                            double timestamp = msg.getTime().toSec();
-                            
-                            std::ostringstream filename_stream;
-                            filename_stream << "image_" 
-                                          << std::setfill('0') << std::setw(4) << success_counts[topic_name]
-                                          << "_" << std::fixed << std::setprecision(3) << timestamp
-                                          << ".jpg";
-                            
-                            std::string filepath = topic_directories_[topic_name] + "/" + filename_stream.str();
-                            
-                            // Save image
-                            if (cv::imwrite(filepath, cv_ptr->image)) {
-                                success_counts[topic_name]++;
-                                
-                                // // Progress update every 50 images
-                                // if (success_counts[topic_name] % 50 == 0) {
-                                //     std::cout << "  " << topic_name << ": saved " 
-                                //              << success_counts[topic_name] << " images" << std::endl;
-                                // }
-                            } else {
-                                std::cerr << "Failed to save image: " << filepath << std::endl;
-                            }
-                        }
-                    }
-                } catch (const std::exception& e) {
-                    if (attempt_counts[topic_name] <= 5) {  // Only show first few errors
-                        std::cerr << "Error processing image " << attempt_counts[topic_name] 
-                                 << " from " << topic_name << ": " << e.what() << std::endl;
-                    }
-                }
-            }
-
-            bag.close();
-
-            // Print final results
-            std::cout << std::endl << "Extraction completed:" << std::endl;
-            std::cout << "--------------------------------------------------" << std::endl;
-            
-            int total_attempted = 0;
-            int total_extracted = 0;
-            
-            for (const auto& topic : image_topics_) {
-                int attempted = attempt_counts[topic.topic_name];
-                int extracted = success_counts[topic.topic_name];
-                double success_rate = attempted > 0 ? (double(extracted) / attempted * 100.0) : 0.0;
-                
-                total_attempted += attempted;
-                total_extracted += extracted;
-                
-                std::cout << topic.topic_name << ":" << std::endl;
-                std::cout << "  Attempted: " << attempted << std::endl;
-                std::cout << "  Successful: " << extracted << std::endl;
-                std::cout << "  Success rate: " << std::fixed << std::setprecision(1) 
-                         << success_rate << "%" << std::endl;
-            }
-            
-            double overall_success = total_attempted > 0 ? (double(total_extracted) / total_attempted * 100.0) : 0.0;
-            std::cout << std::endl << "Overall Results:" << std::endl;
-            std::cout << "  Total attempted: " << total_attempted << std::endl;
-            std::cout << "  Total extracted: " << total_extracted << std::endl;
-            std::cout << "  Overall success rate: " << std::fixed << std::setprecision(1) 
-                     << overall_success << "%" << std::endl;
-
-            return total_extracted > 0;
-
-        } catch (const std::exception& e) {
-            std::cerr << "Error extracting images: " << e.what() << std::endl;
-            return false;
+    // The reader, writer and ffmpeg threads started from here stay off the reserved cores
+    if (options.reserved_cores > 0) {
+        std::vector<int> cpus = TaskScheduler::availableCpus(options.reserved_cores);
+        if (TaskScheduler::restrictCurrentThread(cpus)) {
+            std::cout << "🧮 Using " << cpus.size() << " CPUs (" << options.reserved_cores << " reserved)" << std::endl;
         }
     }
 
-    bool process() {
-        std::cout << "Starting bag file processing..." << std::endl;
-        std::cout << "Bag file: " << bag_path_ << std::endl;
-        std::cout << "Output directory: " << output_dir_ << std::endl << std::endl;
-
-        // Step 1: Analyze bag file
-        if (!analyzeBag()) {
-            std::cerr << "Failed to analyze bag file" << std::endl;
-            return false;
+    if (!stream_topic.empty()) {
+        if (isatty(STDOUT_FILENO)) {
+            std::cerr << "❌ Error: --stream writes H.264 to stdout, redirect it to a file or pipe" << std::endl;
+            return 1;
         }
-
-        // Step 2: Create output directories
-        if (!createOutputDirectories()) {
-            std::cerr << "Failed to create output directories" << std::endl;
-            return false;
+        int input_fd = bag_fd;
+        if (input_fd < 0) {
+            input_fd = bag_file.empty() || bag_file == "-" ? STDIN_FILENO : open(bag_file.c_str(), O_RDONLY);
         }
-
-        // Step 3: Extract images
-        if (!extractImages()) {
-            std::cerr << "Failed to extract images" << std::endl;
-            return false;
+        if (input_fd < 0) {
+            std::cerr << "❌ Error: cannot open " << bag_file << std::endl;
+            return 1;
         }
 
-        // Step 4: Convert images to videos
-        std::cout << std::endl << "=== CONVERTING IMAGES TO VIDEOS ===" << std::endl;
-        
-        bool all_conversions_success = true;
-        for (const auto& topic_dir_pair : topic_directories_) {
-            const std::string& topic_name = topic_dir_pair.first;
-            const std::string& images_dir = topic_dir_pair.second;
-            
-            // Generate output video filename based on directory name
-            std::string dir_name = boost::filesystem::path(images_dir).filename().string();
-            std::string video_filename = dir_name + "_30fps.mp4";
-            std::string output_video_path = output_dir_ + "/" + video_filename;
-            
-            std::cout << std::endl << "Converting topic: " << topic_name << std::endl;
-            
-            if (!convertImagesToVideo(images_dir, output_video_path)) {
-                std::cout << "⚠️  Video conversion failed for " << topic_name << std::endl;
-                all_conversions_success = false;
-            }
-        }
+        BagProcessor streamer("", output_dir, timestamp, options);
+        bool streamed = streamer.stream(input_fd, stream_topic, STDOUT_FILENO);
+        Trace::write();
+        return streamed ? 0 : 1;
+    }
 
-        std::cout << std::endl << "✅ Bag processing completed successfully!" << std::endl;
-        std::cout << "Images extracted to: " << output_dir_ << std::endl;
-        
-        if (all_conversions_success) {
-            std::cout << "✅ All videos converted successfully!" << std::endl;
-        } else {
-            std::cout << "⚠️  Some video conversions failed" << std::endl;
+    if (merge_mode) {
+        if (merge_dirs.empty() || !output_dir_given) {
+            std::cerr << "❌ Error: --merge needs --output-dir and at least one shard directory" << std::endl;
+            return 1;
         }
-        
-        return true;
+        BagProcessor merger("", output_dir, timestamp, options);
+        bool merged = merger.mergeShards(merge_dirs);
+        Trace::write();
+        return merged ? 0 : 1;
     }
-};
-
-int main(int argc, char** argv) {
-    // Initialize ROS (required for rosbag)
-    ros::init(argc, argv, "bag_processor");
-
-    std::string bag_file;
-    std::string timestamp = generate_timestamp();
-    std::string output_dir = "output/extracted_images_" + timestamp;
 
     // Auto-find bag file in /workspace/jetson/ directory
     boost::filesystem::path jetson_dir("/workspace/jetson");
-    bool found = false;
+    bool found = !bag_file.empty();
     
     try {
-        if (boost::filesystem::exists(jetson_dir) && boost::filesystem::is_directory(jetson_dir)) {
+        if (!found && boost::filesystem::exists(jetson_dir) && boost::filesystem::is_directory(jetson_dir)) {
             for (auto& file : boost::filesystem::directory_iterator(jetson_dir)) {
                 if (file.path().extension() == ".bag") {
                     bag_file = file.path().string();
@@ -528,9 +404,23 @@ int main(int argc, char** argv) {
     }
 
     // Create and run bag processor
-    BagProcessor processor(bag_file, output_dir, timestamp);
+    BagProcessor processor(bag_file, output_dir, timestamp, options);
+
+    if (!frame_queries.empty()) {
+        int frames_result = write_frames(processor, frame_queries, output_dir);
+        Trace::write();
+        return frames_result;
+    }
+
+    if (preview_mode) {
+        bool previewed = processor.preview();
+        Trace::write();
+        return previewed ? 0 : 1;
+    }
     
-    if (!processor.process()) {
+    bool processed = processor.process();
+    Trace::write();
+    if (!processed) {
         std::cerr << "Bag processing failed!" << std::endl;
         return 1;
     }
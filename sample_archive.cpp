@@ -0,0 +1,205 @@
+#include "sample_archive.h"
+#include <cstring>
+
+namespace {
+
+const char HEADER_MAGIC[8] = {'H', '2', '6', '4', 'P', 'A', 'C', 'K'};
+const char FOOTER_MAGIC[8] = {'P', 'A', 'C', 'K', 'I', 'N', 'D', 'X'};
+constexpr uint32_t ARCHIVE_VERSION = 1;
+constexpr size_t HEADER_SIZE = 16;
+constexpr size_t INDEX_ENTRY_SIZE = 24;
+constexpr size_t FOOTER_SIZE = 24;
+
+void putU32(uint8_t* out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (value >> ((3 - i) * 8)) & 0xFF;
+    }
+}
+
+void putU64(uint8_t* out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (value >> ((7 - i) * 8)) & 0xFF;
+    }
+}
+
+uint32_t getU32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+uint64_t getU64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+} // namespace
+
+SampleArchiveWriter::~SampleArchiveWriter() {
+    if (file_.is_open() || async_file_) {
+        close();
+    }
+}
+
+bool SampleArchiveWriter::open(const std::string& path, AsyncWriter* writer) {
+    writer_ = writer;
+    if (writer_) {
+        async_file_ = writer_->open(path);
+        if (!async_file_) {
+            return false;
+        }
+    } else {
+        file_.open(path, std::ios::binary | std::ios::trunc);
+        if (!file_) {
+            return false;
+        }
+    }
+
+    uint8_t header[HEADER_SIZE];
+    std::memcpy(header, HEADER_MAGIC, 8);
+    putU32(header + 8, ARCHIVE_VERSION);
+    putU32(header + 12, 0);
+
+    index_.clear();
+    write_offset_ = HEADER_SIZE;
+    return writeBytes(header, HEADER_SIZE);
+}
+
+bool SampleArchiveWriter::writeBytes(const uint8_t* data, size_t size) {
+    if (writer_) {
+        writer_->write(async_file_, std::vector<uint8_t>(data, data + size));
+        return true;
+    }
+    file_.write(reinterpret_cast<const char*>(data), size);
+    return static_cast<bool>(file_);
+}
+
+bool SampleArchiveWriter::appendSample(const uint8_t* data, size_t size, uint32_t flags, uint64_t timestamp_us) {
+    SampleIndexEntry entry;
+    entry.offset = write_offset_;
+    entry.size = static_cast<uint32_t>(size);
+    entry.flags = flags;
+    entry.timestamp_us = timestamp_us;
+
+    if (!writeBytes(data, size)) {
+        return false;
+    }
+
+    index_.push_back(entry);
+    write_offset_ += size;
+    return true;
+}
+
+bool SampleArchiveWriter::close() {
+    if (!file_.is_open() && !async_file_) {
+        return false;
+    }
+
+    // Offset table, written in one block
+    std::vector<uint8_t> table(index_.size() * INDEX_ENTRY_SIZE + FOOTER_SIZE);
+    uint8_t* out = table.data();
+    for (const auto& entry : index_) {
+        putU64(out, entry.offset);
+        putU32(out + 8, entry.size);
+        putU32(out + 12, entry.flags);
+        putU64(out + 16, entry.timestamp_us);
+        out += INDEX_ENTRY_SIZE;
+    }
+
+    // Footer
+    putU64(out, write_offset_);
+    putU64(out + 8, index_.size());
+    std::memcpy(out + 16, FOOTER_MAGIC, 8);
+
+    bool ok = writeBytes(table.data(), table.size());
+    if (writer_) {
+        // The file is closed once its queued writes complete
+        async_file_.reset();
+    } else {
+        file_.close();
+    }
+    return ok;
+}
+
+bool SampleArchiveReader::open(const std::string& path) {
+    file_.open(path, std::ios::binary | std::ios::ate);
+    if (!file_) {
+        return false;
+    }
+
+    uint64_t file_size = static_cast<uint64_t>(file_.tellg());
+    if (file_size < HEADER_SIZE + FOOTER_SIZE) {
+        return false;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    file_.seekg(0, std::ios::beg);
+    file_.read(reinterpret_cast<char*>(header), HEADER_SIZE);
+    if (!file_ || std::memcmp(header, HEADER_MAGIC, 8) != 0 || getU32(header + 8) != ARCHIVE_VERSION) {
+        return false;
+    }
+
+    uint8_t footer[FOOTER_SIZE];
+    file_.seekg(file_size - FOOTER_SIZE, std::ios::beg);
+    file_.read(reinterpret_cast<char*>(footer), FOOTER_SIZE);
+    if (!file_ || std::memcmp(footer + 16, FOOTER_MAGIC, 8) != 0) {
+        return false;
+    }
+
+    uint64_t index_offset = getU64(footer);
+    uint64_t sample_count = getU64(footer + 8);
+    // Compare without multiplying: a corrupt sample_count must not wrap around
+    if (index_offset < HEADER_SIZE || index_offset > file_size - FOOTER_SIZE) {
+        return false;
+    }
+    uint64_t index_size = file_size - FOOTER_SIZE - index_offset;
+    if (index_size % INDEX_ENTRY_SIZE != 0 || sample_count != index_size / INDEX_ENTRY_SIZE) {
+        return false;
+    }
+
+    std::vector<uint8_t> table(sample_count * INDEX_ENTRY_SIZE);
+    file_.seekg(index_offset, std::ios::beg);
+    file_.read(reinterpret_cast<char*>(table.data()), table.size());
+    if (!file_) {
+        return false;
+    }
+
+    index_.resize(sample_count);
+    const uint8_t* in = table.data();
+    for (auto& entry : index_) {
+        entry.offset = getU64(in);
+        entry.size = getU32(in + 8);
+        entry.flags = getU32(in + 12);
+        entry.timestamp_us = getU64(in + 16);
+        if (entry.offset > index_offset || entry.size > index_offset - entry.offset) {
+            index_.clear();
+            return false;
+        }
+        in += INDEX_ENTRY_SIZE;
+    }
+
+    return true;
+}
+
+bool SampleArchiveReader::readSample(size_t i, std::vector<uint8_t>& data) {
+    if (i >= index_.size()) {
+        return false;
+    }
+
+    const SampleIndexEntry& e = index_[i];
+    data.resize(e.size);
+    file_.seekg(e.offset, std::ios::beg);
+    file_.read(reinterpret_cast<char*>(data.data()), e.size);
+    return static_cast<bool>(file_);
+}
+
+bool SampleArchiveReader::isArchivePath(const std::string& path) {
+    const std::string suffix = ".h264pack";
+    return path.size() >= suffix.size() &&
+           path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
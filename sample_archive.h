@@ -0,0 +1,107 @@
+#ifndef SAMPLE_ARCHIVE_H
+#define SAMPLE_ARCHIVE_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include "async_writer.h"
+
+// Packed sample archive: all length-prefixed samples of one topic in a single file.
+//
+// Layout (all integers big-endian, matching the sample length prefixes):
+//   header  "H264PACK" magic, u32 version, u32 reserved
+//   data    sample bytes, back to back
+//   index   one entry per sample: u64 offset, u32 size, u32 flags, u64 timestamp_us
+//   footer  u64 index_offset, u64 sample_count, "PACKINDX" magic
+//
+// The index lives at the end so writers can stream samples without knowing the count.
+
+// Default file name of the archive inside a topic output directory
+constexpr const char* SAMPLE_ARCHIVE_FILENAME = "samples.h264pack";
+
+// Sample flags
+constexpr uint32_t SAMPLE_FLAG_KEYFRAME = 0x1;
+
+struct SampleIndexEntry {
+    uint64_t offset;        // Offset of the sample from the start of the file
+    uint32_t size;          // Sample size in bytes
+    uint32_t flags;         // SAMPLE_FLAG_* bits
+    uint64_t timestamp_us;  // Capture timestamp, 0 if unknown
+};
+
+class SampleArchiveWriter {
+public:
+    SampleArchiveWriter() = default;
+    ~SampleArchiveWriter();
+
+    /**
+     * Create (or truncate) an archive file and write its header
+     * @param path Output file path
+     * @param writer Optional asynchronous writer; write errors are then reported by its flush()
+     * @return true on success
+     */
+    bool open(const std::string& path, AsyncWriter* writer = nullptr);
+
+    /**
+     * Append one sample to the archive
+     * @param data Length-prefixed sample data
+     * @param size Sample size in bytes
+     * @param flags SAMPLE_FLAG_* bits
+     * @param timestamp_us Capture timestamp in microseconds, 0 if unknown
+     * @return true on success
+     */
+    bool appendSample(const uint8_t* data, size_t size, uint32_t flags, uint64_t timestamp_us);
+
+    /**
+     * Write the offset table and footer and close the file
+     * @return true on success
+     */
+    bool close();
+
+    size_t sampleCount() const { return index_.size(); }
+
+private:
+    bool writeBytes(const uint8_t* data, size_t size);
+
+    std::ofstream file_;
+    AsyncWriter* writer_ = nullptr;
+    AsyncWriter::FileHandle async_file_;
+    std::vector<SampleIndexEntry> index_;
+    uint64_t write_offset_ = 0;
+};
+
+class SampleArchiveReader {
+public:
+    /**
+     * Open an archive and load its offset table
+     * @param path Archive file path
+     * @return true if the file is a valid archive
+     */
+    bool open(const std::string& path);
+
+    size_t sampleCount() const { return index_.size(); }
+
+    const SampleIndexEntry& entry(size_t i) const { return index_[i]; }
+
+    /**
+     * Read one sample into a buffer (the buffer is reused between calls)
+     * @param i Sample number
+     * @param data Output buffer, resized to the sample size
+     * @return true on success
+     */
+    bool readSample(size_t i, std::vector<uint8_t>& data);
+
+    /**
+     * Check whether a path looks like a packed archive by its extension
+     * @param path File path
+     * @return true if it ends with ".h264pack"
+     */
+    static bool isArchivePath(const std::string& path);
+
+private:
+    std::ifstream file_;
+    std::vector<SampleIndexEntry> index_;
+};
+
+#endif // SAMPLE_ARCHIVE_H
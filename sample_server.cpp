@@ -0,0 +1,598 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <limits>
+#include <csignal>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "sei_generator.h"
+#include "h264_sample.h"
+#include "sample_archive.h"
+
+// Loopback sample server for the playback backend.
+//
+// Serves the samples of processed cameras (sample-N.h264 directories or samples.h264pack
+// archives) over HTTP/1.1 on 127.0.0.1 or a Unix socket:
+//   GET /cameras                             JSON list of cameras and sample counts
+//   GET /<camera>/samples/<n>                one length-prefixed sample
+//   GET /<camera>/range?from=<us>&to=<us>    all samples with from <= timestamp <= to, back to back
+// Sample bytes go from the page cache to the socket with sendfile(). After each response
+// the next samples of that client are announced to the kernel with posix_fadvise(WILLNEED),
+// so sequential playback finds them in memory.
+
+struct ServedSample {
+    uint64_t offset = 0;        // Offset in the archive (0 for per-file samples)
+    uint32_t size = 0;
+    uint64_t timestamp_us = 0;  // 0 if unknown
+    uint32_t flags = 0;
+};
+
+struct Camera {
+    std::string name;           // Path relative to the served root
+    std::string path;
+    int archive_fd = -1;        // Open archive, -1 for the per-file layout
+    std::vector<std::string> files;
+    std::vector<ServedSample> samples;
+};
+
+struct ServerOptions {
+    std::string root;
+    int port = 0;
+    std::string unix_path;
+    size_t read_ahead = 30;     // Samples announced after each response
+    size_t open_files = 512;    // Per-file descriptors kept open
+};
+
+// Open file descriptor, closed with its last user
+class Descriptor {
+public:
+    explicit Descriptor(int fd) : fd_(fd) {}
+    ~Descriptor() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+    int fd() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+// LRU of open sample files, so repeated and read-ahead requests skip open()
+class DescriptorCache {
+public:
+    explicit DescriptorCache(size_t capacity) : capacity_(capacity) {}
+
+    std::shared_ptr<Descriptor> acquire(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end()) {
+            order_.splice(order_.begin(), order_, it->second.second);
+            return it->second.first;
+        }
+
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        std::shared_ptr<Descriptor> descriptor = std::make_shared<Descriptor>(fd);
+        order_.push_front(path);
+        entries_[path] = std::make_pair(descriptor, order_.begin());
+
+        if (entries_.size() > capacity_) {
+            entries_.erase(order_.back());
+            order_.pop_back();
+        }
+        return descriptor;
+    }
+
+private:
+    size_t capacity_;
+    std::mutex mutex_;
+    std::list<std::string> order_;
+    std::map<std::string, std::pair<std::shared_ptr<Descriptor>, std::list<std::string>::iterator>> entries_;
+};
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isDirectory(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// Sample number from "sample-123.h264", -1 if the name does not match
+long sampleNumber(const std::string& filename) {
+    if (filename.compare(0, 7, "sample-") != 0 || !endsWith(filename, ".h264")) {
+        return -1;
+    }
+    std::string digits = filename.substr(7, filename.size() - 12);
+    if (digits.empty() || digits.size() > 18 || digits.find_first_not_of("0123456789") != std::string::npos) {
+        return -1;
+    }
+    return std::strtol(digits.c_str(), nullptr, 10);
+}
+
+// Timestamp from the SEI at the start of a per-file sample (only the head is read)
+uint64_t readSampleTimestamp(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> head(256);
+    file.read(reinterpret_cast<char*>(head.data()), head.size());
+    head.resize(static_cast<size_t>(file.gcount()));
+
+    // A truncated head still yields the complete NAL units before the cut
+    std::vector<NalUnitRef> nals;
+    H264Sample::parseLengthPrefixed(head.data(), head.size(), nals);
+    for (const auto& nal : nals) {
+        if (nal.type == NAL_UNIT_TYPE_SEI) {
+            std::vector<uint8_t> sei_nalu(head.begin() + nal.offset, head.begin() + nal.offset + nal.length);
+            uint64_t timestamp = SEIGenerator::extractSimpleTimestampFromSEI(sei_nalu);
+            return timestamp != 0 ? timestamp : SEIGenerator::extractTimestampFromSEI(sei_nalu);
+        }
+    }
+    return 0;
+}
+
+bool loadCamera(Camera& camera) {
+    std::string archive_path = camera.path + "/" + SAMPLE_ARCHIVE_FILENAME;
+    SampleArchiveReader archive;
+    if (archive.open(archive_path)) {
+        camera.archive_fd = open(archive_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (camera.archive_fd < 0) {
+            return false;
+        }
+        camera.files.clear();
+        for (size_t i = 0; i < archive.sampleCount(); i++) {
+            const SampleIndexEntry& entry = archive.entry(i);
+            camera.samples.push_back(ServedSample{entry.offset, entry.size, entry.timestamp_us, entry.flags});
+        }
+        return true;
+    }
+
+    for (const auto& filename : camera.files) {
+        ServedSample sample;
+        struct stat info;
+        std::string path = camera.path + "/" + filename;
+        if (!filename.empty() && stat(path.c_str(), &info) == 0) {
+            sample.size = static_cast<uint32_t>(info.st_size);
+            sample.timestamp_us = readSampleTimestamp(path);
+        }
+        camera.samples.push_back(sample);
+    }
+    return true;
+}
+
+// Find camera directories below root (a directory holding samples is a camera)
+void findCameras(const std::string& root, const std::string& name, std::map<std::string, Camera>& cameras) {
+    DIR* dir = opendir(root.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+
+    Camera camera;
+    camera.name = name;
+    camera.path = root;
+    bool packed = false;
+    std::vector<std::string> subdirs;
+    std::map<long, std::string> numbered_files;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string filename = entry->d_name;
+        if (filename == "." || filename == "..") {
+            continue;
+        }
+        if (filename == SAMPLE_ARCHIVE_FILENAME) {
+            packed = true;
+            continue;
+        }
+        long number = sampleNumber(filename);
+        if (number >= 0) {
+            numbered_files[number] = filename;
+        } else if (isDirectory(root + "/" + filename)) {
+            subdirs.push_back(filename);
+        }
+    }
+    closedir(dir);
+
+    // Sample numbers are dense, so the table is bounded by the number of files: a stray
+    // large number must not allocate a slot for every sample below it
+    size_t max_samples = numbered_files.size() * 2;
+    for (const auto& file : numbered_files) {
+        if (static_cast<size_t>(file.first) >= max_samples) {
+            std::cerr << "⚠️  Ignoring sample outside the numbering of " << root << ": " << file.second << std::endl;
+            continue;
+        }
+        if (static_cast<size_t>(file.first) >= camera.files.size()) {
+            camera.files.resize(file.first + 1);
+        }
+        camera.files[file.first] = file.second;
+    }
+
+    if ((packed || !camera.files.empty()) && loadCamera(camera)) {
+        cameras[camera.name.empty() ? "." : camera.name] = camera;
+    }
+
+    for (const auto& subdir : subdirs) {
+        findCameras(root + "/" + subdir, name.empty() ? subdir : name + "/" + subdir, cameras);
+    }
+}
+
+class SampleServer {
+public:
+    SampleServer(const ServerOptions& options, std::map<std::string, Camera>& cameras)
+        : options_(options), cameras_(cameras), descriptors_(options.open_files) {}
+
+    // Serve one client connection until it closes
+    void serveClient(int client_fd) {
+        std::string buffer;
+        char chunk[4096];
+
+        while (true) {
+            size_t header_end;
+            while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+                ssize_t received = recv(client_fd, chunk, sizeof(chunk), 0);
+                if (received <= 0 || buffer.size() > 65536) {
+                    close(client_fd);
+                    return;
+                }
+                buffer.append(chunk, received);
+            }
+
+            std::string request = buffer.substr(0, header_end);
+            buffer.erase(0, header_end + 4);
+
+            std::istringstream request_line(request.substr(0, request.find("\r\n")));
+            std::string method, target, version;
+            request_line >> method >> target >> version;
+
+            std::string lower = request;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            bool keep_alive = version == "HTTP/1.1" ? lower.find("connection: close") == std::string::npos
+                                                    : lower.find("connection: keep-alive") != std::string::npos;
+
+            // An exception must not escape the detached client thread and end the server
+            bool ok = false;
+            try {
+                ok = method == "GET" ? handle(client_fd, target, keep_alive)
+                                     : sendError(client_fd, 405, "Method Not Allowed", keep_alive);
+            } catch (const std::exception& e) {
+                std::cerr << "⚠️  Request failed: " << target << ": " << e.what() << std::endl;
+            }
+            if (!ok || !keep_alive) {
+                close(client_fd);
+                return;
+            }
+        }
+    }
+
+private:
+    bool handle(int client_fd, const std::string& target, bool keep_alive) {
+        std::string path = target.substr(0, target.find('?'));
+        std::map<std::string, std::string> query = parseQuery(target);
+
+        if (path == "/cameras") {
+            return sendCameraList(client_fd, keep_alive);
+        }
+
+        size_t samples_pos = path.rfind("/samples/");
+        if (samples_pos != std::string::npos) {
+            Camera* camera = findCamera(path.substr(1, samples_pos - 1));
+            size_t index = 0;
+            if (camera && !parseNumber(path.substr(samples_pos + 9), index)) {
+                return sendError(client_fd, 400, "Bad Request", keep_alive);
+            }
+            if (!camera || index >= camera->samples.size() || camera->samples[index].size == 0) {
+                return sendError(client_fd, 404, "Not Found", keep_alive);
+            }
+            return sendSamples(client_fd, *camera, index, index + 1, keep_alive);
+        }
+
+        if (endsWith(path, "/range")) {
+            Camera* camera = findCamera(path.substr(1, path.size() - 7));
+            size_t from_us = 0;
+            size_t to_us = 0;
+            if (!camera || !parseNumber(query["from"], from_us) || !parseNumber(query["to"], to_us) || to_us < from_us) {
+                return sendError(client_fd, camera ? 400 : 404, camera ? "Bad Request" : "Not Found", keep_alive);
+            }
+
+            // Timestamps increase with the sample number, so the range is contiguous
+            auto by_time = [](const ServedSample& sample, uint64_t t) { return sample.timestamp_us < t; };
+            auto first = std::lower_bound(camera->samples.begin(), camera->samples.end(), from_us, by_time);
+            auto after_time = [](uint64_t t, const ServedSample& sample) { return t < sample.timestamp_us; };
+            auto last = std::upper_bound(first, camera->samples.end(), to_us, after_time);
+            return sendSamples(client_fd, *camera, first - camera->samples.begin(), last - camera->samples.begin(),
+                               keep_alive);
+        }
+
+        return sendError(client_fd, 404, "Not Found", keep_alive);
+    }
+
+    Camera* findCamera(const std::string& name) {
+        auto it = cameras_.find(name);
+        return it == cameras_.end() ? nullptr : &it->second;
+    }
+
+    // Decimal number; false (never an exception) for anything else, including overflow
+    static bool parseNumber(const std::string& text, size_t& value) {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        errno = 0;
+        unsigned long long parsed = std::strtoull(text.c_str(), nullptr, 10);
+        if (errno == ERANGE || parsed > std::numeric_limits<size_t>::max()) {
+            return false;
+        }
+        value = static_cast<size_t>(parsed);
+        return true;
+    }
+
+    static std::map<std::string, std::string> parseQuery(const std::string& target) {
+        std::map<std::string, std::string> query;
+        size_t pos = target.find('?');
+        if (pos == std::string::npos) {
+            return query;
+        }
+        std::istringstream pairs(target.substr(pos + 1));
+        std::string pair;
+        while (std::getline(pairs, pair, '&')) {
+            size_t equals = pair.find('=');
+            if (equals != std::string::npos) {
+                query[pair.substr(0, equals)] = pair.substr(equals + 1);
+            }
+        }
+        return query;
+    }
+
+    static bool sendAll(int client_fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t result = send(client_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (result <= 0) {
+                return false;
+            }
+            sent += result;
+        }
+        return true;
+    }
+
+    // sendfile() may send less than asked; loop until the range is out
+    static bool sendFileRange(int client_fd, int file_fd, uint64_t offset, uint64_t size) {
+        off_t position = static_cast<off_t>(offset);
+        while (size > 0) {
+            ssize_t result = sendfile(client_fd, file_fd, &position, size);
+            if (result <= 0) {
+                return false;
+            }
+            size -= result;
+        }
+        return true;
+    }
+
+    static std::string responseHeader(int status, const std::string& reason, const std::string& content_type,
+                                      uint64_t length, bool keep_alive) {
+        std::ostringstream header;
+        header << "HTTP/1.1 " << status << " " << reason << "\r\n"
+               << "Content-Type: " << content_type << "\r\n"
+               << "Content-Length: " << length << "\r\n"
+               << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n";
+        return header.str();
+    }
+
+    bool sendError(int client_fd, int status, const std::string& reason, bool keep_alive) {
+        std::string body = reason + "\n";
+        return sendAll(client_fd, responseHeader(status, reason, "text/plain", body.size(), keep_alive) + "\r\n" + body);
+    }
+
+    bool sendCameraList(int client_fd, bool keep_alive) {
+        std::ostringstream body;
+        body << "[";
+        bool first = true;
+        for (const auto& entry : cameras_) {
+            const Camera& camera = entry.second;
+            uint64_t first_us = camera.samples.empty() ? 0 : camera.samples.front().timestamp_us;
+            uint64_t last_us = camera.samples.empty() ? 0 : camera.samples.back().timestamp_us;
+            body << (first ? "" : ",") << "{\"name\": \"" << entry.first << "\", \"samples\": " << camera.samples.size()
+                 << ", \"packed\": " << (camera.archive_fd >= 0 ? "true" : "false")
+                 << ", \"first_us\": " << first_us << ", \"last_us\": " << last_us << "}";
+            first = false;
+        }
+        body << "]\n";
+        std::string json = body.str();
+        return sendAll(client_fd, responseHeader(200, "OK", "application/json", json.size(), keep_alive) + "\r\n" + json);
+    }
+
+    // Send samples [begin, end) and announce the samples that follow
+    bool sendSamples(int client_fd, Camera& camera, size_t begin, size_t end, bool keep_alive) {
+        uint64_t length = 0;
+        for (size_t i = begin; i < end; i++) {
+            length += camera.samples[i].size;
+        }
+
+        std::string header = responseHeader(200, "OK", "application/octet-stream", length, keep_alive);
+        header += "X-First-Sample: " + std::to_string(begin) + "\r\n";
+        header += "X-Sample-Count: " + std::to_string(end - begin) + "\r\n";
+        if (end == begin + 1) {
+            header += "X-Timestamp-Us: " + std::to_string(camera.samples[begin].timestamp_us) + "\r\n";
+        }
+        if (!sendAll(client_fd, header + "\r\n")) {
+            return false;
+        }
+
+        if (camera.archive_fd >= 0) {
+            // Archive samples are stored back to back, so any range is one sendfile
+            if (end > begin && !sendFileRange(client_fd, camera.archive_fd, camera.samples[begin].offset, length)) {
+                return false;
+            }
+        } else {
+            for (size_t i = begin; i < end; i++) {
+                if (camera.samples[i].size == 0) {
+                    continue;
+                }
+                std::shared_ptr<Descriptor> file = descriptors_.acquire(camera.path + "/" + camera.files[i]);
+                if (!file || !sendFileRange(client_fd, file->fd(), 0, camera.samples[i].size)) {
+                    return false;
+                }
+            }
+        }
+
+        readAhead(camera, end);
+        return true;
+    }
+
+    void readAhead(Camera& camera, size_t next) {
+        size_t end = std::min(camera.samples.size(), next + options_.read_ahead);
+        if (next >= end) {
+            return;
+        }
+
+        if (camera.archive_fd >= 0) {
+            uint64_t offset = camera.samples[next].offset;
+            uint64_t length = camera.samples[end - 1].offset + camera.samples[end - 1].size - offset;
+            posix_fadvise(camera.archive_fd, offset, length, POSIX_FADV_WILLNEED);
+            return;
+        }
+
+        for (size_t i = next; i < end; i++) {
+            if (camera.samples[i].size == 0) {
+                continue;
+            }
+            std::shared_ptr<Descriptor> file = descriptors_.acquire(camera.path + "/" + camera.files[i]);
+            if (file) {
+                posix_fadvise(file->fd(), 0, 0, POSIX_FADV_WILLNEED);
+            }
+        }
+    }
+
+    const ServerOptions& options_;
+    std::map<std::string, Camera>& cameras_;
+    DescriptorCache descriptors_;
+};
+
+int listenSocket(const ServerOptions& options) {
+    int server_fd;
+    if (!options.unix_path.empty()) {
+        server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, options.unix_path.c_str(), sizeof(address.sun_path) - 1);
+        unlink(options.unix_path.c_str());
+        if (server_fd < 0 || bind(server_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+            return -1;
+        }
+    } else {
+        server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        if (server_fd < 0 || bind(server_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+            return -1;
+        }
+    }
+    return listen(server_fd, 64) == 0 ? server_fd : -1;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] <h264_with_sei dir>" << std::endl;
+    std::cerr << "  --port <n>          Listen on 127.0.0.1:<n> (default: 8090)" << std::endl;
+    std::cerr << "  --unix <path>       Listen on a Unix socket instead" << std::endl;
+    std::cerr << "  --read-ahead <n>    Samples prefetched after each response (default: 30)" << std::endl;
+    std::cerr << "  --open-files <n>    Per-file sample descriptors kept open (default: 512)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    ServerOptions options;
+    options.port = 8090;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--port" && has_value) {
+                options.port = std::stoi(argv[++i]);
+            } else if (arg == "--unix" && has_value) {
+                options.unix_path = argv[++i];
+            } else if (arg == "--read-ahead" && has_value) {
+                options.read_ahead = std::stoul(argv[++i]);
+            } else if (arg == "--open-files" && has_value) {
+                options.open_files = std::max(1ul, std::stoul(argv[++i]));
+            } else if (!arg.empty() && arg[0] == '-') {
+                printUsage(argv[0]);
+                return 2;
+            } else {
+                options.root = arg;
+            }
+        }
+    } catch (const std::exception& e) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (options.root.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::map<std::string, Camera> cameras;
+    findCameras(options.root, "", cameras);
+    if (cameras.empty()) {
+        std::cerr << "No samples found under " << options.root << std::endl;
+        return 1;
+    }
+    for (const auto& camera : cameras) {
+        std::cout << "📹 " << camera.first << ": " << camera.second.samples.size() << " samples"
+                  << (camera.second.archive_fd >= 0 ? " (packed)" : "") << std::endl;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int server_fd = listenSocket(options);
+    if (server_fd < 0) {
+        std::cerr << "Cannot listen: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    if (options.unix_path.empty()) {
+        std::cout << "✅ Serving on http://127.0.0.1:" << options.port << std::endl;
+    } else {
+        std::cout << "✅ Serving on unix:" << options.unix_path << std::endl;
+    }
+
+    SampleServer server(options, cameras);
+    while (true) {
+        int client_fd = accept4(server_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        std::thread(&SampleServer::serveClient, &server, client_fd).detach();
+    }
+
+    close(server_fd);
+    return 1;
+}
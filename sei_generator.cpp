@@ -4,12 +4,17 @@
 
 // Definition of static constexpr member (required for C++14)
 constexpr std::array<uint8_t, 16> SEIGenerator::TIMESTAMP_UUID;
+constexpr std::array<uint8_t, 16> SEIGenerator::TELEMETRY_UUID;
 
 std::vector<uint8_t> SEIGenerator::createTimestampSEI(uint64_t timestamp_us) {
     std::vector<uint8_t> timestamp_bytes = timestampToBytes(timestamp_us);
     return createUserDataSEI(TIMESTAMP_UUID, timestamp_bytes);
 }
 
+std::vector<uint8_t> SEIGenerator::createTelemetrySEI(const std::vector<uint8_t>& payload) {
+    return createUserDataSEI(TELEMETRY_UUID, payload);
+}
+
 std::vector<uint8_t> SEIGenerator::createSimpleTimestampSEI(uint64_t timestamp_us) {
     std::vector<uint8_t> sei_nal;
 
@@ -81,8 +86,18 @@ std::vector<uint8_t> SEIGenerator::createUserDataSEI(
     return nal_unit;
 }
 
+std::vector<uint8_t> SEIGenerator::createSimpleTimestampSEIAnnexB(uint64_t timestamp_us) {
+    std::vector<uint8_t> sei_nal = createSimpleTimestampSEI(timestamp_us);
+    std::vector<uint8_t> payload(sei_nal.begin() + 1, sei_nal.end());
+    std::vector<uint8_t> escaped = writeRBSP(payload);
+    sei_nal.resize(1);
+    sei_nal.insert(sei_nal.end(), escaped.begin(), escaped.end());
+    return sei_nal;
+}
+
 uint64_t SEIGenerator::extractTimestampFromSEI(const std::vector<uint8_t>& sei_nalu) {
-    if (!isTimestampSEI(sei_nalu)) {
+    // Check NAL unit type (isTimestampSEI() calls back into this function)
+    if (sei_nalu.size() < 2 || (sei_nalu[0] & 0x1F) != NAL_UNIT_TYPE_SEI) {
         return 0;
     }
 
@@ -96,7 +111,7 @@ uint64_t SEIGenerator::extractTimestampFromSEI(const std::vector<uint8_t>& sei_n
     pos = 0;
 
     // Skip payload type
-    if (payload[pos] != SEI_TYPE_USER_DATA_UNREGISTERED) {
+    if (payload.empty() || payload[pos] != SEI_TYPE_USER_DATA_UNREGISTERED) {
         return 0;
     }
     pos++;
@@ -189,15 +204,25 @@ uint64_t SEIGenerator::extractSimpleTimestampFromSEI(const std::vector<uint8_t>&
         return 0;
     }
 
+    // Length-prefixed samples carry the 12 bytes as is; a longer NAL comes from an
+    // Annex-B stream and holds emulation prevention bytes (createSimpleTimestampSEIAnnexB)
+    std::vector<uint8_t> payload(sei_nalu.begin() + 1, sei_nalu.end());
+    if (sei_nalu.size() > 12) {
+        payload = readRBSP(payload);
+        if (payload.size() < 10) {
+            return 0;
+        }
+    }
+
     // Check if it's our simple format
-    if (sei_nalu[1] != 0x01 || sei_nalu[2] != 0x08) { // payload_type=1, payload_size=8
+    if (payload[0] != 0x01 || payload[1] != 0x08) { // payload_type=1, payload_size=8
         return 0;
     }
 
-    // Extract 8-byte timestamp starting at offset 3
+    // Extract 8-byte timestamp after payload type and size
     uint64_t timestamp = 0;
     for (int i = 0; i < 8; i++) {
-        timestamp = (timestamp << 8) | sei_nalu[3 + i];
+        timestamp = (timestamp << 8) | payload[2 + i];
     }
 
     return timestamp;
@@ -205,15 +230,17 @@ uint64_t SEIGenerator::extractSimpleTimestampFromSEI(const std::vector<uint8_t>&
 
 std::vector<uint8_t> SEIGenerator::writeRBSP(const std::vector<uint8_t>& data) {
     std::vector<uint8_t> rbsp;
+    size_t zeros = 0;    // Zero bytes written since the last non-zero byte
 
     for (size_t i = 0; i < data.size(); i++) {
         // Check for emulation prevention: 0x00 0x00 0x00/0x01/0x02/0x03
-        if (i >= 2 && data[i - 2] == 0x00 && data[i - 1] == 0x00 &&
-            data[i] <= 0x03) {
+        if (zeros >= 2 && data[i] <= 0x03) {
             // Insert emulation prevention byte 0x03
             rbsp.push_back(0x03);
+            zeros = 0;
         }
         rbsp.push_back(data[i]);
+        zeros = data[i] == 0x00 ? zeros + 1 : 0;
     }
 
     return rbsp;
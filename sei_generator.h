@@ -23,6 +23,14 @@ private:
         0x54, 0x41, 0x4D, 0x50   // "TAMP"
     };
 
+    // "ROSBAG-TELEMETRY" identifier for per-frame telemetry (see telemetry.h)
+    static constexpr std::array<uint8_t, 16> TELEMETRY_UUID = {
+        0x52, 0x4F, 0x53, 0x42,  // "ROSB"
+        0x41, 0x47, 0x2D, 0x54,  // "AG-T"
+        0x45, 0x4C, 0x45, 0x4D,  // "ELEM"
+        0x45, 0x54, 0x52, 0x59   // "ETRY"
+    };
+
 public:
     /**
      * Create a SEI NAL unit containing a timestamp
@@ -38,6 +46,14 @@ public:
      */
     static std::vector<uint8_t> createSimpleTimestampSEI(uint64_t timestamp_us);
 
+    /**
+     * Create a simple timestamp SEI for an Annex-B stream, with emulation prevention
+     * bytes where the timestamp would otherwise contain a start code
+     * @param timestamp_us Timestamp in microseconds
+     * @return SEI NAL unit data (without start code)
+     */
+    static std::vector<uint8_t> createSimpleTimestampSEIAnnexB(uint64_t timestamp_us);
+
     /**
      * Create a SEI NAL unit with custom user data
      * @param uuid 16-byte UUID identifier
@@ -49,6 +65,13 @@ public:
         const std::vector<uint8_t>& data
     );
 
+    /**
+     * Create a user_data_unregistered SEI NAL unit carrying frame telemetry
+     * @param payload Payload built by TelemetrySidecar::seiPayload()
+     * @return SEI NAL unit data (without start code)
+     */
+    static std::vector<uint8_t> createTelemetrySEI(const std::vector<uint8_t>& payload);
+
     /**
      * Extract timestamp from a SEI NAL unit
      * @param sei_nalu SEI NAL unit data (without start code)
@@ -0,0 +1,150 @@
+#include "sprite_sheet.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+
+SpriteSheetBuilder::SpriteSheetBuilder(const std::string& output_dir, const SpriteOptions& options)
+    : output_dir_(output_dir), options_(options),
+      tiles_per_sheet_(static_cast<size_t>(std::max(1, options.columns) * std::max(1, options.rows))) {}
+
+long SpriteSheetBuilder::select(uint64_t timestamp_us, size_t frame_number) {
+    if (options_.interval_us == 0 || (!tiles_.empty() && timestamp_us < next_timestamp_us_)) {
+        return -1;
+    }
+
+    // Ticks follow the first tile, so a long gap yields one tile and not a burst
+    next_timestamp_us_ = timestamp_us + options_.interval_us;
+    tiles_.push_back(Tile{timestamp_us, frame_number});
+    return static_cast<long>(tiles_.size() - 1);
+}
+
+bool SpriteSheetBuilder::addTile(long ordinal, const cv::Mat& image) {
+    if (ordinal < 0 || image.empty()) {
+        return true;
+    }
+
+    cv::Size tile_size;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tile_size_.width == 0) {
+            int height = static_cast<int>(static_cast<double>(options_.tile_width) * image.rows / image.cols + 0.5);
+            tile_size_ = cv::Size(options_.tile_width, std::max(1, height));
+        }
+        tile_size = tile_size_;
+    }
+
+    // Downscale outside the lock; INTER_AREA avoids aliasing at large ratios
+    cv::Mat tile;
+    cv::resize(image, tile, tile_size, 0, 0, cv::INTER_AREA);
+    if (tile.channels() == 1) {
+        cv::cvtColor(tile, tile, cv::COLOR_GRAY2BGR);
+    }
+
+    size_t sheet_index = static_cast<size_t>(ordinal) / tiles_per_sheet_;
+    size_t position = static_cast<size_t>(ordinal) % tiles_per_sheet_;
+    int columns = std::max(1, options_.columns);
+    cv::Mat completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Sheet& sheet = open_sheets_[sheet_index];
+        if (sheet.pixels.empty()) {
+            sheet.pixels = cv::Mat(std::max(1, options_.rows) * tile_size.height, columns * tile_size.width,
+                                   CV_8UC3, cv::Scalar(0, 0, 0));
+        }
+
+        cv::Mat target = sheet.pixels(cv::Rect(static_cast<int>(position % columns) * tile_size.width,
+                                               static_cast<int>(position / columns) * tile_size.height,
+                                               tile_size.width, tile_size.height));
+        tile.copyTo(target);
+
+        if (++sheet.filled == tiles_per_sheet_) {
+            completed = sheet.pixels;
+            open_sheets_.erase(sheet_index);
+        }
+    }
+
+    if (!completed.empty()) {
+        return writeSheet(sheet_index, completed);
+    }
+    return true;
+}
+
+std::string SpriteSheetBuilder::sheetName(size_t sheet_index) const {
+    std::ostringstream name;
+    name << "sheet_" << std::setfill('0') << std::setw(4) << sheet_index << "." << options_.format;
+    return name.str();
+}
+
+bool SpriteSheetBuilder::writeSheet(size_t sheet_index, const cv::Mat& pixels) {
+    std::vector<int> params;
+    if (options_.format == "webp") {
+        params = {cv::IMWRITE_WEBP_QUALITY, 80};
+    } else {
+        params = {cv::IMWRITE_JPEG_QUALITY, 80};
+    }
+
+    std::vector<uint8_t> encoded;
+    bool ok = false;
+    try {
+        boost::filesystem::create_directories(output_dir_);
+        if (cv::imencode("." + options_.format, pixels, encoded, params)) {
+            std::ofstream file(output_dir_ + "/" + sheetName(sheet_index), std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            ok = static_cast<bool>(file);
+        }
+    } catch (const std::exception& e) {
+        ok = false;
+    }
+
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        write_failed_ = true;
+    }
+    return ok;
+}
+
+bool SpriteSheetBuilder::finish() {
+    if (tiles_.empty() || tile_size_.width == 0) {
+        return true;
+    }
+
+    // The last sheet is cropped to the rows it uses
+    int columns = std::max(1, options_.columns);
+    for (auto& sheet : open_sheets_) {
+        size_t used = std::min(tiles_per_sheet_, tiles_.size() - sheet.first * tiles_per_sheet_);
+        int used_rows = static_cast<int>((used + columns - 1) / columns);
+        cv::Mat cropped = sheet.second.pixels(cv::Rect(0, 0, sheet.second.pixels.cols, used_rows * tile_size_.height)).clone();
+        writeSheet(sheet.first, cropped);
+    }
+    open_sheets_.clear();
+
+    std::ofstream index(output_dir_ + "/sprites.json", std::ios::trunc);
+    index << "{\n"
+          << "  \"interval_us\": " << options_.interval_us << ",\n"
+          << "  \"tile_width\": " << tile_size_.width << ",\n"
+          << "  \"tile_height\": " << tile_size_.height << ",\n"
+          << "  \"columns\": " << columns << ",\n"
+          << "  \"rows\": " << std::max(1, options_.rows) << ",\n"
+          << "  \"sheets\": [";
+    size_t sheet_count = (tiles_.size() + tiles_per_sheet_ - 1) / tiles_per_sheet_;
+    for (size_t i = 0; i < sheet_count; i++) {
+        index << (i ? ", " : "") << "\"" << sheetName(i) << "\"";
+    }
+    index << "],\n"
+          << "  \"tiles\": [\n";
+    for (size_t i = 0; i < tiles_.size(); i++) {
+        size_t position = i % tiles_per_sheet_;
+        index << "    {\"timestamp_us\": " << tiles_[i].timestamp_us
+              << ", \"frame\": " << tiles_[i].frame_number
+              << ", \"sheet\": " << i / tiles_per_sheet_
+              << ", \"x\": " << (position % columns) * tile_size_.width
+              << ", \"y\": " << (position / columns) * tile_size_.height << "}"
+              << (i + 1 < tiles_.size() ? ",\n" : "\n");
+    }
+    index << "  ]\n"
+          << "}\n";
+
+    return static_cast<bool>(index) && !write_failed_;
+}
@@ -0,0 +1,91 @@
+#ifndef SPRITE_SHEET_H
+#define SPRITE_SHEET_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+#include <opencv2/opencv.hpp>
+
+// Timeline preview sprites of one topic.
+//
+// Every interval_us the extraction picks one frame, downscales it to a tile and places it
+// in a grid of columns x rows tiles. Full sheets are encoded as sheet_NNNN.<format> as soon
+// as their last tile arrives; finish() writes the last partial sheet and sprites.json,
+// which maps each tile to its timestamp, frame number, sheet and pixel position.
+//
+// select() is called by the bag reader in frame order; addTile() may be called from any
+// thread and in any order, since each tile carries the ordinal select() gave it.
+
+struct SpriteOptions {
+    uint64_t interval_us = 0;        // One tile per interval (0 = sprites disabled)
+    int tile_width = 160;            // Tile width in pixels; height keeps the first frame's aspect
+    int columns = 10;
+    int rows = 10;
+    std::string format = "jpg";      // "jpg" or "webp"
+};
+
+class SpriteSheetBuilder {
+public:
+    /**
+     * @param output_dir Directory for the sheets and sprites.json (created on first write)
+     * @param options Sprite layout
+     */
+    SpriteSheetBuilder(const std::string& output_dir, const SpriteOptions& options);
+
+    /**
+     * Decide whether a frame becomes a tile
+     * @param timestamp_us Frame timestamp
+     * @param frame_number Frame number within the topic
+     * @return Tile ordinal, or -1 if the frame is skipped
+     */
+    long select(uint64_t timestamp_us, size_t frame_number);
+
+    /**
+     * Downscale a frame into its tile; writes the sheet once it is complete
+     * @param ordinal Value returned by select()
+     * @param image Decoded frame (8-bit, 1 or 3 channels)
+     * @return false if a completed sheet could not be written
+     */
+    bool addTile(long ordinal, const cv::Mat& image);
+
+    /**
+     * Write the remaining partial sheet and sprites.json
+     * @return true on success
+     */
+    bool finish();
+
+    size_t tileCount() const { return tiles_.size(); }
+
+private:
+    struct Tile {
+        uint64_t timestamp_us;
+        size_t frame_number;
+    };
+
+    struct Sheet {
+        cv::Mat pixels;
+        size_t filled = 0;
+    };
+
+    bool writeSheet(size_t sheet_index, const cv::Mat& pixels);
+    std::string sheetName(size_t sheet_index) const;
+
+    std::string output_dir_;
+    SpriteOptions options_;
+    size_t tiles_per_sheet_;
+
+    // Reader side (select)
+    std::vector<Tile> tiles_;
+    uint64_t next_timestamp_us_ = 0;
+
+    // Worker side (addTile), guarded by mutex_
+    std::mutex mutex_;
+    cv::Size tile_size_;
+    std::map<size_t, Sheet> open_sheets_;
+    bool write_failed_ = false;
+};
+
+#endif // SPRITE_SHEET_H
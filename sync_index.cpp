@@ -0,0 +1,157 @@
+#include "sync_index.h"
+#include <fstream>
+#include <limits>
+#include <algorithm>
+
+namespace {
+
+void putU16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 3; i >= 0; i--) {
+        out.push_back((value >> (i * 8)) & 0xFF);
+    }
+}
+
+void putU64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        out.push_back((value >> (i * 8)) & 0xFF);
+    }
+}
+
+uint64_t distance(uint64_t a, uint64_t b) {
+    return a > b ? a - b : b - a;
+}
+
+int32_t clampSkew(int64_t skew) {
+    if (skew > std::numeric_limits<int32_t>::max()) {
+        return std::numeric_limits<int32_t>::max();
+    }
+    if (skew < std::numeric_limits<int32_t>::min()) {
+        return std::numeric_limits<int32_t>::min();
+    }
+    return static_cast<int32_t>(skew);
+}
+
+} // namespace
+
+bool SyncIndex::buildFromMaster(const std::map<std::string, std::vector<uint64_t>>& frame_times,
+                                const std::string& master) {
+    auto master_it = frame_times.find(master);
+    if (master_it == frame_times.end() || master_it->second.empty()) {
+        return false;
+    }
+
+    mode_ = 0;
+    tick_us_ = 0;
+    references_ = master_it->second;
+    start_us_ = references_.front();
+    fillRows(frame_times);
+    return true;
+}
+
+bool SyncIndex::buildFromTicks(const std::map<std::string, std::vector<uint64_t>>& frame_times, uint64_t tick_us) {
+    uint64_t start = std::numeric_limits<uint64_t>::max();
+    uint64_t end = 0;
+    for (const auto& topic : frame_times) {
+        if (!topic.second.empty()) {
+            start = std::min(start, topic.second.front());
+            end = std::max(end, topic.second.back());
+        }
+    }
+    if (tick_us == 0 || end < start) {
+        return false;
+    }
+
+    mode_ = 1;
+    tick_us_ = tick_us;
+    start_us_ = start;
+    references_.clear();
+    for (uint64_t t = start; t <= end; t += tick_us) {
+        references_.push_back(t);
+    }
+    fillRows(frame_times);
+    return true;
+}
+
+void SyncIndex::fillRows(const std::map<std::string, std::vector<uint64_t>>& frame_times) {
+    topics_.clear();
+    for (const auto& topic : frame_times) {
+        topics_.push_back(topic.first);
+    }
+
+    size_t topic_count = topics_.size();
+    entries_.assign(references_.size() * topic_count, SyncEntry{-1, 0});
+
+    // References and frames are both sorted, so one forward sweep per topic finds the
+    // nearest frame for every row
+    size_t column = 0;
+    for (const auto& topic : frame_times) {
+        const std::vector<uint64_t>& times = topic.second;
+        size_t nearest = 0;
+
+        for (size_t row = 0; row < references_.size() && !times.empty(); row++) {
+            uint64_t reference = references_[row];
+            while (nearest + 1 < times.size() &&
+                   distance(times[nearest + 1], reference) <= distance(times[nearest], reference)) {
+                nearest++;
+            }
+
+            SyncEntry& entry = entries_[row * topic_count + column];
+            entry.frame_index = static_cast<int32_t>(nearest);
+            entry.skew_us = clampSkew(static_cast<int64_t>(times[nearest]) - static_cast<int64_t>(reference));
+        }
+        column++;
+    }
+}
+
+bool SyncIndex::write(const std::string& output_dir) const {
+    std::vector<uint8_t> data;
+    const char magic[] = "SYNCIDX1";
+    data.insert(data.end(), magic, magic + 8);
+    putU32(data, static_cast<uint32_t>(topics_.size()));
+    putU32(data, mode_);
+    putU64(data, start_us_);
+    putU64(data, tick_us_);
+    putU64(data, references_.size());
+
+    for (const auto& topic : topics_) {
+        putU16(data, static_cast<uint16_t>(topic.size()));
+        data.insert(data.end(), topic.begin(), topic.end());
+    }
+
+    for (size_t row = 0; row < references_.size(); row++) {
+        putU64(data, references_[row]);
+        for (size_t column = 0; column < topics_.size(); column++) {
+            const SyncEntry& entry = entries_[row * topics_.size() + column];
+            putU32(data, static_cast<uint32_t>(entry.frame_index));
+            putU32(data, static_cast<uint32_t>(entry.skew_us));
+        }
+    }
+
+    std::ofstream binary(output_dir + "/" + SYNC_INDEX_FILENAME, std::ios::binary | std::ios::trunc);
+    binary.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!binary) {
+        return false;
+    }
+
+    // Human-readable copy of the same table
+    std::ofstream csv(output_dir + "/" + SYNC_INDEX_CSV_FILENAME, std::ios::trunc);
+    csv << "reference_us";
+    for (const auto& topic : topics_) {
+        csv << "," << topic << ":frame," << topic << ":skew_us";
+    }
+    csv << "\n";
+    for (size_t row = 0; row < references_.size(); row++) {
+        csv << references_[row];
+        for (size_t column = 0; column < topics_.size(); column++) {
+            const SyncEntry& entry = entries_[row * topics_.size() + column];
+            csv << "," << entry.frame_index << "," << entry.skew_us;
+        }
+        csv << "\n";
+    }
+    return static_cast<bool>(csv);
+}
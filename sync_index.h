@@ -0,0 +1,71 @@
+#ifndef SYNC_INDEX_H
+#define SYNC_INDEX_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+
+// Cross-camera synchronization table.
+//
+// Every row is a reference time (a frame of the master topic, or a fixed tick) and,
+// for each topic, the index of the nearest frame with its skew in microseconds.
+// A player seeks with one lookup instead of matching timestamps of all cameras.
+//
+// sync_index.bin layout (integers big-endian, like the sample archives):
+//   "SYNCIDX1" magic
+//   u32 topic_count, u32 mode (0 = master frames, 1 = fixed ticks)
+//   u64 start_us, u64 tick_us (0 in master mode), u64 row_count
+//   topic_count x (u16 name_length, name bytes)
+//   row_count x (u64 reference_us, topic_count x (i32 frame_index, i32 skew_us))
+//
+// In tick mode row = (t - start_us) / tick_us; in master mode rows are sorted by
+// reference_us. frame_index is -1 for a topic without frames; skew is frame - reference.
+
+constexpr const char* SYNC_INDEX_FILENAME = "sync_index.bin";
+constexpr const char* SYNC_INDEX_CSV_FILENAME = "sync_index.csv";
+
+struct SyncEntry {
+    int32_t frame_index;
+    int32_t skew_us;
+};
+
+class SyncIndex {
+public:
+    /**
+     * Build rows from the frames of a master topic
+     * @param frame_times Frame timestamps (us) per topic, each sorted ascending
+     * @param master Topic whose frames define the rows
+     * @return false if the master topic has no frames
+     */
+    bool buildFromMaster(const std::map<std::string, std::vector<uint64_t>>& frame_times, const std::string& master);
+
+    /**
+     * Build rows at a fixed tick over the time span covered by all topics
+     * @param frame_times Frame timestamps (us) per topic, each sorted ascending
+     * @param tick_us Row spacing in microseconds
+     * @return false if there are no frames or the tick is 0
+     */
+    bool buildFromTicks(const std::map<std::string, std::vector<uint64_t>>& frame_times, uint64_t tick_us);
+
+    /**
+     * Write sync_index.bin and sync_index.csv into a directory
+     * @param output_dir Destination directory
+     * @return true on success
+     */
+    bool write(const std::string& output_dir) const;
+
+    size_t rowCount() const { return references_.size(); }
+
+private:
+    void fillRows(const std::map<std::string, std::vector<uint64_t>>& frame_times);
+
+    std::vector<std::string> topics_;
+    std::vector<uint64_t> references_;
+    std::vector<SyncEntry> entries_;       // rowCount() x topics_.size()
+    uint32_t mode_ = 0;
+    uint64_t start_us_ = 0;
+    uint64_t tick_us_ = 0;
+};
+
+#endif // SYNC_INDEX_H
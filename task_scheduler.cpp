@@ -0,0 +1,252 @@
+#include "task_scheduler.h"
+#include "trace.h"
+#include <iostream>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+// Worker identity of the calling thread, used to route submit() to the own deque
+thread_local const TaskScheduler* current_scheduler = nullptr;
+thread_local size_t current_worker = 0;
+
+std::vector<int> currentThreadCpus() {
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &mask)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+} // namespace
+
+TaskScheduler::TaskScheduler(const SchedulerOptions& options)
+    : cpus_(availableCpus(options.reserved_cores)), options_(options) {
+    size_t thread_count = options.threads > 0 ? options.threads : cpus_.size();
+    thread_count = std::max<size_t>(1, thread_count);
+    max_queued_ = options.max_queued > 0 ? options.max_queued : thread_count * 2;
+
+    for (size_t i = 0; i < thread_count; i++) {
+        workers_.emplace_back(new Worker());
+    }
+    // Threads start once every deque exists, since any of them may be stolen from
+    for (size_t i = 0; i < thread_count; i++) {
+        workers_[i]->thread = std::thread(&TaskScheduler::run, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    space_available_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+std::vector<int> TaskScheduler::availableCpus(int reserved_cores) {
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &mask)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        unsigned count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned cpu = 0; cpu < count; cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+
+    size_t reserved = reserved_cores > 0 ? static_cast<size_t>(reserved_cores) : 0;
+    reserved = std::min(reserved, cpus.size() - 1);
+    cpus.erase(cpus.begin(), cpus.begin() + reserved);
+    return cpus;
+}
+
+bool TaskScheduler::restrictCurrentThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &mask);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+}
+
+void TaskScheduler::submit(Task task) {
+    size_t target;
+    if (current_scheduler == this) {
+        target = current_worker;
+    } else {
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        space_available_.wait(lock, [this] { return queued_ < max_queued_ || stopping_; });
+        target = next_worker_++ % workers_.size();
+    }
+
+    // Counted before the push, so a worker never sees a task the counter does not cover
+    queued_++;
+    {
+        std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+        workers_[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+    }
+    work_available_.notify_one();
+}
+
+bool TaskScheduler::takeTask(size_t own_index, Task& task) {
+    size_t count = workers_.size();
+    bool is_worker = own_index < count;
+
+    if (is_worker) {
+        Worker& own = *workers_[own_index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task, starting after the own deque so thieves spread out
+    size_t start = is_worker ? own_index + 1 : next_worker_.load();
+    for (size_t i = 0; i < count; i++) {
+        Worker& victim = *workers_[(start + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::execute(Task& task) {
+    queued_--;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+    }
+    space_available_.notify_one();
+
+    try {
+        task();
+    } catch (const std::exception& e) {
+        std::cerr << "Task failed: " << e.what() << std::endl;
+    }
+    task = nullptr;
+}
+
+bool TaskScheduler::runPendingTask() {
+    Task task;
+    size_t own_index = current_scheduler == this ? current_worker : workers_.size();
+    if (!takeTask(own_index, task)) {
+        return false;
+    }
+    execute(task);
+    return true;
+}
+
+void TaskScheduler::run(size_t index) {
+    current_scheduler = this;
+    current_worker = index;
+    TRACE_THREAD_NAME("worker");
+
+    if (options_.pin_threads) {
+        restrictCurrentThread({cpus_[index % cpus_.size()]});
+    } else if (options_.reserved_cores > 0) {
+        restrictCurrentThread(cpus_);
+    }
+
+    Task task;
+    while (true) {
+        if (takeTask(index, task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        work_available_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+        if (stopping_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+void TaskGroup::run(TaskScheduler::Task task) {
+    pending_++;
+    scheduler_.submit([this, task]() {
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "Task failed: " << e.what() << std::endl;
+        }
+        finish();
+    });
+}
+
+void TaskGroup::finish() {
+    // Under the lock, so a waiter that saw pending_ reach 0 cannot destroy the group
+    // while this is still running
+    std::lock_guard<std::mutex> lock(mutex_);
+    completed_++;
+    if (--pending_ == 0) {
+        done_.notify_all();
+    }
+}
+
+// Runs queued tasks while any are left, so a worker that waits on nested tasks does not
+// block the pool. Once nothing is queued, every unfinished task of the group is running
+// on some thread, so blocking until finish() signals cannot miss work.
+void TaskGroup::wait() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_ == 0) {
+                return;
+            }
+        }
+        if (scheduler_.runPendingTask()) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+        return;
+    }
+}
+
+// Does not run tasks: a queued task may be a whole topic encode, which would hold the
+// caller far past the timeout (the progress loops in process() and preview())
+bool TaskGroup::waitFor(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return done_.wait_for(lock, timeout, [this] { return pending_ == 0; });
+}
+
+ScopedAffinity::ScopedAffinity(const std::vector<int>& cpus) : previous_(currentThreadCpus()) {
+    TaskScheduler::restrictCurrentThread(cpus);
+}
+
+ScopedAffinity::~ScopedAffinity() {
+    TaskScheduler::restrictCurrentThread(previous_);
+}
@@ -0,0 +1,141 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstddef>
+
+// Work-stealing task scheduler shared by the extraction and encode stages.
+//
+// Every worker owns a deque. Tasks submitted from a worker go to the back of its own
+// deque and are taken LIFO (the data is still hot); an idle worker steals the oldest
+// task from the front of another deque. Tasks from outside the pool are spread over
+// the deques round-robin and block the submitter while max_queued tasks are waiting,
+// which keeps the bag reader from running ahead of the encoders.
+//
+// CPU placement: reserved_cores leaves the lowest-numbered CPUs of the process mask to
+// other services; pin_threads binds worker i to one of the remaining CPUs. Child
+// processes inherit the CPU mask of the thread that starts them, so encoders should be
+// started inside a ScopedAffinity over allowedCpus().
+
+struct SchedulerOptions {
+    size_t threads = 0;          // Worker threads (0 = one per allowed CPU)
+    int reserved_cores = 0;      // CPUs kept free for other services
+    bool pin_threads = false;    // Bind each worker to one CPU
+    size_t max_queued = 0;       // Waiting tasks before external submit() blocks (0 = 2 per worker)
+};
+
+class TaskScheduler {
+public:
+    typedef std::function<void()> Task;
+
+    explicit TaskScheduler(const SchedulerOptions& options = SchedulerOptions());
+
+    // Runs every queued task, then stops the workers
+    ~TaskScheduler();
+
+    /**
+     * Queue a task (blocks an external caller while too many tasks are waiting)
+     * @param task Work to run on some worker
+     */
+    void submit(Task task);
+
+    /**
+     * Run one queued task on the calling thread, so a waiting thread helps instead of idling
+     * @return false if no task was queued
+     */
+    bool runPendingTask();
+
+    size_t threadCount() const { return workers_.size(); }
+
+    // CPUs the workers may use (process mask minus reserved cores)
+    const std::vector<int>& allowedCpus() const { return cpus_; }
+
+    /**
+     * CPUs of the process affinity mask without the first reserved_cores of them
+     * @param reserved_cores CPUs to leave free (at least one CPU is always returned)
+     */
+    static std::vector<int> availableCpus(int reserved_cores);
+
+    /**
+     * Restrict the calling thread to a set of CPUs
+     * @return false if the mask could not be applied
+     */
+    static bool restrictCurrentThread(const std::vector<int>& cpus);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void run(size_t index);
+    bool takeTask(size_t own_index, Task& task);
+    void execute(Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<int> cpus_;
+    SchedulerOptions options_;
+    size_t max_queued_;
+
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> next_worker_{0};
+    std::mutex state_mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable space_available_;
+    bool stopping_ = false;
+};
+
+// Tasks that are waited for together (e.g. the frames of one extraction run)
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskScheduler& scheduler) : scheduler_(scheduler) {}
+
+    // Waits for the remaining tasks, so the data they reference outlives them
+    ~TaskGroup() { wait(); }
+
+    void run(TaskScheduler::Task task);
+
+    // Wait for all tasks of the group, running queued tasks meanwhile
+    void wait();
+
+    /**
+     * Wait for at most timeout without running tasks (for progress loops)
+     * @return true if all tasks of the group have finished
+     */
+    bool waitFor(std::chrono::milliseconds timeout);
+
+    size_t completed() const { return completed_; }
+
+private:
+    void finish();
+
+    TaskScheduler& scheduler_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> completed_{0};
+    std::mutex mutex_;
+    std::condition_variable done_;
+};
+
+// Sets the calling thread's CPU mask for a scope and restores it afterwards
+class ScopedAffinity {
+public:
+    explicit ScopedAffinity(const std::vector<int>& cpus);
+    ~ScopedAffinity();
+
+    ScopedAffinity(const ScopedAffinity&) = delete;
+    ScopedAffinity& operator=(const ScopedAffinity&) = delete;
+
+private:
+    std::vector<int> previous_;
+};
+
+#endif // TASK_SCHEDULER_H
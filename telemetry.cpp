@@ -0,0 +1,264 @@
+#include "telemetry.h"
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t SIDECAR_VERSION = 1;
+
+void putU16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 3; i >= 0; i--) {
+        out.push_back((value >> (i * 8)) & 0xFF);
+    }
+}
+
+void putU64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        out.push_back((value >> (i * 8)) & 0xFF);
+    }
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& value) {
+    size_t length = std::min<size_t>(value.size(), std::numeric_limits<uint16_t>::max());
+    putU16(out, static_cast<uint16_t>(length));
+    out.insert(out.end(), value.begin(), value.begin() + length);
+}
+
+// Bounds-checked big-endian reader over a loaded file
+struct Cursor {
+    const std::vector<uint8_t>& data;
+    size_t position;
+
+    bool get(size_t size, const uint8_t*& bytes) {
+        if (data.size() - position < size) {
+            return false;
+        }
+        bytes = &data[position];
+        position += size;
+        return true;
+    }
+
+    bool getUnsigned(size_t size, uint64_t& value) {
+        const uint8_t* bytes;
+        if (!get(size, bytes)) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = 0; i < size; i++) {
+            value = (value << 8) | bytes[i];
+        }
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint64_t length;
+        const uint8_t* bytes;
+        if (!getUnsigned(2, length) || !get(length, bytes)) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(bytes), length);
+        return true;
+    }
+};
+
+int32_t clampSkew(int64_t skew) {
+    if (skew > std::numeric_limits<int32_t>::max()) {
+        return std::numeric_limits<int32_t>::max();
+    }
+    if (skew < std::numeric_limits<int32_t>::min()) {
+        return std::numeric_limits<int32_t>::min();
+    }
+    return static_cast<int32_t>(skew);
+}
+
+void putEntry(std::vector<uint8_t>& out, size_t track, int64_t skew_us, const uint8_t* data, size_t size) {
+    out.push_back(static_cast<uint8_t>(track));
+    putU32(out, static_cast<uint32_t>(clampSkew(skew_us)));
+    putU16(out, static_cast<uint16_t>(size));
+    out.insert(out.end(), data, data + size);
+}
+
+std::vector<uint8_t> encodeTrackTable(const std::vector<TelemetryTrack>& tracks) {
+    std::vector<uint8_t> table;
+    putU16(table, static_cast<uint16_t>(tracks.size()));
+    for (const auto& track : tracks) {
+        table.push_back(static_cast<uint8_t>(track.kind));
+        putString(table, track.topic);
+        putString(table, track.datatype);
+    }
+    return table;
+}
+
+} // namespace
+
+size_t TelemetryRecorder::addTrack(const std::string& topic, const std::string& datatype, TelemetryKind kind) {
+    tracks_.push_back(TelemetryTrack{topic, datatype, kind});
+    series_.emplace_back();
+    return tracks_.size() - 1;
+}
+
+void TelemetryRecorder::addMessage(size_t track, uint64_t timestamp_us, const uint8_t* data, size_t size) {
+    if (size > std::numeric_limits<uint16_t>::max()) {
+        return;
+    }
+    Series& series = series_[track];
+    series.timestamps_us.push_back(timestamp_us);
+    series.data.emplace_back(data, data + size);
+}
+
+void TelemetryRecorder::addValues(size_t track, uint64_t timestamp_us, const std::vector<double>& values) {
+    Series& series = series_[track];
+    series.timestamps_us.push_back(timestamp_us);
+    series.values.push_back(values);
+}
+
+size_t TelemetryRecorder::messageCount() const {
+    size_t count = 0;
+    for (const auto& series : series_) {
+        count += series.timestamps_us.size();
+    }
+    return count;
+}
+
+std::vector<uint8_t> TelemetryRecorder::frameEntries(uint64_t frame_us) const {
+    std::vector<uint8_t> entries;
+    uint8_t entry_count = 0;
+    entries.push_back(0);
+
+    // Entry track numbers are one byte; later tracks are not embedded
+    size_t track_limit = std::min<size_t>(tracks_.size(), std::numeric_limits<uint8_t>::max());
+    for (size_t track = 0; track < track_limit; track++) {
+        const Series& series = series_[track];
+        const std::vector<uint64_t>& times = series.timestamps_us;
+        if (times.empty()) {
+            continue;
+        }
+
+        // First message at or after the frame, and the one before it
+        size_t after = std::lower_bound(times.begin(), times.end(), frame_us) - times.begin();
+        size_t before = after > 0 ? after - 1 : 0;
+        if (after == times.size()) {
+            after = before;
+        }
+        uint64_t before_distance = frame_us > times[before] ? frame_us - times[before] : times[before] - frame_us;
+        uint64_t after_distance = times[after] > frame_us ? times[after] - frame_us : frame_us - times[after];
+        size_t nearest = after_distance < before_distance ? after : before;
+        int64_t skew_us = static_cast<int64_t>(frame_us) - static_cast<int64_t>(times[nearest]);
+
+        if (tracks_[track].kind == TelemetryKind::Interpolated) {
+            // Between two messages the values are interpolated; outside the recorded
+            // span the nearest message is held
+            const std::vector<double>& first = series.values[before];
+            const std::vector<double>& second = series.values[after];
+            double weight = 0.0;
+            if (after != before && times[after] > times[before] && frame_us > times[before]) {
+                weight = static_cast<double>(frame_us - times[before]) / (times[after] - times[before]);
+            } else if (nearest == after) {
+                weight = 1.0;
+            }
+
+            std::vector<uint8_t> data;
+            for (size_t i = 0; i < first.size() && i < second.size(); i++) {
+                double value = first[i] + (second[i] - first[i]) * weight;
+                uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                putU64(data, bits);
+            }
+            putEntry(entries, track, skew_us, data.data(), data.size());
+        } else {
+            const std::vector<uint8_t>& data = series.data[nearest];
+            putEntry(entries, track, skew_us, data.data(), data.size());
+        }
+        entry_count++;
+    }
+
+    entries[0] = entry_count;
+    return entries;
+}
+
+bool TelemetryRecorder::writeSidecar(const std::string& path, const std::vector<uint64_t>& frame_times) const {
+    std::vector<uint8_t> data;
+    const char magic[] = "TELEMTRY";
+    data.insert(data.end(), magic, magic + 8);
+    putU32(data, SIDECAR_VERSION);
+
+    std::vector<uint8_t> table = encodeTrackTable(tracks_);
+    data.insert(data.end(), table.begin(), table.end());
+
+    putU64(data, frame_times.size());
+    for (uint64_t frame_us : frame_times) {
+        std::vector<uint8_t> entries = frameEntries(frame_us);
+        putU32(data, static_cast<uint32_t>(entries.size()));
+        data.insert(data.end(), entries.begin(), entries.end());
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    return static_cast<bool>(file);
+}
+
+bool TelemetrySidecar::read(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Cursor cursor{data, 0};
+    const uint8_t* magic;
+    uint64_t version, track_count, frame_count;
+    if (!cursor.get(8, magic) || std::memcmp(magic, "TELEMTRY", 8) != 0 ||
+        !cursor.getUnsigned(4, version) || version != SIDECAR_VERSION ||
+        !cursor.getUnsigned(2, track_count)) {
+        return false;
+    }
+
+    size_t table_start = cursor.position - 2;
+    tracks_.clear();
+    for (uint64_t i = 0; i < track_count; i++) {
+        TelemetryTrack track;
+        uint64_t kind;
+        if (!cursor.getUnsigned(1, kind) || !cursor.getString(track.topic) || !cursor.getString(track.datatype)) {
+            return false;
+        }
+        track.kind = static_cast<TelemetryKind>(kind);
+        tracks_.push_back(track);
+    }
+    track_table_.assign(data.begin() + table_start, data.begin() + cursor.position);
+
+    if (!cursor.getUnsigned(8, frame_count)) {
+        return false;
+    }
+    frames_.clear();
+    for (uint64_t i = 0; i < frame_count; i++) {
+        uint64_t length;
+        const uint8_t* entries;
+        if (!cursor.getUnsigned(4, length) || !cursor.get(length, entries)) {
+            return false;
+        }
+        frames_.emplace_back(entries, entries + length);
+    }
+    return true;
+}
+
+std::vector<uint8_t> TelemetrySidecar::seiPayload(size_t frame_index, bool include_tracks) const {
+    std::vector<uint8_t> payload;
+    if (frame_index >= frames_.size() || frames_[frame_index].empty() || frames_[frame_index][0] == 0) {
+        return payload;
+    }
+
+    payload.push_back(TELEMETRY_SEI_VERSION);
+    payload.push_back(include_tracks ? TELEMETRY_FLAG_TRACK_TABLE : 0);
+    if (include_tracks) {
+        payload.insert(payload.end(), track_table_.begin(), track_table_.end());
+    }
+    payload.insert(payload.end(), frames_[frame_index].begin(), frames_[frame_index].end());
+    return payload;
+}
@@ -0,0 +1,118 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Non-image topics sampled at every video frame.
+//
+// The extraction records the messages of the configured telemetry topics in the same
+// traversal as the images. After extraction every frame gets one entry per topic: the
+// nearest message (raw ROS serialization), or for numeric tracks the values linearly
+// interpolated at the frame time. The injector embeds them as a user_data_unregistered
+// SEI next to the timestamp SEI, so a viewer needs no separate alignment step.
+//
+// telemetry.bin (next to the frames of an image topic; integers big-endian):
+//   "TELEMTRY" magic, u32 version
+//   u16 track_count, track_count x (u8 kind, u16 topic_length, topic, u16 type_length, datatype)
+//   u64 frame_count, frame_count x (u32 entries_length, entries)
+//
+// Frame entries, and the SEI payload built from them:
+//   SEI: u8 version, u8 flags (bit 0: track table follows), [track table as above], entries
+//   entries: u8 entry_count, entry_count x (u8 track, i32 skew_us, u16 data_length, data)
+//
+// skew_us is frame time - time of the nearest message used. Interpolated data is
+// big-endian IEEE-754 f64 values; the track table is only sent on keyframes.
+
+constexpr const char* TELEMETRY_FILENAME = "telemetry.bin";
+constexpr uint8_t TELEMETRY_SEI_VERSION = 1;
+constexpr uint8_t TELEMETRY_FLAG_TRACK_TABLE = 0x01;
+
+enum class TelemetryKind : uint8_t {
+    Nearest = 0,        // Raw serialized message nearest to the frame
+    Interpolated = 1    // f64 values interpolated between the surrounding messages
+};
+
+struct TelemetryTrack {
+    std::string topic;
+    std::string datatype;
+    TelemetryKind kind = TelemetryKind::Nearest;
+};
+
+class TelemetryRecorder {
+public:
+    /**
+     * Register a topic; messages are added in bag time order
+     * @return Track number used by addMessage()/addValues()
+     */
+    size_t addTrack(const std::string& topic, const std::string& datatype, TelemetryKind kind);
+
+    /**
+     * Record a raw message of a Nearest track
+     * @param track Track number
+     * @param timestamp_us Message time
+     * @param data Serialized message
+     * @param size Size in bytes (messages over 65535 bytes are dropped)
+     */
+    void addMessage(size_t track, uint64_t timestamp_us, const uint8_t* data, size_t size);
+
+    /**
+     * Record the numeric fields of an Interpolated track
+     * @param track Track number
+     * @param timestamp_us Message time
+     * @param values Field values (same count for every message of the track)
+     */
+    void addValues(size_t track, uint64_t timestamp_us, const std::vector<double>& values);
+
+    /**
+     * Sample all tracks at each frame time and write telemetry.bin
+     * @param path Destination file
+     * @param frame_times Frame timestamps (us) of one image topic
+     * @return true on success
+     */
+    bool writeSidecar(const std::string& path, const std::vector<uint64_t>& frame_times) const;
+
+    const std::vector<TelemetryTrack>& tracks() const { return tracks_; }
+    size_t messageCount() const;
+
+private:
+    struct Series {
+        std::vector<uint64_t> timestamps_us;
+        std::vector<std::vector<uint8_t>> data;       // Nearest tracks
+        std::vector<std::vector<double>> values;      // Interpolated tracks
+    };
+
+    std::vector<uint8_t> frameEntries(uint64_t frame_us) const;
+
+    std::vector<TelemetryTrack> tracks_;
+    std::vector<Series> series_;
+};
+
+class TelemetrySidecar {
+public:
+    /**
+     * Load telemetry.bin
+     * @param path File written by TelemetryRecorder::writeSidecar()
+     * @return false if the file is missing or malformed
+     */
+    bool read(const std::string& path);
+
+    /**
+     * Build the SEI payload of a frame
+     * @param frame_index Frame number within the topic
+     * @param include_tracks Prepend the track table (keyframes)
+     * @return Payload for SEIGenerator::createTelemetrySEI(), empty if the frame has no entries
+     */
+    std::vector<uint8_t> seiPayload(size_t frame_index, bool include_tracks) const;
+
+    size_t frameCount() const { return frames_.size(); }
+    const std::vector<TelemetryTrack>& tracks() const { return tracks_; }
+
+private:
+    std::vector<TelemetryTrack> tracks_;
+    std::vector<uint8_t> track_table_;                // Encoded as in the file
+    std::vector<std::vector<uint8_t>> frames_;        // Encoded entries per frame
+};
+
+#endif // TELEMETRY_H
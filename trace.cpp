@@ -0,0 +1,147 @@
+#include "trace.h"
+#include <atomic>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint64_t start_us;
+    uint64_t duration_us;
+};
+
+constexpr size_t CHUNK_EVENTS = 4096;
+constexpr size_t MAX_CHUNKS = 256;     // 1M spans per thread; later spans are counted as dropped
+
+// Written only by its thread. Chunks are allocated before count is published with
+// release order, so write() can read any thread's spans without stopping it.
+struct ThreadBuffer {
+    long tid = 0;
+    std::atomic<const char*> name{nullptr};
+    std::array<std::unique_ptr<Event[]>, MAX_CHUNKS> chunks;
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> dropped{0};
+};
+
+std::atomic<bool> trace_enabled{false};
+std::mutex registry_mutex;                               // Guards buffers and trace_path
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;      // Kept after their threads exit
+std::string trace_path;
+
+thread_local ThreadBuffer* thread_buffer = nullptr;
+
+ThreadBuffer& currentBuffer() {
+    if (!thread_buffer) {
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+        buffer->tid = static_cast<long>(syscall(SYS_gettid));
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        thread_buffer = buffer.get();
+        buffers.push_back(std::move(buffer));
+    }
+    return *thread_buffer;
+}
+
+} // namespace
+
+void Trace::start(const std::string& path) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    trace_path = path;
+    trace_enabled.store(true, std::memory_order_release);
+}
+
+bool Trace::enabled() {
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+bool Trace::compiledIn() {
+#ifdef ENABLE_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t Trace::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Trace::nameThread(const char* name) {
+    currentBuffer().name.store(name, std::memory_order_release);
+}
+
+void Trace::record(const char* name, uint64_t start_us) {
+    if (!enabled()) {
+        return;
+    }
+    uint64_t end_us = now();
+
+    ThreadBuffer& buffer = currentBuffer();
+    size_t index = buffer.count.load(std::memory_order_relaxed);
+    size_t chunk = index / CHUNK_EVENTS;
+    if (chunk >= MAX_CHUNKS) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!buffer.chunks[chunk]) {
+        buffer.chunks[chunk].reset(new Event[CHUNK_EVENTS]);
+    }
+    buffer.chunks[chunk][index % CHUNK_EVENTS] = Event{name, start_us, end_us - start_us};
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+bool Trace::write() {
+    if (!trace_enabled.exchange(false)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    std::ofstream out(trace_path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Failed to create trace: " << trace_path << std::endl;
+        return false;
+    }
+
+    long pid = static_cast<long>(getpid());
+    size_t span_count = 0;
+    size_t dropped = 0;
+    bool first = true;
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (const auto& buffer : buffers) {
+        const char* thread_name = buffer->name.load(std::memory_order_acquire);
+        if (thread_name) {
+            out << (first ? "" : ",\n")
+                << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid << ", \"tid\": " << buffer->tid
+                << ", \"args\": {\"name\": \"" << thread_name << "\"}}";
+            first = false;
+        }
+
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            const Event& event = buffer->chunks[i / CHUNK_EVENTS][i % CHUNK_EVENTS];
+            out << (first ? "" : ",\n")
+                << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": " << pid
+                << ", \"tid\": " << buffer->tid << ", \"ts\": " << event.start_us
+                << ", \"dur\": " << event.duration_us << "}";
+            first = false;
+        }
+        span_count += count;
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    out << "\n]}\n";
+
+    std::cout << "⏱️  Trace: " << span_count << " spans from " << buffers.size() << " threads written to "
+              << trace_path << std::endl;
+    if (dropped > 0) {
+        std::cout << "⚠️  " << dropped << " spans dropped (per-thread buffer full)" << std::endl;
+    }
+    return static_cast<bool>(out);
+}
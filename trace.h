@@ -0,0 +1,97 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <cstdint>
+
+// Timeline tracing in the Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+//
+// Spans are recorded with the TRACE_* macros. Without ENABLE_TRACING the macros expand
+// to nothing, so release builds carry no tracing code at all. With it, a span costs one
+// relaxed atomic load while tracing is stopped, and two clock reads plus an append to
+// the calling thread's own buffer while it runs: threads never share a lock or a cache
+// line on the recording path.
+//
+// Span names must be string literals (only the pointer is stored). Timestamps come
+// from the monotonic clock, so traces of the tools in one run (e.g. rosbag_analyzed and
+// the injector) share a time base and can be opened side by side.
+
+class Trace {
+public:
+    /**
+     * Start recording; spans before this call and after write() are ignored
+     * @param path Destination of the JSON trace
+     */
+    static void start(const std::string& path);
+
+    /**
+     * Stop recording and write every thread's spans as a Chrome trace JSON file
+     * @return true on success (also true if tracing was never started)
+     */
+    static bool write();
+
+    /**
+     * Name the calling thread in the trace (e.g. "jpeg_writer")
+     * @param name String literal
+     */
+    static void nameThread(const char* name);
+
+    /**
+     * Record a finished span of the calling thread
+     * @param name String literal
+     * @param start_us Start time from now()
+     */
+    static void record(const char* name, uint64_t start_us);
+
+    static bool enabled();
+    static uint64_t now();
+
+    // True if this build records spans (ENABLE_TRACING)
+    static bool compiledIn();
+};
+
+// Records a span from construction to the end of the scope
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name_(name), start_us_(Trace::enabled() ? Trace::now() : 0) {}
+    ~TraceSpan() {
+        if (start_us_ != 0) {
+            Trace::record(name_, start_us_);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    uint64_t start_us_;
+};
+
+// Resets a TRACE_MARK variable when the scope ends, so a loop can time the work
+// between its iterations (e.g. advancing a bag view) despite early continues
+struct TraceMarkOnExit {
+    uint64_t& mark;
+    ~TraceMarkOnExit() { mark = Trace::enabled() ? Trace::now() : 0; }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_TRACING
+// Span covering the rest of the enclosing scope
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+// Span between TRACE_MARK(var) and TRACE_SINCE(name, var), for work that is not a scope
+#define TRACE_MARK(var) uint64_t var = Trace::enabled() ? Trace::now() : 0
+#define TRACE_SINCE(name, var) do { if (var != 0) Trace::record(name, var); } while (0)
+#define TRACE_MARK_ON_EXIT(var) TraceMarkOnExit TRACE_CONCAT(trace_mark_, __LINE__){var}
+#define TRACE_THREAD_NAME(name) Trace::nameThread(name)
+#else
+#define TRACE_SPAN(name) do {} while (0)
+#define TRACE_MARK(var) do {} while (0)
+#define TRACE_SINCE(name, var) do {} while (0)
+#define TRACE_MARK_ON_EXIT(var) do {} while (0)
+#define TRACE_THREAD_NAME(name) do {} while (0)
+#endif
+
+#endif // TRACE_H